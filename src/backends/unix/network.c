@@ -24,6 +24,10 @@
  * =======================================================================
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+ #define _GNU_SOURCE
+#endif
+
 #include "../../common/header/common.h"
 
 #include <unistd.h>
@@ -44,10 +48,19 @@
 #include <arpa/inet.h>
 #include <net/if.h>
 
+/* recvmmsg(), sendmmsg(), epoll and timerfd
+   are only available on Linux. */
+#if defined(__linux__)
+ #define NET_BATCHIO
+ #define NET_EPOLL
+ #include <sys/epoll.h>
+ #include <sys/timerfd.h>
+#endif
+
 netadr_t net_local_adr;
 
 #define LOOPBACK 0x7f000001
-#define MAX_LOOPBACK 4
+#define MAX_LOOPBACK 16
 #define QUAKE2MCAST "ff12::666"
 
 typedef struct
@@ -71,6 +84,61 @@ char *multicast_interface = NULL;
 int NET_Socket(char *net_interface, int port, netsrc_t type, int family);
 char *NET_ErrorString(void);
 
+#ifdef NET_BATCHIO
+/* Number of datagrams read or written by one syscall. */
+#define NET_BATCH_SIZE 64
+
+typedef struct
+{
+	byte data[MAX_MSGLEN];
+	int datalen;
+	netadr_t from;
+} netrecv_t;
+
+typedef struct
+{
+	byte data[MAX_MSGLEN];
+	int datalen;
+	int socket;
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	netadr_t to;
+} netsend_t;
+
+typedef struct
+{
+	unsigned int recvpackets;
+	unsigned int recvcalls;
+	unsigned int sendpackets;
+	unsigned int sendcalls;
+} netstats_t;
+
+/* Server datagrams read by the last recvmmsg()
+   calls and not yet handed to NET_GetPacket(). */
+static netrecv_t net_recvring[NET_BATCH_SIZE];
+static int net_recvget, net_recvcount;
+
+/* Server datagrams queued between NET_BeginSendBatch()
+   and NET_FlushSendBatch(). */
+static netsend_t net_sendqueue[NET_BATCH_SIZE];
+static int net_sendcount;
+static qboolean net_sendbatch;
+
+static netstats_t net_stats;
+static cvar_t *net_batchio;
+#endif
+
+#ifdef NET_EPOLL
+/* NET_Wait() sleeps in epoll_wait() on the server
+   sockets, stdin and a timerfd for the timeout. */
+static int net_epollfd = -1;
+static int net_timerfd = -1;
+
+/* Descriptors currently registered with net_epollfd:
+   IPv4 socket, IPv6 socket and stdin. -1 if none. */
+static int net_epollwatched[3] = {-1, -1, -1};
+#endif
+
 void
 NetadrToSockadr(netadr_t *a, struct sockaddr_storage *s)
 {
@@ -184,9 +252,31 @@ SockadrToNetadr(struct sockaddr_storage *s, netadr_t *a)
 	}
 }
 
+#ifdef NET_BATCHIO
+static void
+NET_Stats_f(void)
+{
+	Com_Printf("recv: %u packets in %u syscalls (%.2f per call)\n",
+			net_stats.recvpackets, net_stats.recvcalls, net_stats.recvcalls ?
+			(float)net_stats.recvpackets / net_stats.recvcalls : 0.0f);
+	Com_Printf("send: %u packets in %u syscalls (%.2f per call)\n",
+			net_stats.sendpackets, net_stats.sendcalls, net_stats.sendcalls ?
+			(float)net_stats.sendpackets / net_stats.sendcalls : 0.0f);
+
+	if ((Cmd_Argc() > 1) && !strcmp(Cmd_Argv(1), "reset"))
+	{
+		memset(&net_stats, 0, sizeof(net_stats));
+	}
+}
+#endif
+
 void
 NET_Init()
 {
+#ifdef NET_BATCHIO
+	net_batchio = Cvar_Get("net_batchio", "1", CVAR_ARCHIVE);
+	Cmd_AddCommand("net_stats", NET_Stats_f);
+#endif
 }
 
 qboolean
@@ -511,6 +601,153 @@ NET_SendLoopPacket(netsrc_t sock, int length, void *data, netadr_t to)
 	loop->msgs[i].datalen = length;
 }
 
+#ifdef NET_BATCHIO
+/*
+ * Drains the server sockets into net_recvring with as
+ * few recvmmsg() calls as possible. Returns false if
+ * the kernel doesn't support recvmmsg().
+ */
+static qboolean
+NET_FillRecvRing(netsrc_t sock)
+{
+	struct mmsghdr msgs[NET_BATCH_SIZE];
+	struct iovec iovecs[NET_BATCH_SIZE];
+	struct sockaddr_storage froms[NET_BATCH_SIZE];
+	int net_socket;
+	int protocol;
+	int first;
+	int ret;
+	int i;
+
+	net_recvget = 0;
+	net_recvcount = 0;
+
+	for (protocol = 0; protocol < 3; protocol++)
+	{
+		if (protocol == 0)
+		{
+			net_socket = ip_sockets[sock];
+		}
+		else if (protocol == 1)
+		{
+			net_socket = ip6_sockets[sock];
+		}
+		else
+		{
+			net_socket = ipx_sockets[sock];
+		}
+
+		if (!net_socket)
+		{
+			continue;
+		}
+
+		first = net_recvcount;
+
+		for (i = first; i < NET_BATCH_SIZE; i++)
+		{
+			iovecs[i].iov_base = net_recvring[i].data;
+			iovecs[i].iov_len = sizeof(net_recvring[i].data);
+
+			memset(&msgs[i], 0, sizeof(msgs[i]));
+			msgs[i].msg_hdr.msg_name = &froms[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(froms[i]);
+			msgs[i].msg_hdr.msg_iov = &iovecs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		ret = recvmmsg(net_socket, &msgs[first], NET_BATCH_SIZE - first,
+				MSG_DONTWAIT, NULL);
+
+		if (ret == -1)
+		{
+			if (errno == ENOSYS)
+			{
+				return false;
+			}
+
+			if ((errno != EWOULDBLOCK) && (errno != ECONNREFUSED))
+			{
+				Com_Printf("NET_GetPacket: %s\n", NET_ErrorString());
+			}
+
+			continue;
+		}
+
+		net_stats.recvcalls++;
+		net_stats.recvpackets += ret;
+
+		for (i = first; i < first + ret; i++)
+		{
+			memset(&net_recvring[net_recvcount].from, 0, sizeof(netadr_t));
+			SockadrToNetadr(&froms[i], &net_recvring[net_recvcount].from);
+
+			if (msgs[i].msg_len >= sizeof(net_recvring[i].data))
+			{
+				Com_Printf("Oversize packet from %s\n",
+						NET_AdrToString(net_recvring[net_recvcount].from));
+				continue;
+			}
+
+			/* close the gap left by dropped packets */
+			if (i != net_recvcount)
+			{
+				memcpy(net_recvring[net_recvcount].data, net_recvring[i].data,
+						msgs[i].msg_len);
+			}
+
+			net_recvring[net_recvcount].datalen = msgs[i].msg_len;
+			net_recvcount++;
+		}
+
+		if (net_recvcount == NET_BATCH_SIZE)
+		{
+			break;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Returns the next datagram from net_recvring,
+ * refilling it from the sockets when empty.
+ */
+static qboolean
+NET_GetBatchedPacket(netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message)
+{
+	netrecv_t *msg;
+
+	if (net_recvget >= net_recvcount)
+	{
+		if (!net_batchio->value)
+		{
+			return false;
+		}
+
+		if (!NET_FillRecvRing(sock))
+		{
+			Com_Printf("NET_GetPacket: recvmmsg() not supported, disabling net_batchio\n");
+			Cvar_Set("net_batchio", "0");
+			return false;
+		}
+
+		if (!net_recvcount)
+		{
+			return false;
+		}
+	}
+
+	msg = &net_recvring[net_recvget++];
+
+	memcpy(net_message->data, msg->data, msg->datalen);
+	net_message->cursize = msg->datalen;
+	*net_from = msg->from;
+
+	return true;
+}
+#endif
+
 qboolean
 NET_GetPacket(netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message)
 {
@@ -526,6 +763,23 @@ NET_GetPacket(netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message)
 		return true;
 	}
 
+#ifdef NET_BATCHIO
+	/* packets left in the ring are returned even
+	   if net_batchio was switched off meanwhile */
+	if ((sock == NS_SERVER) && (net_batchio->value || (net_recvget < net_recvcount)))
+	{
+		if (NET_GetBatchedPacket(sock, net_from, net_message))
+		{
+			return true;
+		}
+
+		if (net_batchio->value)
+		{
+			return false;
+		}
+	}
+#endif
+
 	for (protocol = 0; protocol < 3; protocol++)
 	{
 		if (protocol == 0)
@@ -579,6 +833,110 @@ NET_GetPacket(netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message)
 	return false;
 }
 
+#ifdef NET_BATCHIO
+/*
+ * Writes all queued server datagrams. Consecutive
+ * packets for the same socket go out in a single
+ * sendmmsg() call.
+ */
+static void
+NET_SendQueue(void)
+{
+	struct mmsghdr msgs[NET_BATCH_SIZE];
+	struct iovec iovecs[NET_BATCH_SIZE];
+	netsend_t *msg;
+	int first, last;
+	int ret;
+	int i;
+
+	for (i = 0; i < net_sendcount; i++)
+	{
+		msg = &net_sendqueue[i];
+
+		iovecs[i].iov_base = msg->data;
+		iovecs[i].iov_len = msg->datalen;
+
+		memset(&msgs[i], 0, sizeof(msgs[i]));
+		msgs[i].msg_hdr.msg_name = &msg->addr;
+		msgs[i].msg_hdr.msg_namelen = msg->addrlen;
+		msgs[i].msg_hdr.msg_iov = &iovecs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	first = 0;
+
+	while (first < net_sendcount)
+	{
+		for (last = first + 1; last < net_sendcount; last++)
+		{
+			if (net_sendqueue[last].socket != net_sendqueue[first].socket)
+			{
+				break;
+			}
+		}
+
+		ret = sendmmsg(net_sendqueue[first].socket, &msgs[first],
+				last - first, 0);
+
+		if (ret == -1)
+		{
+			/* the first packet failed, report
+			   and skip it, retry the rest */
+			Com_Printf("NET_SendPacket ERROR: %s to %s\n", NET_ErrorString(),
+					NET_AdrToString(net_sendqueue[first].to));
+			first++;
+			continue;
+		}
+
+		net_stats.sendcalls++;
+		net_stats.sendpackets += ret;
+		first += ret;
+	}
+
+	net_sendcount = 0;
+}
+
+/*
+ * Starts queueing datagrams sent through the server
+ * socket instead of writing them one by one.
+ */
+void
+NET_BeginSendBatch(netsrc_t sock)
+{
+	if ((sock != NS_SERVER) || !net_batchio->value)
+	{
+		return;
+	}
+
+	net_sendbatch = true;
+}
+
+/*
+ * Writes all datagrams queued since NET_BeginSendBatch().
+ */
+void
+NET_FlushSendBatch(netsrc_t sock)
+{
+	if (sock != NS_SERVER)
+	{
+		return;
+	}
+
+	NET_SendQueue();
+	net_sendbatch = false;
+}
+#else
+void
+NET_BeginSendBatch(netsrc_t sock)
+{
+}
+
+void
+NET_FlushSendBatch(netsrc_t sock)
+{
+}
+#endif
+
 void
 NET_SendPacket(netsrc_t sock, int length, void *data, netadr_t to)
 {
@@ -720,6 +1078,28 @@ NET_SendPacket(netsrc_t sock, int length, void *data, netadr_t to)
 		}
 	}
 
+#ifdef NET_BATCHIO
+	if (net_sendbatch && (sock == NS_SERVER) && (length <= MAX_MSGLEN))
+	{
+		netsend_t *msg;
+
+		if (net_sendcount == NET_BATCH_SIZE)
+		{
+			NET_SendQueue();
+		}
+
+		msg = &net_sendqueue[net_sendcount++];
+		memcpy(msg->data, data, length);
+		msg->datalen = length;
+		msg->socket = net_socket;
+		msg->addr = addr;
+		msg->addrlen = addr_size;
+		msg->to = to;
+
+		return;
+	}
+#endif
+
 	ret = sendto(net_socket,
 			data,
 			length,
@@ -777,6 +1157,28 @@ NET_Config(qboolean multiplayer)
 	{
 		int i;
 
+#ifdef NET_BATCHIO
+		/* forget everything belonging to the old sockets */
+		net_recvget = net_recvcount = 0;
+		net_sendcount = 0;
+#endif
+
+#ifdef NET_EPOLL
+		/* start over with a new epoll set, the old one
+		   may be shared with a forked server instance */
+		if (net_epollfd != -1)
+		{
+			close(net_epollfd);
+			close(net_timerfd);
+			net_epollfd = -1;
+			net_timerfd = -1;
+		}
+
+		net_epollwatched[0] = -1;
+		net_epollwatched[1] = -1;
+		net_epollwatched[2] = -1;
+#endif
+
 		/* shut down any existing sockets */
 		for (i = 0; i < 2; i++)
 		{
@@ -1015,3 +1417,160 @@ NET_Sleep(int msec)
 					ip6_sockets[NS_SERVER]) + 1, &fdset, NULL, NULL, &timeout);
 }
 
+#ifdef NET_EPOLL
+/*
+ * Brings the epoll set in line with the currently
+ * open server sockets and the state of stdin.
+ * Returns false if epoll isn't usable.
+ */
+static qboolean
+NET_UpdateEpoll(void)
+{
+	struct epoll_event ev;
+	int wanted[3];
+	int i;
+	extern cvar_t *dedicated;
+	extern qboolean stdin_active;
+
+	if (net_epollfd == -1)
+	{
+		net_epollfd = epoll_create1(EPOLL_CLOEXEC);
+
+		if (net_epollfd == -1)
+		{
+			Com_Printf("NET_Wait: epoll_create1: %s\n", NET_ErrorString());
+			return false;
+		}
+
+		net_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+		if (net_timerfd == -1)
+		{
+			Com_Printf("NET_Wait: timerfd_create: %s\n", NET_ErrorString());
+			close(net_epollfd);
+			net_epollfd = -1;
+			return false;
+		}
+
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.fd = net_timerfd;
+		epoll_ctl(net_epollfd, EPOLL_CTL_ADD, net_timerfd, &ev);
+	}
+
+	wanted[0] = ip_sockets[NS_SERVER] ? ip_sockets[NS_SERVER] : -1;
+	wanted[1] = ip6_sockets[NS_SERVER] ? ip6_sockets[NS_SERVER] : -1;
+	wanted[2] = (stdin_active && dedicated && dedicated->value) ? 0 : -1;
+
+	for (i = 0; i < 3; i++)
+	{
+		if (net_epollwatched[i] == wanted[i])
+		{
+			continue;
+		}
+
+		if (net_epollwatched[i] != -1)
+		{
+			epoll_ctl(net_epollfd, EPOLL_CTL_DEL, net_epollwatched[i], NULL);
+		}
+
+		if (wanted[i] != -1)
+		{
+			memset(&ev, 0, sizeof(ev));
+			ev.events = EPOLLIN;
+			ev.data.fd = wanted[i];
+
+			/* fails for stdin redirected from a regular
+			   file, it's still polled each frame */
+			epoll_ctl(net_epollfd, EPOLL_CTL_ADD, wanted[i], &ev);
+		}
+
+		net_epollwatched[i] = wanted[i];
+	}
+
+	return true;
+}
+#endif
+
+/*
+ * Sleeps usec microseconds or until a server socket
+ * or stdin becomes readable. Returns true in the
+ * latter case.
+ */
+qboolean
+NET_Wait(int usec)
+{
+	struct timeval timeout;
+	fd_set fdset;
+	int maxfd;
+	extern cvar_t *dedicated;
+	extern qboolean stdin_active;
+
+	if (usec <= 0)
+	{
+		return false;
+	}
+
+#ifdef NET_EPOLL
+	if (NET_UpdateEpoll())
+	{
+		struct epoll_event events[4];
+		struct itimerspec its;
+		qboolean activity;
+		uint64_t expirations;
+		int ret;
+		int i;
+
+		memset(&its, 0, sizeof(its));
+		its.it_value.tv_sec = usec / 1000000;
+		its.it_value.tv_nsec = (usec % 1000000) * 1000;
+		timerfd_settime(net_timerfd, 0, &its, NULL);
+
+		ret = epoll_wait(net_epollfd, events, 4, -1);
+		activity = false;
+
+		for (i = 0; i < ret; i++)
+		{
+			if (events[i].data.fd == net_timerfd)
+			{
+				if (read(net_timerfd, &expirations, sizeof(expirations)) < 0)
+				{
+					/* only drains the expiration counter */
+				}
+			}
+			else
+			{
+				activity = true;
+			}
+		}
+
+		return activity;
+	}
+#endif
+
+	FD_ZERO(&fdset);
+	maxfd = -1;
+
+	if (stdin_active && dedicated && dedicated->value)
+	{
+		FD_SET(0, &fdset); /* stdin is processed too */
+		maxfd = 0;
+	}
+
+	if (ip_sockets[NS_SERVER])
+	{
+		FD_SET(ip_sockets[NS_SERVER], &fdset); /* IPv4 network socket */
+		maxfd = MAX(maxfd, ip_sockets[NS_SERVER]);
+	}
+
+	if (ip6_sockets[NS_SERVER])
+	{
+		FD_SET(ip6_sockets[NS_SERVER], &fdset); /* IPv6 network socket */
+		maxfd = MAX(maxfd, ip6_sockets[NS_SERVER]);
+	}
+
+	timeout.tv_sec = usec / 1000000;
+	timeout.tv_usec = usec % 1000000;
+
+	return select(maxfd + 1, &fdset, NULL, NULL, &timeout) > 0;
+}
@@ -27,6 +27,7 @@
 #include <dirent.h>
 #include <dlfcn.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -35,6 +36,10 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/select.h> /* for fd_set */
+#ifdef __linux__
+#include <signal.h>
+#include <sys/prctl.h>
+#endif
 #ifndef FNDELAY
 #define FNDELAY O_NDELAY
 #endif
@@ -553,6 +558,100 @@ Sys_Realpath(const char *in, char *out, size_t size)
 
 /* ================================================================ */
 
+typedef struct
+{
+	pthread_t thread;
+	void (*func)(void *);
+	void *arg;
+} systhread_t;
+
+static void *
+Sys_ThreadMain(void *arg)
+{
+	systhread_t *t = arg;
+
+	t->func(t->arg);
+
+	return NULL;
+}
+
+/*
+ * Starts func(arg) in a new thread. Returns
+ * a handle for Sys_JoinThread() or NULL.
+ */
+void *
+Sys_CreateThread(void (*func)(void *), void *arg)
+{
+	systhread_t *t;
+
+	t = malloc(sizeof(*t));
+
+	if (!t)
+	{
+		return NULL;
+	}
+
+	t->func = func;
+	t->arg = arg;
+
+	if (pthread_create(&t->thread, NULL, Sys_ThreadMain, t) != 0)
+	{
+		free(t);
+		return NULL;
+	}
+
+	return t;
+}
+
+void
+Sys_JoinThread(void *thread)
+{
+	systhread_t *t = thread;
+
+	pthread_join(t->thread, NULL);
+	free(t);
+}
+
+/*
+ * Forces everything written to the file onto the disk.
+ */
+void
+Sys_SyncFile(FILE *f)
+{
+	fflush(f);
+	fsync(fileno(f));
+}
+
+/*
+ * Starts a copy of the process sharing all memory
+ * copy-on-write. Returns 0 in the copy, the pid of
+ * the copy in the original and -1 on error. The
+ * copy doesn't read from stdin and terminates with
+ * the original.
+ */
+int
+Sys_Fork(void)
+{
+	pid_t pid;
+
+	/* don't write buffered output twice */
+	fflush(NULL);
+
+	pid = fork();
+
+	if (pid == 0)
+	{
+#ifdef __linux__
+		prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+		stdin_active = false;
+	}
+
+	return pid;
+}
+
+/* ================================================================ */
+
 void *
 Sys_GetProcAddress(void *handle, const char *sym)
 {
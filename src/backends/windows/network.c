@@ -32,7 +32,7 @@
 #include <wsipx.h>
 #include "../../common/header/common.h"
 
-#define MAX_LOOPBACK 4
+#define MAX_LOOPBACK 16
 #define QUAKE2MCAST "ff12::666"
 
 typedef struct
@@ -624,6 +624,20 @@ NET_GetPacket(netsrc_t sock, netadr_t *net_from, sizebuf_t *net_message)
 
 /* ============================================================================= */
 
+/*
+ * Batched sending isn't implemented on
+ * Windows, packets are sent immediately.
+ */
+void
+NET_BeginSendBatch(netsrc_t sock)
+{
+}
+
+void
+NET_FlushSendBatch(netsrc_t sock)
+{
+}
+
 void
 NET_SendPacket(netsrc_t sock, int length, void *data, netadr_t to)
 {
@@ -1260,6 +1274,52 @@ NET_Sleep(int msec)
 	select(i + 1, &fdset, NULL, NULL, &timeout);
 }
 
+/*
+ * Sleeps usec microseconds or until a server
+ * socket becomes readable. Returns true in
+ * the latter case.
+ */
+qboolean
+NET_Wait(int usec)
+{
+	struct timeval timeout;
+	fd_set fdset;
+
+	if (usec <= 0)
+	{
+		return false;
+	}
+
+	FD_ZERO(&fdset);
+
+	if (ip6_sockets[NS_SERVER])
+	{
+		FD_SET(ip6_sockets[NS_SERVER], &fdset);
+	}
+
+	if (ip_sockets[NS_SERVER])
+	{
+		FD_SET(ip_sockets[NS_SERVER], &fdset);
+	}
+
+	if (ipx_sockets[NS_SERVER])
+	{
+		FD_SET(ipx_sockets[NS_SERVER], &fdset);
+	}
+
+	/* select() without sockets is an error on Windows */
+	if (!fdset.fd_count)
+	{
+		Sys_Nanosleep(usec * 1000);
+		return false;
+	}
+
+	timeout.tv_sec = usec / 1000000;
+	timeout.tv_usec = usec % 1000000;
+
+	return select(0, &fdset, NULL, NULL, &timeout) > 0;
+}
+
 /* =================================================================== */
 
 void
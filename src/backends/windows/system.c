@@ -615,6 +615,83 @@ Sys_Realpath(const char *in, char *out, size_t size)
 
 /* ======================================================================= */
 
+typedef struct
+{
+	HANDLE thread;
+	void (*func)(void *);
+	void *arg;
+} systhread_t;
+
+static DWORD WINAPI
+Sys_ThreadMain(LPVOID arg)
+{
+	systhread_t *t = arg;
+
+	t->func(t->arg);
+
+	return 0;
+}
+
+/*
+ * Starts func(arg) in a new thread. Returns
+ * a handle for Sys_JoinThread() or NULL.
+ */
+void *
+Sys_CreateThread(void (*func)(void *), void *arg)
+{
+	systhread_t *t;
+
+	t = malloc(sizeof(*t));
+
+	if (!t)
+	{
+		return NULL;
+	}
+
+	t->func = func;
+	t->arg = arg;
+	t->thread = CreateThread(NULL, 0, Sys_ThreadMain, t, 0, NULL);
+
+	if (!t->thread)
+	{
+		free(t);
+		return NULL;
+	}
+
+	return t;
+}
+
+void
+Sys_JoinThread(void *thread)
+{
+	systhread_t *t = thread;
+
+	WaitForSingleObject(t->thread, INFINITE);
+	CloseHandle(t->thread);
+	free(t);
+}
+
+/*
+ * Forces everything written to the file onto the disk.
+ */
+void
+Sys_SyncFile(FILE *f)
+{
+	fflush(f);
+	_commit(_fileno(f));
+}
+
+/*
+ * There's no fork() on Windows.
+ */
+int
+Sys_Fork(void)
+{
+	return -1;
+}
+
+/* ======================================================================= */
+
 void *
 Sys_GetProcAddress(void *handle, const char *sym)
 {
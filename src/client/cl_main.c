@@ -28,6 +28,9 @@
 #include "header/client.h"
 #include "input/header/input.h"
 
+/* number of frames stored in demo keyframes */
+#define DEMO_KEYFRAME_FRAMES 4
+
 void CL_ForwardToServer_f(void);
 void CL_Changing_f(void);
 void CL_Reconnect_f(void);
@@ -102,19 +105,375 @@ extern cvar_t *allow_download_models;
 extern cvar_t *allow_download_sounds;
 extern cvar_t *allow_download_maps;
 
+/*
+ * Writes the configstrings and baselines, flushing
+ * the buffer into the demo whenever it's full.
+ */
+static void
+CL_WriteDemoState(sizebuf_t *buf)
+{
+	int i;
+	entity_state_t *ent;
+	entity_state_t nullstate;
+
+	/* configstrings */
+	for (i = 0; i < MAX_CONFIGSTRINGS; i++)
+	{
+		if (cl.configstrings[i][0])
+		{
+			if (buf->cursize + strlen(cl.configstrings[i]) + 32 > buf->maxsize)
+			{
+				DemoWriter_WriteMessage(cls.demofile, buf->data, buf->cursize);
+				buf->cursize = 0;
+			}
+
+			MSG_WriteByte(buf, svc_configstring);
+
+			MSG_WriteShort(buf, i);
+			MSG_WriteString(buf, cl.configstrings[i]);
+		}
+	}
+
+	/* baselines */
+	memset(&nullstate, 0, sizeof(nullstate));
+
+	for (i = 0; i < MAX_EDICTS; i++)
+	{
+		ent = &cl_entities[i].baseline;
+
+		if (!ent->modelindex)
+		{
+			continue;
+		}
+
+		if (buf->cursize + 64 > buf->maxsize)
+		{
+			DemoWriter_WriteMessage(cls.demofile, buf->data, buf->cursize);
+			buf->cursize = 0;
+		}
+
+		MSG_WriteByte(buf, svc_spawnbaseline);
+
+		MSG_WriteDeltaEntity(&nullstate, &cl_entities[i].baseline,
+				buf, true, true);
+	}
+}
+
+/*
+ * Writes a frame without delta compression, so
+ * the following messages can delta against it.
+ * Returns false if the frame doesn't fit into
+ * a message, nothing is written then.
+ */
+static qboolean
+CL_WriteDemoFrame(frame_t *frame)
+{
+	byte buf_data[MAX_BIGMSGLEN];
+	sizebuf_t buf;
+	entity_state_t state;
+	int i;
+
+	SZ_Init(&buf, buf_data, sizeof(buf_data));
+	buf.allowoverflow = true;
+
+	MSG_WriteByte(&buf, svc_frame);
+	MSG_WriteLong(&buf, frame->serverframe);
+	MSG_WriteLong(&buf, -1);
+	MSG_WriteByte(&buf, 0);
+
+	MSG_WriteByte(&buf, sizeof(frame->areabits));
+	SZ_Write(&buf, frame->areabits, sizeof(frame->areabits));
+
+	MSG_WriteByte(&buf, svc_playerinfo);
+	MSG_WriteDeltaPlayerstate(NULL, &frame->playerstate, &buf);
+
+	MSG_WriteByte(&buf, svc_packetentities);
+
+	for (i = 0; i < frame->num_entities; i++)
+	{
+		state = cl_parse_entities[(frame->parse_entities + i) &
+			(MAX_PARSE_ENTITIES - 1)];
+
+		/* don't replay sounds and effects after seeking */
+		state.event = 0;
+
+		MSG_WriteDeltaEntity(&cl_entities[state.number].baseline,
+				&state, &buf, true, true);
+	}
+
+	MSG_WriteShort(&buf, 0);
+
+	if (buf.overflowed)
+	{
+		return false;
+	}
+
+	DemoWriter_WriteMessage(cls.demofile, buf.data, buf.cursize);
+
+	return true;
+}
+
+/*
+ * Stores the complete client state as keyframe. Since the
+ * following frames may be delta compressed against any of
+ * the last few frames, these are written out, too.
+ */
+static void
+CL_WriteDemoKeyframe(void)
+{
+	byte buf_data[MAX_MSGLEN];
+	sizebuf_t buf;
+	frame_t *frame;
+	int i;
+
+	DemoWriter_BeginKeyframe(cls.demofile);
+
+	SZ_Init(&buf, buf_data, sizeof(buf_data));
+	CL_WriteDemoState(&buf);
+
+	if (buf.cursize)
+	{
+		DemoWriter_WriteMessage(cls.demofile, buf.data, buf.cursize);
+	}
+
+	for (i = DEMO_KEYFRAME_FRAMES - 1; i >= 0; i--)
+	{
+		frame = &cl.frames[(cl.frame.serverframe - i) & UPDATE_MASK];
+
+		if (!frame->valid || (frame->serverframe != cl.frame.serverframe - i) ||
+			(cl.parse_entities - frame->parse_entities > MAX_PARSE_ENTITIES - 128))
+		{
+			continue;
+		}
+
+		/* without all frames the messages
+		   after the keyframe may delta
+		   against a missing one */
+		if (!CL_WriteDemoFrame(frame))
+		{
+			Com_DPrintf("CL_WriteDemoKeyframe: frame %i too large, keyframe skipped\n",
+					frame->serverframe);
+			DemoWriter_AbortKeyframe(cls.demofile);
+
+			return;
+		}
+	}
+
+	DemoWriter_EndKeyframe(cls.demofile);
+}
+
+/*
+ * Writes the entities of a frame received as svc_bitentities
+ * as svc_packetentities, so demos can be played by clients
+ * without PROTOCOL_EXT_BITDELTA. The list is never cut short,
+ * the caller checks msg->overflowed.
+ */
+static void
+CL_WriteDemoEntities(frame_t *from, frame_t *to, sizebuf_t *msg)
+{
+	entity_state_t *oldent, *newent;
+	int oldindex, newindex;
+	int oldnum, newnum;
+	int from_num_entities;
+	int bits;
+
+	MSG_WriteByte(msg, svc_packetentities);
+
+	from_num_entities = from ? from->num_entities : 0;
+	newindex = 0;
+	oldindex = 0;
+	newent = NULL;
+	oldent = NULL;
+
+	while (newindex < to->num_entities || oldindex < from_num_entities)
+	{
+		if (newindex >= to->num_entities)
+		{
+			newnum = 9999;
+		}
+		else
+		{
+			newent = &cl_parse_entities[(to->parse_entities +
+					newindex) & (MAX_PARSE_ENTITIES - 1)];
+			newnum = newent->number;
+		}
+
+		if (oldindex >= from_num_entities)
+		{
+			oldnum = 9999;
+		}
+		else
+		{
+			oldent = &cl_parse_entities[(from->parse_entities +
+					oldindex) & (MAX_PARSE_ENTITIES - 1)];
+			oldnum = oldent->number;
+		}
+
+		if (newnum == oldnum)
+		{
+			/* the old origin is only sent if
+			   it isn't the previous origin */
+			MSG_WriteDeltaEntity(oldent, newent, msg, false,
+					!VectorCompare(newent->old_origin, oldent->origin));
+			oldindex++;
+			newindex++;
+			continue;
+		}
+
+		if (newnum < oldnum)
+		{
+			MSG_WriteDeltaEntity(&cl_entities[newnum].baseline, newent,
+					msg, true, true);
+			newindex++;
+			continue;
+		}
+
+		bits = U_REMOVE;
+
+		if (oldnum >= 256)
+		{
+			bits |= U_NUMBER16 | U_MOREBITS1;
+		}
+
+		MSG_WriteByte(msg, bits & 255);
+
+		if (bits & 0x0000ff00)
+		{
+			MSG_WriteByte(msg, (bits >> 8) & 255);
+		}
+
+		if (bits & U_NUMBER16)
+		{
+			MSG_WriteShort(msg, oldnum);
+		}
+		else
+		{
+			MSG_WriteByte(msg, oldnum);
+		}
+
+		oldindex++;
+	}
+
+	MSG_WriteShort(msg, 0);
+}
+
+/*
+ * Writes a message to the demo. Messages reassembled from
+ * fragments may be larger than MAX_MSGLEN, which other
+ * clients can't read from demos. They're split between
+ * commands into several messages. starts are the offsets
+ * of the commands in data.
+ */
+static void
+CL_WriteDemoBlocks(byte *data, int len, int *starts, int numstarts)
+{
+	int blockstart, last, end;
+	int i;
+
+	blockstart = 0;
+	last = 0;
+
+	for (i = 0; i <= numstarts; i++)
+	{
+		end = (i < numstarts) ? starts[i] : len;
+
+		if ((end - blockstart > MAX_MSGLEN) && (last > blockstart))
+		{
+			if (last - blockstart > MAX_MSGLEN)
+			{
+				Com_Printf("WARNING: %i bytes of frame %i can't be split, "
+						"only this client can play the demo\n",
+						last - blockstart, cl.frame.serverframe);
+			}
+
+			DemoWriter_WriteMessage(cls.demofile, data + blockstart,
+					last - blockstart);
+			blockstart = last;
+		}
+
+		last = end;
+	}
+
+	if (len - blockstart > MAX_MSGLEN)
+	{
+		Com_Printf("WARNING: %i bytes of frame %i can't be split, "
+				"only this client can play the demo\n",
+				len - blockstart, cl.frame.serverframe);
+	}
+
+	DemoWriter_WriteMessage(cls.demofile, data + blockstart, len - blockstart);
+}
+
 /*
  * Dumps the current net message, prefixed by the length
  */
 void
 CL_WriteDemoMessage(void)
 {
-	int len, swlen;
+	byte buf_data[MAX_BIGMSGLEN];
+	int starts[MAX_MSGCMDS];
+	sizebuf_t buf;
+	frame_t *old;
+	int tail, shift;
+	int i;
 
 	/* the first eight bytes are just packet sequencing stuff */
-	len = net_message.cursize - 8;
-	swlen = LittleLong(len);
-	fwrite(&swlen, 4, 1, cls.demofile);
-	fwrite(net_message.data + 8, len, 1, cls.demofile);
+	for (i = 0; i < cl.numcmdstarts; i++)
+	{
+		starts[i] = cl.cmdstarts[i] - 8;
+	}
+
+	if (cl.bitentities_end)
+	{
+		tail = net_message.cursize - cl.bitentities_end;
+		old = (cl.frame.deltaframe > 0) ?
+			&cl.frames[cl.frame.deltaframe & UPDATE_MASK] : NULL;
+
+		SZ_Init(&buf, buf_data, sizeof(buf_data) - tail);
+		buf.allowoverflow = true;
+		SZ_Write(&buf, net_message.data + 8, cl.bitentities_start - 8);
+		CL_WriteDemoEntities(old, &cl.frame, &buf);
+
+		if (!buf.overflowed)
+		{
+			/* the commands after the entities moved */
+			shift = buf.cursize - (cl.bitentities_end - 8);
+
+			for (i = 0; i < cl.numcmdstarts; i++)
+			{
+				if (cl.cmdstarts[i] >= cl.bitentities_end)
+				{
+					starts[i] += shift;
+				}
+			}
+
+			buf.maxsize = sizeof(buf_data);
+			SZ_Write(&buf, net_message.data + cl.bitentities_end, tail);
+
+			CL_WriteDemoBlocks(buf.data, buf.cursize, starts, cl.numcmdstarts);
+		}
+		else
+		{
+			/* the byte encoding is larger than the bit
+			   packed one. Store the message as received,
+			   only clients knowing svc_bitentities can
+			   play this frame */
+			Com_Printf("WARNING: frame %i too large for svc_packetentities, "
+					"recorded bit packed\n", cl.frame.serverframe);
+			CL_WriteDemoBlocks(net_message.data + 8, net_message.cursize - 8,
+					starts, cl.numcmdstarts);
+		}
+	}
+	else
+	{
+		CL_WriteDemoBlocks(net_message.data + 8, net_message.cursize - 8,
+				starts, cl.numcmdstarts);
+	}
+
+	if (DemoWriter_KeyframeDue(cls.demofile) && cl.frame.valid)
+	{
+		CL_WriteDemoKeyframe();
+	}
 }
 
 /*
@@ -123,18 +482,13 @@ CL_WriteDemoMessage(void)
 void
 CL_Stop_f(void)
 {
-	int len;
-
 	if (!cls.demorecording)
 	{
 		Com_Printf("Not recording a demo.\n");
 		return;
 	}
 
-	len = -1;
-
-	fwrite(&len, 4, 1, cls.demofile);
-	fclose(cls.demofile);
+	DemoWriter_Close(cls.demofile);
 	cls.demofile = NULL;
 	cls.demorecording = false;
 	Com_Printf("Stopped demo.\n");
@@ -150,10 +504,6 @@ CL_Record_f(void)
 	char name[MAX_OSPATH];
 	byte buf_data[MAX_MSGLEN];
 	sizebuf_t buf;
-	int i;
-	int len;
-	entity_state_t *ent;
-	entity_state_t nullstate;
 
 	if (Cmd_Argc() != 2)
 	{
@@ -175,16 +525,17 @@ CL_Record_f(void)
 
 	Com_sprintf(name, sizeof(name), "%s/demos/%s.dm2", FS_Gamedir(), Cmd_Argv(1));
 
-	Com_Printf("recording to %s.\n", name);
 	FS_CreatePath(name);
-	cls.demofile = Q_fopen(name, "wb");
+	cls.demofile = DemoWriter_Open(name);
 
 	if (!cls.demofile)
 	{
-		Com_Printf("ERROR: couldn't open.\n");
+		Com_Printf("ERROR: couldn't open %s.\n", name);
 		return;
 	}
 
+	Com_Printf("recording to %s.\n", DemoWriter_Name(cls.demofile));
+
 	cls.demorecording = true;
 
 	/* don't start saving messages until a non-delta compressed message is received */
@@ -203,60 +554,14 @@ CL_Record_f(void)
 
 	MSG_WriteString(&buf, cl.configstrings[CS_NAME]);
 
-	/* configstrings */
-	for (i = 0; i < MAX_CONFIGSTRINGS; i++)
-	{
-		if (cl.configstrings[i][0])
-		{
-			if (buf.cursize + strlen(cl.configstrings[i]) + 32 > buf.maxsize)
-			{
-				len = LittleLong(buf.cursize);
-				fwrite(&len, 4, 1, cls.demofile);
-				fwrite(buf.data, buf.cursize, 1, cls.demofile);
-				buf.cursize = 0;
-			}
-
-			MSG_WriteByte(&buf, svc_configstring);
-
-			MSG_WriteShort(&buf, i);
-			MSG_WriteString(&buf, cl.configstrings[i]);
-		}
-	}
-
-	/* baselines */
-	memset(&nullstate, 0, sizeof(nullstate));
-
-	for (i = 0; i < MAX_EDICTS; i++)
-	{
-		ent = &cl_entities[i].baseline;
-
-		if (!ent->modelindex)
-		{
-			continue;
-		}
-
-		if (buf.cursize + 64 > buf.maxsize)
-		{
-			len = LittleLong(buf.cursize);
-			fwrite(&len, 4, 1, cls.demofile);
-			fwrite(buf.data, buf.cursize, 1, cls.demofile);
-			buf.cursize = 0;
-		}
-
-		MSG_WriteByte(&buf, svc_spawnbaseline);
-
-		MSG_WriteDeltaEntity(&nullstate, &cl_entities[i].baseline,
-				&buf, true, true);
-	}
+	CL_WriteDemoState(&buf);
 
 	MSG_WriteByte(&buf, svc_stufftext);
 
 	MSG_WriteString(&buf, "precache\n");
 
 	/* write it to the demo file */
-	len = LittleLong(buf.cursize);
-	fwrite(&len, 4, 1, cls.demofile);
-	fwrite(buf.data, buf.cursize, 1, cls.demofile);
+	DemoWriter_WriteMessage(cls.demofile, buf.data, buf.cursize);
 }
 
 void
@@ -946,6 +1251,12 @@ CL_Shutdown(void)
 	CL_HTTP_Cleanup(true);
 #endif
 
+	/* the demo writer may still have data queued */
+	if (cls.demorecording)
+	{
+		CL_Stop_f();
+	}
+
 	CL_WriteConfiguration();
 
 	Key_WriteConsoleHistory();
@@ -134,8 +134,9 @@ CL_SendConnectPacket(void)
 
 	userinfo_modified = false;
 
-	Netchan_OutOfBandPrint(NS_CLIENT, adr, "connect %i %i %i \"%s\"\n",
-			PROTOCOL_VERSION, port, cls.challenge, Cvar_Userinfo());
+	Netchan_OutOfBandPrint(NS_CLIENT, adr, "connect %i %i %i \"%s\" ext=%i\n",
+			PROTOCOL_VERSION, port, cls.challenge, Cvar_Userinfo(),
+			PROTOCOL_EXT_SUPPORTED);
 }
 
 /*
@@ -594,7 +595,8 @@ CL_ConnectionlessPacket(void)
 			return;
 		}
 
-		Netchan_Setup(NS_CLIENT, &cls.netchan, net_from, cls.quakePort);
+		Netchan_Setup(NS_CLIENT, &cls.netchan, net_from,
+				(int)Cvar_VariableValue("qport"));
 		char *buff = NET_AdrToString(cls.netchan.remote_address);
 
 		for(int i = 1; i < Cmd_Argc(); i++)
@@ -616,6 +618,20 @@ CL_ConnectionlessPacket(void)
 				Com_Printf("HTTP downloading supported by server but not the client.\n");
 #endif
 			}
+			else if (!strncmp(p, "ext=", 4))
+			{
+				int ext = (int)strtol(p + 4, (char **)NULL, 10);
+
+				if (ext & PROTOCOL_EXT_FRAGMENT)
+				{
+					Netchan_EnableFragments(&cls.netchan);
+				}
+
+				if (ext & PROTOCOL_EXT_COMPRESS)
+				{
+					Netchan_EnableCompression(&cls.netchan);
+				}
+			}
 		}
 
 		/* Put client into pause mode when connecting to a local server.
@@ -55,7 +55,8 @@ char *svc_strings[256] = {
 	"svc_playerinfo",
 	"svc_packetentities",
 	"svc_deltapacketentities",
-	"svc_frame"
+	"svc_frame",
+	"svc_bitentities"
 };
 
 void
@@ -271,12 +272,141 @@ CL_ParseDelta(entity_state_t *from, entity_state_t *to, int number, int bits)
 	}
 }
 
+/*
+ * Reads the flags of an entity in svc_bitentities
+ */
+static unsigned
+CL_ParseBitEntityFlags(void)
+{
+	unsigned bits;
+
+	bits = MSG_ReadBits(&net_message, 8);
+
+	if (bits & BE_MORE)
+	{
+		bits |= MSG_ReadBits(&net_message, BE_BITS - 8) << 8;
+	}
+
+	return bits;
+}
+
+/*
+ * Bit packed counterpart of CL_ParseDelta(), see
+ * MSG_WriteDeltaEntityBits()
+ */
+static void
+CL_ParseDeltaBits(entity_state_t *from, entity_state_t *to, int number,
+		unsigned bits)
+{
+	int coord;
+	int i;
+
+	/* set everything to the state we are delta'ing from */
+	*to = *from;
+
+	VectorCopy(from->origin, to->old_origin);
+	to->number = number;
+
+	for (i = 0; i < 3; i++)
+	{
+		if (bits & (BE_ORIGIN1 << i))
+		{
+			coord = (int)(from->origin[i] * 8) + MSG_ReadDeltaBits(&net_message);
+			to->origin[i] = (short)coord * 0.125f;
+		}
+	}
+
+	for (i = 0; i < 3; i++)
+	{
+		if (bits & (BE_ANGLE1 << i))
+		{
+			to->angles[i] = (signed char)MSG_ReadBits(&net_message, 8) * 1.40625f;
+		}
+	}
+
+	if (bits & BE_FRAME)
+	{
+		if (MSG_ReadBits(&net_message, 1))
+		{
+			to->frame = (short)(from->frame + 1);
+		}
+		else
+		{
+			to->frame = (short)MSG_ReadVarBits(&net_message);
+		}
+	}
+
+	if (bits & BE_OLDORIGIN)
+	{
+		for (i = 0; i < 3; i++)
+		{
+			coord = (int)(to->origin[i] * 8) + MSG_ReadDeltaBits(&net_message);
+			to->old_origin[i] = (short)coord * 0.125f;
+		}
+	}
+
+	if (bits & BE_EVENT)
+	{
+		to->event = MSG_ReadBits(&net_message, 8);
+	}
+	else
+	{
+		to->event = 0;
+	}
+
+	if (bits & BE_MODEL)
+	{
+		to->modelindex = MSG_ReadBits(&net_message, 8);
+	}
+
+	if (bits & BE_MODEL2)
+	{
+		to->modelindex2 = MSG_ReadBits(&net_message, 8);
+	}
+
+	if (bits & BE_MODEL3)
+	{
+		to->modelindex3 = MSG_ReadBits(&net_message, 8);
+	}
+
+	if (bits & BE_MODEL4)
+	{
+		to->modelindex4 = MSG_ReadBits(&net_message, 8);
+	}
+
+	if (bits & BE_SKIN)
+	{
+		to->skinnum = MSG_ReadVarBits(&net_message);
+	}
+
+	if (bits & BE_EFFECTS)
+	{
+		to->effects = MSG_ReadVarBits(&net_message);
+	}
+
+	if (bits & BE_RENDERFX)
+	{
+		to->renderfx = MSG_ReadVarBits(&net_message);
+	}
+
+	if (bits & BE_SOLID)
+	{
+		to->solid = (short)MSG_ReadBits(&net_message, 16);
+	}
+
+	if (bits & BE_SOUND)
+	{
+		to->sound = MSG_ReadBits(&net_message, 8);
+	}
+}
+
 /*
  * Parses deltas from the given base and adds the resulting entity to
  * the current frame
  */
 void
-CL_DeltaEntity(frame_t *frame, int newnum, entity_state_t *old, int bits)
+CL_DeltaEntity(frame_t *frame, int newnum, entity_state_t *old, int bits,
+		qboolean bitpacked)
 {
 	centity_t *ent;
 	entity_state_t *state;
@@ -287,7 +417,14 @@ CL_DeltaEntity(frame_t *frame, int newnum, entity_state_t *old, int bits)
 	cl.parse_entities++;
 	frame->num_entities++;
 
-	CL_ParseDelta(old, state, newnum, bits);
+	if (bitpacked)
+	{
+		CL_ParseDeltaBits(old, state, newnum, bits);
+	}
+	else
+	{
+		CL_ParseDelta(old, state, newnum, bits);
+	}
 
 	/* some data changes will force no lerping */
 	if ((state->modelindex != ent->current.modelindex) ||
@@ -335,18 +472,20 @@ CL_DeltaEntity(frame_t *frame, int newnum, entity_state_t *old, int bits)
 }
 
 /*
- * An svc_packetentities has just been
- * parsed, deal with the rest of the
- * data stream.
+ * An svc_packetentities or svc_bitentities
+ * has just been parsed, deal with the rest
+ * of the data stream.
  */
 void
-CL_ParsePacketEntities(frame_t *oldframe, frame_t *newframe)
+CL_ParsePacketEntities(frame_t *oldframe, frame_t *newframe, qboolean bitpacked)
 {
 	unsigned int newnum;
 	unsigned bits;
 	entity_state_t
 	*oldstate = NULL;
 	int oldindex, oldnum;
+	qboolean remove;
+	int lastnum;
 
 	newframe->parse_entities = cl.parse_entities;
 	newframe->num_entities = 0;
@@ -374,9 +513,22 @@ CL_ParsePacketEntities(frame_t *oldframe, frame_t *newframe)
 		}
 	}
 
+	lastnum = 0;
+
 	while (1)
 	{
-		newnum = CL_ParseEntityBits(&bits);
+		if (bitpacked)
+		{
+			newnum = MSG_ReadEntityNumberBits(&net_message, lastnum);
+			remove = newnum && MSG_ReadBits(&net_message, 1);
+			bits = (newnum && !remove) ? CL_ParseBitEntityFlags() : 0;
+			lastnum = newnum;
+		}
+		else
+		{
+			newnum = CL_ParseEntityBits(&bits);
+			remove = (bits & U_REMOVE) != 0;
+		}
 
 		if (newnum >= MAX_EDICTS)
 		{
@@ -401,7 +553,7 @@ CL_ParsePacketEntities(frame_t *oldframe, frame_t *newframe)
 				Com_Printf("   unchanged: %i\n", oldnum);
 			}
 
-			CL_DeltaEntity(newframe, oldnum, oldstate, 0);
+			CL_DeltaEntity(newframe, oldnum, oldstate, 0, false);
 
 			oldindex++;
 
@@ -418,7 +570,7 @@ CL_ParsePacketEntities(frame_t *oldframe, frame_t *newframe)
 			}
 		}
 
-		if (bits & U_REMOVE)
+		if (remove)
 		{
 			/* the entity present in oldframe is not in the current frame */
 			if (cl_shownet->value == 3)
@@ -456,7 +608,7 @@ CL_ParsePacketEntities(frame_t *oldframe, frame_t *newframe)
 				Com_Printf("   delta: %i\n", newnum);
 			}
 
-			CL_DeltaEntity(newframe, newnum, oldstate, bits);
+			CL_DeltaEntity(newframe, newnum, oldstate, bits, bitpacked);
 
 			oldindex++;
 
@@ -485,7 +637,7 @@ CL_ParsePacketEntities(frame_t *oldframe, frame_t *newframe)
 
 			CL_DeltaEntity(newframe, newnum,
 					&cl_entities[newnum].baseline,
-					bits);
+					bits, bitpacked);
 			continue;
 		}
 	}
@@ -499,7 +651,7 @@ CL_ParsePacketEntities(frame_t *oldframe, frame_t *newframe)
 			Com_Printf("   unchanged: %i\n", oldnum);
 		}
 
-		CL_DeltaEntity(newframe, oldnum, oldstate, 0);
+		CL_DeltaEntity(newframe, oldnum, oldstate, 0, false);
 
 		oldindex++;
 
@@ -770,12 +922,24 @@ CL_ParseFrame(void)
 	cmd = MSG_ReadByte(&net_message);
 	SHOWNET(svc_strings[cmd]);
 
-	if (cmd != svc_packetentities)
+	if ((cmd != svc_packetentities) && (cmd != svc_bitentities))
 	{
 		Com_Error(ERR_DROP, "CL_ParseFrame: 0x%X not packetentities", cmd);
 	}
 
-	CL_ParsePacketEntities(old, &cl.frame);
+	/* remember where the entities are, demos
+	   get them in the old encoding */
+	if (cmd == svc_bitentities)
+	{
+		cl.bitentities_start = net_message.readcount - 1;
+	}
+
+	CL_ParsePacketEntities(old, &cl.frame, cmd == svc_bitentities);
+
+	if (cmd == svc_bitentities)
+	{
+		cl.bitentities_end = net_message.readcount;
+	}
 
 	/* save the frame off in the backup array for later delta comparisons */
 	cl.frames[cl.frame.serverframe & UPDATE_MASK] = cl.frame;
@@ -1252,6 +1416,9 @@ CL_ParseServerMessage(void)
 		Com_Printf("------------------\n");
 	}
 
+	cl.bitentities_start = cl.bitentities_end = 0;
+	cl.numcmdstarts = 0;
+
 	/* parse the message */
 	while (1)
 	{
@@ -1261,6 +1428,13 @@ CL_ParseServerMessage(void)
 			break;
 		}
 
+		/* svc_frame reads the player and entities
+		   itself, so they stay with the frame */
+		if (cl.numcmdstarts < MAX_MSGCMDS)
+		{
+			cl.cmdstarts[cl.numcmdstarts++] = net_message.readcount;
+		}
+
 		cmd = MSG_ReadByte(&net_message);
 
 		if (cmd == -1)
@@ -1382,6 +1556,7 @@ CL_ParseServerMessage(void)
 			case svc_playerinfo:
 			case svc_packetentities:
 			case svc_deltapacketentities:
+			case svc_bitentities:
 				Com_Error(ERR_DROP, "Out of place frame data");
 				break;
 		}
@@ -29,6 +29,7 @@
 
 #define MAX_CLIENTWEAPONMODELS 20
 #define	CMD_BACKUP 256 /* allow a lot of command backups for very fast systems */
+#define MAX_MSGCMDS 512 /* commands in a server message split for demos */
 
 /* the cl_parse_entities must be large enough to hold UPDATE_BACKUP frames of
    entities, so that when a delta compressed message arives from the server
@@ -134,6 +135,16 @@ typedef struct
 	int			surpressCount; /* number of messages rate supressed */
 	frame_t		frames[UPDATE_BACKUP];
 
+	/* svc_bitentities in net_message, demos
+	   get the entities in the old encoding */
+	int			bitentities_start;
+	int			bitentities_end;
+
+	/* offsets of the commands in net_message, demos
+	   split messages larger than MAX_MSGLEN there */
+	int			cmdstarts[MAX_MSGCMDS];
+	int			numcmdstarts;
+
 	/* the client maintains its own idea of view angles, which are
 	   sent to the server each frame.  It is cleared to 0 upon entering each level.
 	   the server sends a delta each frame which is added to the locally
@@ -247,7 +258,7 @@ typedef struct
 	/* demo recording info must be here, so it isn't cleared on level change */
 	qboolean	demorecording;
 	qboolean	demowaiting; /* don't record until a non-delta message is received */
-	FILE		*demofile;
+	demowriter_t	*demofile;
 
 #ifdef USE_CURL
 	/* http downloading */
@@ -142,10 +142,22 @@ Com_VPrintf(int print_level, const char *fmt, va_list argptr)
 		if (logfile_active && logfile_active->value)
 		{
 			char name[MAX_OSPATH];
+			int instance;
 
 			if (!logfile)
 			{
-				Com_sprintf(name, sizeof(name), "%s/qconsole.log", FS_Gamedir());
+				/* forked server instances have their own */
+				instance = (int)Cvar_VariableValue("sv_instance");
+
+				if (instance)
+				{
+					Com_sprintf(name, sizeof(name), "%s/qconsole%i.log",
+							FS_Gamedir(), instance);
+				}
+				else
+				{
+					Com_sprintf(name, sizeof(name), "%s/qconsole.log", FS_Gamedir());
+				}
 
 				if (logfile_active->value > 2)
 				{
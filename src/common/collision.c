@@ -55,7 +55,6 @@ typedef struct
 	int			contents;
 	int			numsides;
 	int			firstbrushside;
-	int			checkcount;	/* to avoid repeated testings */
 } cbrush_t;
 
 typedef struct
@@ -69,31 +68,22 @@ typedef struct
 byte *cmod_base;
 byte map_visibility[MAX_MAP_VISIBILITY];
 // DG: is casted to int32_t* in SV_FatPVS() so align accordingly
-static YQ2_ALIGNAS_TYPE(int32_t) byte pvsrow[MAX_MAP_LEAFS / 8];
-byte phsrow[MAX_MAP_LEAFS / 8];
+static YQ2_THREAD_LOCAL YQ2_ALIGNAS_TYPE(int32_t) byte pvsrow[MAX_MAP_LEAFS / 8];
+static YQ2_THREAD_LOCAL byte phsrow[MAX_MAP_LEAFS / 8];
 carea_t	map_areas[MAX_MAP_AREAS];
-cbrush_t map_brushes[MAX_MAP_BRUSHES];
-cbrushside_t map_brushsides[MAX_MAP_BRUSHSIDES];
+cbrush_t map_brushes[MAX_MAP_BRUSHES + CM_MAX_THREADS]; /* extra for box hulls */
+cbrushside_t map_brushsides[MAX_MAP_BRUSHSIDES + 6 * CM_MAX_THREADS]; /* extra for box hulls */
 char map_name[MAX_QPATH];
 char map_entitystring[MAX_MAP_ENTSTRING];
-cbrush_t *box_brush;
-cleaf_t	*box_leaf;
-cleaf_t	map_leafs[MAX_MAP_LEAFS];
+cleaf_t	map_leafs[MAX_MAP_LEAFS + CM_MAX_THREADS]; /* extra for box hulls */
 cmodel_t map_cmodels[MAX_MAP_MODELS];
-cnode_t	map_nodes[MAX_MAP_NODES+6]; /* extra for box hull */
-cplane_t *box_planes;
-cplane_t map_planes[MAX_MAP_PLANES+6]; /* extra for box hull */
+cnode_t	map_nodes[MAX_MAP_NODES + 6 * CM_MAX_THREADS]; /* extra for box hulls */
+cplane_t map_planes[MAX_MAP_PLANES + 12 * CM_MAX_THREADS]; /* extra for box hulls */
 cvar_t *map_noareas;
 dareaportal_t map_areaportals[MAX_MAP_AREAPORTALS];
 dvis_t *map_vis = (dvis_t *)map_visibility;
-int box_headnode;
-int	checkcount;
 int	emptyleaf, solidleaf;
 int	floodvalid;
-float *leaf_mins, *leaf_maxs;
-int leaf_count, leaf_maxcount;
-int *leaf_list;
-int leaf_topnode;
 int	numareaportals;
 int numareas = 1;
 int	numbrushes;
@@ -107,16 +97,41 @@ int	numnodes;
 int	numplanes;
 int	numtexinfo;
 int	numvisibility;
-int trace_contents;
 mapsurface_t map_surfaces[MAX_MAP_TEXINFO];
 mapsurface_t nullsurface;
 qboolean portalopen[MAX_MAP_AREAPORTALS];
-qboolean trace_ispoint; /* optimized case */
-trace_t trace_trace;
-unsigned short	map_leafbrushes[MAX_MAP_LEAFBRUSHES];
-vec3_t trace_start, trace_end;
-vec3_t trace_mins, trace_maxs;
-vec3_t trace_extents;
+unsigned short	map_leafbrushes[MAX_MAP_LEAFBRUSHES + CM_MAX_THREADS]; /* extra for box hulls */
+
+/* each thread slot has its own box hull, so
+   CM_HeadnodeForBox() can run in parallel */
+static int box_headnodes[CM_MAX_THREADS];
+static cplane_t *box_planes[CM_MAX_THREADS];
+
+/* to avoid repeated testings of a brush that's in
+   several leafs. Each slot marks its own copy, so
+   threads never skip each other's brushes. */
+static int cm_checkcounts[CM_MAX_THREADS];
+static int cm_brushmarks[CM_MAX_THREADS][MAX_MAP_BRUSHES + CM_MAX_THREADS];
+
+/* slots 1 and up are handed out to other threads by
+   CM_AcquireSlot(), the thread loading maps has 0 */
+static int cm_slotmask;
+static YQ2_THREAD_LOCAL qboolean cm_mainthread;
+
+/* state of the running trace or leaf query. It's
+   per thread, so queries may run in parallel as
+   long as each thread has its own slot. */
+static YQ2_THREAD_LOCAL int cm_slot;
+static YQ2_THREAD_LOCAL float *leaf_mins, *leaf_maxs;
+static YQ2_THREAD_LOCAL int leaf_count, leaf_maxcount;
+static YQ2_THREAD_LOCAL int *leaf_list;
+static YQ2_THREAD_LOCAL int leaf_topnode;
+static YQ2_THREAD_LOCAL int trace_contents;
+static YQ2_THREAD_LOCAL qboolean trace_ispoint; /* optimized case */
+static YQ2_THREAD_LOCAL trace_t trace_trace;
+static YQ2_THREAD_LOCAL vec3_t trace_start, trace_end;
+static YQ2_THREAD_LOCAL vec3_t trace_mins, trace_maxs;
+static YQ2_THREAD_LOCAL vec3_t trace_extents;
 
 #ifndef DEDICATED_ONLY
 int		c_pointcontents;
@@ -214,6 +229,16 @@ CM_AreasConnected(int area1, int area2)
 	return false;
 }
 
+/*
+ * Changes whenever the result of CM_AreasConnected()
+ * may have changed, so callers can cache it.
+ */
+int
+CM_AreaFloodVersion(void)
+{
+	return map_noareas->value ? -1 : floodvalid;
+}
+
 /*
  * Writes a length byte followed by a bit vector of all the areas
  * that area in the same flood as the area parameter
@@ -319,73 +344,128 @@ CM_HeadnodeVisible(int nodenum, byte *visbits)
 void
 CM_InitBoxHull(void)
 {
-	int i;
+	int i, slot;
 	int side;
+	int headnode;
+	int firstplane;
 	cnode_t *c;
 	cplane_t *p;
 	cbrushside_t *s;
+	cbrush_t *brush;
+	cleaf_t *leaf;
 
-	box_headnode = numnodes;
-	box_planes = &map_planes[numplanes];
-
-	if ((numnodes + 6 > MAX_MAP_NODES) ||
-		(numbrushes + 1 > MAX_MAP_BRUSHES) ||
-		(numleafbrushes + 1 > MAX_MAP_LEAFBRUSHES) ||
-		(numbrushsides + 6 > MAX_MAP_BRUSHSIDES) ||
-		(numplanes + 12 > MAX_MAP_PLANES))
+	for (slot = 0; slot < CM_MAX_THREADS; slot++)
 	{
-		Com_Error(ERR_DROP, "Not enough room for box tree");
-	}
+		headnode = numnodes + slot * 6;
+		firstplane = numplanes + slot * 12;
 
-	box_brush = &map_brushes[numbrushes];
-	box_brush->numsides = 6;
-	box_brush->firstbrushside = numbrushsides;
-	box_brush->contents = CONTENTS_MONSTER;
+		box_headnodes[slot] = headnode;
+		box_planes[slot] = &map_planes[firstplane];
 
-	box_leaf = &map_leafs[numleafs];
-	box_leaf->contents = CONTENTS_MONSTER;
-	box_leaf->firstleafbrush = numleafbrushes;
-	box_leaf->numleafbrushes = 1;
+		brush = &map_brushes[numbrushes + slot];
+		brush->numsides = 6;
+		brush->firstbrushside = numbrushsides + slot * 6;
+		brush->contents = CONTENTS_MONSTER;
 
-	map_leafbrushes[numleafbrushes] = numbrushes;
+		leaf = &map_leafs[numleafs + slot];
+		leaf->contents = CONTENTS_MONSTER;
+		leaf->firstleafbrush = numleafbrushes + slot;
+		leaf->numleafbrushes = 1;
 
-	for (i = 0; i < 6; i++)
-	{
-		side = i & 1;
+		map_leafbrushes[numleafbrushes + slot] = numbrushes + slot;
 
-		/* brush sides */
-		s = &map_brushsides[numbrushsides + i];
-		s->plane = map_planes + (numplanes + i * 2 + side);
-		s->surface = &nullsurface;
+		for (i = 0; i < 6; i++)
+		{
+			side = i & 1;
 
-		/* nodes */
-		c = &map_nodes[box_headnode + i];
-		c->plane = map_planes + (numplanes + i * 2);
-		c->children[side] = -1 - emptyleaf;
+			/* brush sides */
+			s = &map_brushsides[brush->firstbrushside + i];
+			s->plane = map_planes + (firstplane + i * 2 + side);
+			s->surface = &nullsurface;
 
-		if (i != 5)
-		{
-			c->children[side ^ 1] = box_headnode + i + 1;
+			/* nodes */
+			c = &map_nodes[headnode + i];
+			c->plane = map_planes + (firstplane + i * 2);
+			c->children[side] = -1 - emptyleaf;
+
+			if (i != 5)
+			{
+				c->children[side ^ 1] = headnode + i + 1;
+			}
+
+			else
+			{
+				c->children[side ^ 1] = -1 - (numleafs + slot);
+			}
+
+			/* planes */
+			p = &box_planes[slot][i * 2];
+			p->type = i >> 1;
+			p->signbits = 0;
+			VectorClear(p->normal);
+			p->normal[i >> 1] = 1;
+
+			p = &box_planes[slot][i * 2 + 1];
+			p->type = 3 + (i >> 1);
+			p->signbits = 0;
+			VectorClear(p->normal);
+			p->normal[i >> 1] = -1;
 		}
+	}
+}
 
-		else
+/*
+ * Gives the calling thread a slot with its own box
+ * hull and brush marks, so its collision queries can
+ * run in parallel to those of other threads. The
+ * thread loading maps always has slot 0, the others
+ * wait for a free slot and must release it with
+ * CM_ReleaseSlot() when done with the query.
+ */
+int
+CM_AcquireSlot(void)
+{
+	int mask, slot;
+
+	if (cm_mainthread)
+	{
+		return 0;
+	}
+
+	for ( ; ; )
+	{
+		mask = __atomic_load_n(&cm_slotmask, __ATOMIC_ACQUIRE);
+
+		for (slot = 1; slot < CM_MAX_THREADS; slot++)
 		{
-			c->children[side ^ 1] = -1 - numleafs;
-		}
+			if (mask & (1 << slot))
+			{
+				continue;
+			}
 
-		/* planes */
-		p = &box_planes[i * 2];
-		p->type = i >> 1;
-		p->signbits = 0;
-		VectorClear(p->normal);
-		p->normal[i >> 1] = 1;
+			if (__atomic_compare_exchange_n(&cm_slotmask, &mask,
+						mask | (1 << slot), false, __ATOMIC_ACQUIRE,
+						__ATOMIC_RELAXED))
+			{
+				cm_slot = slot;
+				return slot;
+			}
+
+			break; /* the mask changed, try again */
+		}
+	}
+}
 
-		p = &box_planes[i * 2 + 1];
-		p->type = 3 + (i >> 1);
-		p->signbits = 0;
-		VectorClear(p->normal);
-		p->normal[i >> 1] = -1;
+void
+CM_ReleaseSlot(int slot)
+{
+	if (!slot)
+	{
+		return;
 	}
+
+	cm_slot = 0;
+	__atomic_fetch_and(&cm_slotmask, ~(1 << slot), __ATOMIC_RELEASE);
 }
 
 /*
@@ -395,20 +475,22 @@ CM_InitBoxHull(void)
 int
 CM_HeadnodeForBox(vec3_t mins, vec3_t maxs)
 {
-	box_planes[0].dist = maxs[0];
-	box_planes[1].dist = -maxs[0];
-	box_planes[2].dist = mins[0];
-	box_planes[3].dist = -mins[0];
-	box_planes[4].dist = maxs[1];
-	box_planes[5].dist = -maxs[1];
-	box_planes[6].dist = mins[1];
-	box_planes[7].dist = -mins[1];
-	box_planes[8].dist = maxs[2];
-	box_planes[9].dist = -maxs[2];
-	box_planes[10].dist = mins[2];
-	box_planes[11].dist = -mins[2];
-
-	return box_headnode;
+	cplane_t *planes = box_planes[cm_slot];
+
+	planes[0].dist = maxs[0];
+	planes[1].dist = -maxs[0];
+	planes[2].dist = mins[0];
+	planes[3].dist = -mins[0];
+	planes[4].dist = maxs[1];
+	planes[5].dist = -maxs[1];
+	planes[6].dist = mins[1];
+	planes[7].dist = -mins[1];
+	planes[8].dist = maxs[2];
+	planes[9].dist = -maxs[2];
+	planes[10].dist = mins[2];
+	planes[11].dist = -mins[2];
+
+	return box_headnodes[cm_slot];
 }
 
 int
@@ -445,7 +527,10 @@ CM_PointLeafnum_r(vec3_t p, int num)
 	}
 
 #ifndef DEDICATED_ONLY
-	c_pointcontents++; /* optimize counter */
+	if (!cm_slot)
+	{
+		c_pointcontents++; /* optimize counter */
+	}
 #endif
 
 	return -1 - num;
@@ -575,7 +660,7 @@ CM_TransformedPointContents(vec3_t p, int headnode,
 	VectorSubtract(p, origin, p_l);
 
 	/* rotate start and end into the models frame of reference */
-	if ((headnode != box_headnode) &&
+	if ((headnode != box_headnodes[cm_slot]) &&
 		(angles[0] || angles[1] || angles[2]))
 	{
 		AngleVectors(angles, forward, right, up);
@@ -615,7 +700,10 @@ CM_ClipBoxToBrush(vec3_t mins, vec3_t maxs, vec3_t p1,
 	}
 
 #ifndef DEDICATED_ONLY
-	c_brush_traces++;
+	if (!cm_slot)
+	{
+		c_brush_traces++;
+	}
 #endif
 
 	getout = false;
@@ -816,12 +904,12 @@ CM_TraceToLeaf(int leafnum)
 		brushnum = map_leafbrushes[leaf->firstleafbrush + k];
 		b = &map_brushes[brushnum];
 
-		if (b->checkcount == checkcount)
+		if (cm_brushmarks[cm_slot][brushnum] == cm_checkcounts[cm_slot])
 		{
 			continue; /* already checked this brush in another leaf */
 		}
 
-		b->checkcount = checkcount;
+		cm_brushmarks[cm_slot][brushnum] = cm_checkcounts[cm_slot];
 
 		if (!(b->contents & trace_contents))
 		{
@@ -859,12 +947,12 @@ CM_TestInLeaf(int leafnum)
 		brushnum = map_leafbrushes[leaf->firstleafbrush + k];
 		b = &map_brushes[brushnum];
 
-		if (b->checkcount == checkcount)
+		if (cm_brushmarks[cm_slot][brushnum] == cm_checkcounts[cm_slot])
 		{
 			continue; /* already checked this brush in another leaf */
 		}
 
-		b->checkcount = checkcount;
+		cm_brushmarks[cm_slot][brushnum] = cm_checkcounts[cm_slot];
 
 		if (!(b->contents & trace_contents))
 		{
@@ -1019,10 +1107,13 @@ CM_BoxTrace(vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs,
 {
 	int i;
 
-	checkcount++; /* for multi-check avoidance */
+	cm_checkcounts[cm_slot]++; /* for multi-check avoidance */
 
 #ifndef DEDICATED_ONLY
-	c_traces++; /* for statistics, may be zeroed */
+	if (!cm_slot)
+	{
+		c_traces++; /* for statistics, may be zeroed */
+	}
 #endif
 
 	/* fill in a default trace */
@@ -1131,7 +1222,7 @@ CM_TransformedBoxTrace(vec3_t start, vec3_t end, vec3_t mins, vec3_t maxs,
 	VectorSubtract(end, origin, end_l);
 
 	/* rotate start and end into the models frame of reference */
-	if ((headnode != box_headnode) &&
+	if ((headnode != box_headnodes[cm_slot]) &&
 		(angles[0] || angles[1] || angles[2]))
 	{
 		rotated = true;
@@ -1676,6 +1767,9 @@ CM_LoadMap(char *name, qboolean clientload, unsigned *checksum)
 
 	map_noareas = Cvar_Get("map_noareas", "0", 0);
 
+	/* the thread loading maps runs the frames */
+	cm_mainthread = true;
+
 	if (strcmp(map_name, name) == 0
 		&& (clientload || !Cvar_VariableValue("flushmap")))
 	{
@@ -224,6 +224,11 @@ Cvar_Get(char *var_name, char *var_value, int flags)
 		}
 	}
 
+	if (flags & CVAR_SERVERINFO)
+	{
+		serverinfo_modified = true;
+	}
+
 	var = Cvar_FindVar(var_name);
 
 	if (var)
@@ -350,6 +355,11 @@ Cvar_Set2(char *var_name, char *value, qboolean force)
 			}
 			else
 			{
+				if (var->flags & CVAR_SERVERINFO)
+				{
+					serverinfo_modified = true;
+				}
+
 				var->string = CopyString(value);
 				var->value = (float)strtod(var->string, (char **)NULL);
 
@@ -383,6 +393,11 @@ Cvar_Set2(char *var_name, char *value, qboolean force)
 		userinfo_modified = true;
 	}
 
+	if (var->flags & CVAR_SERVERINFO)
+	{
+		serverinfo_modified = true;
+	}
+
 	Z_Free(var->string);
 
 	var->string = CopyString(value);
@@ -422,6 +437,11 @@ Cvar_FullSet(char *var_name, char *value, int flags)
 		userinfo_modified = true;
 	}
 
+	if ((var->flags | flags) & CVAR_SERVERINFO)
+	{
+		serverinfo_modified = true;
+	}
+
 	// if $game is the default one ("baseq2"), then use "" instead because
 	// other code assumes this behavior (e.g. FS_BuildGameSpecificSearchPath())
 	if(strcmp(var_name, "game") == 0 && strcmp(value, BASEDIRNAME) == 0)
@@ -472,6 +492,11 @@ Cvar_GetLatchedVars(void)
 			continue;
 		}
 
+		if (var->flags & CVAR_SERVERINFO)
+		{
+			serverinfo_modified = true;
+		}
+
 		Z_Free(var->string);
 		var->string = var->latched_string;
 		var->latched_string = NULL;
@@ -664,6 +689,7 @@ Cvar_List_f(void)
 }
 
 qboolean userinfo_modified;
+qboolean serverinfo_modified;
 
 char *
 Cvar_BitInfo(int bit)
@@ -0,0 +1,708 @@
+/*
+ * Copyright (C) 1997-2001 Id Software, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * =======================================================================
+ *
+ * Buffered demo writer. Demo messages are copied into a ring buffer
+ * and written to disk by a background thread, so a slow disk or a
+ * network filesystem can't stall the game. The ring has exactly one
+ * producer (the main thread, advancing head) and one consumer (the
+ * writer thread, advancing tail), so no locks are needed.
+ *
+ * Optionally the demo is deflated into a gzip file and synced to
+ * disk in fixed intervals.
+ *
+ * Uncompressed demos can carry keyframes: self contained blocks of
+ * messages which restore the full game state at a certain point of
+ * the stream. They're collected in memory and appended after the
+ * end of the stream together with an index, so the file still
+ * plays in every Quake II client:
+ *
+ *   <message stream> -1
+ *   <keyframe> -1 <keyframe> -1 ...
+ *   <index entries: message, stream offset, keyframe offset>
+ *   <index offset> <number of entries> "YQ2I"
+ *
+ * =======================================================================
+ */
+
+#include "header/common.h"
+#include "unzip/miniz.h"
+
+#define DEMO_OUTBUF_SIZE 16384
+#define DEMO_MAX_INDEX 8192
+
+typedef struct
+{
+	int message;                /* number of the first message after it */
+	int offset;                 /* stream offset of that message */
+	int keyoffset;              /* offset of the keyframe in the key blob */
+} demoindex_t;
+
+struct demowriter_s
+{
+	struct demowriter_s *next;  /* in the list of open writers */
+	char name[MAX_OSPATH];
+	FILE *file;
+
+	/* the ring buffer. head is only written by
+	   the main thread, tail only by the writer */
+	byte *ring;
+	unsigned size;              /* power of two */
+	unsigned head;
+	unsigned tail;
+	int closing;
+	void *thread;
+
+	/* gzip compression */
+	qboolean compress;
+	mz_stream stream;
+	mz_ulong crc;
+	unsigned rawsize;
+	byte *outbuf;
+
+	/* sync policy */
+	int syncinterval;           /* msec, 0 to never sync */
+	int lastsync;
+
+	/* keyframes and their index */
+	int messages;
+	qboolean inkeyframe;
+	byte *keys;
+	int keysize;
+	int keymax;
+	int keystart;               /* start of the current keyframe */
+	int lastkey;                /* start of the previous keyframe */
+	demoindex_t *index;
+	int numindex;
+
+	/* statistics */
+	size_t bytes;
+	unsigned highwater;
+	int stalls;
+	qboolean failed;
+};
+
+static demowriter_t *demowriters;
+
+static cvar_t *demo_async;
+static cvar_t *demo_buffer;
+static cvar_t *demo_compress;
+static cvar_t *demo_fsync;
+static cvar_t *demo_keyframes;
+
+/*
+ * Writes raw demo data to the file, deflating it
+ * if requested. Only called by the thread owning
+ * the file at that moment.
+ */
+static void
+DemoWriter_Store(demowriter_t *dw, const byte *data, int len, qboolean finish)
+{
+	int status;
+	int out;
+
+	if (!dw->compress)
+	{
+		if (len && (fwrite(data, len, 1, dw->file) != 1))
+		{
+			dw->failed = true;
+		}
+
+		return;
+	}
+
+	if (len)
+	{
+		dw->crc = mz_crc32(dw->crc, data, len);
+		dw->rawsize += len;
+	}
+
+	dw->stream.next_in = data;
+	dw->stream.avail_in = len;
+
+	for ( ; ; )
+	{
+		dw->stream.next_out = dw->outbuf;
+		dw->stream.avail_out = DEMO_OUTBUF_SIZE;
+
+		status = mz_deflate(&dw->stream, finish ? MZ_FINISH : MZ_NO_FLUSH);
+
+		if ((status != MZ_OK) && (status != MZ_STREAM_END) &&
+			(status != MZ_BUF_ERROR))
+		{
+			dw->failed = true;
+			return;
+		}
+
+		out = DEMO_OUTBUF_SIZE - dw->stream.avail_out;
+
+		if (out && (fwrite(dw->outbuf, out, 1, dw->file) != 1))
+		{
+			dw->failed = true;
+			return;
+		}
+
+		if (finish ? (status == MZ_STREAM_END) : (dw->stream.avail_out != 0))
+		{
+			break;
+		}
+	}
+}
+
+/*
+ * Flushes the file to disk if the sync interval has passed.
+ */
+static void
+DemoWriter_Sync(demowriter_t *dw, qboolean force)
+{
+	int now;
+
+	if (!dw->syncinterval)
+	{
+		return;
+	}
+
+	now = Sys_Milliseconds();
+
+	if (!force && (now - dw->lastsync < dw->syncinterval))
+	{
+		return;
+	}
+
+	Sys_SyncFile(dw->file);
+	dw->lastsync = now;
+}
+
+static void
+DemoWriter_Thread(void *arg)
+{
+	demowriter_t *dw = arg;
+	unsigned head, tail;
+	unsigned ofs, len;
+	int closing;
+
+	for ( ; ; )
+	{
+		/* closing is set after the last
+		   write, so read it before head */
+		closing = __atomic_load_n(&dw->closing, __ATOMIC_ACQUIRE);
+		head = __atomic_load_n(&dw->head, __ATOMIC_ACQUIRE);
+		tail = dw->tail;
+
+		if (head == tail)
+		{
+			if (closing)
+			{
+				break;
+			}
+
+			DemoWriter_Sync(dw, false);
+			Sys_Nanosleep(2000000);
+
+			continue;
+		}
+
+		/* write the contiguous part */
+		ofs = tail & (dw->size - 1);
+		len = head - tail;
+
+		if (len > dw->size - ofs)
+		{
+			len = dw->size - ofs;
+		}
+
+		DemoWriter_Store(dw, dw->ring + ofs, len, false);
+		__atomic_store_n(&dw->tail, tail + len, __ATOMIC_RELEASE);
+
+		DemoWriter_Sync(dw, false);
+	}
+}
+
+/*
+ * Opens a demo for writing. If compression is
+ * enabled, ".gz" is appended to the name.
+ */
+demowriter_t *
+DemoWriter_Open(const char *name)
+{
+	demowriter_t *dw;
+	static const byte gzheader[10] = {
+		0x1f, 0x8b, MZ_DEFLATED, 0, 0, 0, 0, 0, 0, 0xff
+	};
+	unsigned size;
+
+	dw = Z_Malloc(sizeof(*dw));
+
+	dw->compress = demo_compress->value != 0;
+
+	if (dw->compress)
+	{
+		Com_sprintf(dw->name, sizeof(dw->name), "%s.gz", name);
+	}
+	else
+	{
+		Q_strlcpy(dw->name, name, sizeof(dw->name));
+	}
+
+	dw->file = Q_fopen(dw->name, "wb");
+
+	if (!dw->file)
+	{
+		Z_Free(dw);
+		return NULL;
+	}
+
+	if (dw->compress)
+	{
+		if (mz_deflateInit2(&dw->stream, MZ_DEFAULT_LEVEL, MZ_DEFLATED,
+					-MZ_DEFAULT_WINDOW_BITS, 9, MZ_DEFAULT_STRATEGY) != MZ_OK)
+		{
+			Com_Printf("DemoWriter_Open: couldn't initialize compression.\n");
+			fclose(dw->file);
+			Z_Free(dw);
+			return NULL;
+		}
+
+		dw->outbuf = Z_Malloc(DEMO_OUTBUF_SIZE);
+		dw->crc = mz_crc32(0, NULL, 0);
+
+		if (fwrite(gzheader, sizeof(gzheader), 1, dw->file) != 1)
+		{
+			dw->failed = true;
+		}
+	}
+
+	dw->syncinterval = (int)(demo_fsync->value * 1000);
+	dw->lastsync = Sys_Milliseconds();
+
+	if (demo_async->value)
+	{
+		/* round the buffer up to a power of two */
+		for (size = 64 * 1024; size < demo_buffer->value * 1024 &&
+				size < 256 * 1024 * 1024; size <<= 1)
+		{
+		}
+
+		dw->size = size;
+		dw->ring = Z_Malloc(dw->size);
+		dw->thread = Sys_CreateThread(DemoWriter_Thread, dw);
+
+		if (!dw->thread)
+		{
+			Com_Printf("DemoWriter_Open: couldn't start thread, writing synchronously.\n");
+			Z_Free(dw->ring);
+			dw->ring = NULL;
+			dw->size = 0;
+		}
+	}
+
+	dw->next = demowriters;
+	demowriters = dw;
+
+	return dw;
+}
+
+const char *
+DemoWriter_Name(demowriter_t *dw)
+{
+	return dw->name;
+}
+
+/*
+ * Queues data for writing. Unless the writer thread
+ * falls behind by more than the whole buffer, this
+ * is nothing more than a memcpy().
+ */
+void
+DemoWriter_Write(demowriter_t *dw, const void *data, int len)
+{
+	const byte *src = data;
+	unsigned ofs, chunk, first, used;
+	qboolean stalled;
+
+	dw->bytes += len;
+
+	if (!dw->thread)
+	{
+		DemoWriter_Store(dw, src, len, false);
+		DemoWriter_Sync(dw, false);
+
+		return;
+	}
+
+	stalled = false;
+
+	while (len > 0)
+	{
+		chunk = len;
+
+		if (chunk > dw->size)
+		{
+			chunk = dw->size;
+		}
+
+		/* wait for the writer to make room */
+		while (dw->head + chunk - __atomic_load_n(&dw->tail, __ATOMIC_ACQUIRE) > dw->size)
+		{
+			stalled = true;
+			Sys_Nanosleep(1000000);
+		}
+
+		ofs = dw->head & (dw->size - 1);
+		first = dw->size - ofs;
+
+		if (first > chunk)
+		{
+			first = chunk;
+		}
+
+		memcpy(dw->ring + ofs, src, first);
+		memcpy(dw->ring, src + first, chunk - first);
+
+		__atomic_store_n(&dw->head, dw->head + chunk, __ATOMIC_RELEASE);
+
+		used = dw->head - __atomic_load_n(&dw->tail, __ATOMIC_ACQUIRE);
+
+		if (used > dw->highwater)
+		{
+			dw->highwater = used;
+		}
+
+		src += chunk;
+		len -= chunk;
+	}
+
+	if (stalled)
+	{
+		dw->stalls++;
+	}
+}
+
+/*
+ * Appends data to the in-memory keyframe blob.
+ */
+static void
+DemoWriter_AppendKey(demowriter_t *dw, const void *data, int len)
+{
+	byte *keys;
+
+	if (dw->keysize + len > dw->keymax)
+	{
+		while (dw->keysize + len > dw->keymax)
+		{
+			dw->keymax = dw->keymax ? dw->keymax * 2 : 256 * 1024;
+		}
+
+		keys = Z_Malloc(dw->keymax);
+
+		if (dw->keys)
+		{
+			memcpy(keys, dw->keys, dw->keysize);
+			Z_Free(dw->keys);
+		}
+
+		dw->keys = keys;
+	}
+
+	memcpy(dw->keys + dw->keysize, data, len);
+	dw->keysize += len;
+}
+
+/*
+ * Writes a length prefixed message. Inside a
+ * keyframe the message goes to the key blob.
+ */
+void
+DemoWriter_WriteMessage(demowriter_t *dw, const void *data, int len)
+{
+	int swlen;
+
+	swlen = LittleLong(len);
+
+	if (dw->inkeyframe)
+	{
+		DemoWriter_AppendKey(dw, &swlen, 4);
+		DemoWriter_AppendKey(dw, data, len);
+
+		return;
+	}
+
+	DemoWriter_Write(dw, &swlen, 4);
+	DemoWriter_Write(dw, data, len);
+	dw->messages++;
+}
+
+/*
+ * Returns true if it's time to store the next keyframe.
+ * Keyframes are only written into uncompressed demos,
+ * a gzip stream can't be seeked anyways.
+ */
+qboolean
+DemoWriter_KeyframeDue(demowriter_t *dw)
+{
+	int interval;
+
+	if (dw->compress || (demo_keyframes->value <= 0) ||
+		(dw->numindex == DEMO_MAX_INDEX))
+	{
+		return false;
+	}
+
+	/* the server sends 10 messages per second */
+	interval = (int)(demo_keyframes->value * 10);
+
+	if (interval < 1)
+	{
+		interval = 1;
+	}
+
+	if (!dw->numindex)
+	{
+		return dw->messages >= interval;
+	}
+
+	return dw->messages - dw->index[dw->numindex - 1].message >= interval;
+}
+
+/*
+ * All messages until DemoWriter_EndKeyframe()
+ * form a keyframe for the current position.
+ */
+void
+DemoWriter_BeginKeyframe(demowriter_t *dw)
+{
+	dw->inkeyframe = true;
+	dw->keystart = dw->keysize;
+}
+
+void
+DemoWriter_EndKeyframe(demowriter_t *dw)
+{
+	demoindex_t *entry;
+	int end = -1;
+	int len, lastlen;
+
+	DemoWriter_AppendKey(dw, &end, 4);
+	dw->inkeyframe = false;
+
+	if (!dw->index)
+	{
+		dw->index = Z_Malloc(DEMO_MAX_INDEX * sizeof(demoindex_t));
+	}
+
+	entry = &dw->index[dw->numindex++];
+	entry->message = dw->messages;
+	entry->offset = (int)dw->bytes;
+	entry->keyoffset = dw->keystart;
+
+	/* most keyframes only differ in the
+	   entities, don't store them twice */
+	len = dw->keysize - dw->keystart;
+
+	if (dw->numindex > 1)
+	{
+		lastlen = dw->keystart - dw->lastkey;
+
+		if ((len == lastlen) && !memcmp(dw->keys + dw->lastkey,
+					dw->keys + dw->keystart, len))
+		{
+			entry->keyoffset = dw->lastkey;
+			dw->keysize = dw->keystart;
+
+			return;
+		}
+	}
+
+	dw->lastkey = dw->keystart;
+}
+
+/*
+ * Throws away the messages written since
+ * DemoWriter_BeginKeyframe(). No index
+ * entry is added, a later keyframe is
+ * tried when the next one is due.
+ */
+void
+DemoWriter_AbortKeyframe(demowriter_t *dw)
+{
+	dw->keysize = dw->keystart;
+	dw->inkeyframe = false;
+}
+
+/*
+ * Appends the keyframes and the index
+ * after the end of the message stream.
+ */
+static void
+DemoWriter_WriteIndex(demowriter_t *dw)
+{
+	int keybase, indexofs;
+	int i, v;
+
+	keybase = (int)dw->bytes;
+	DemoWriter_Write(dw, dw->keys, dw->keysize);
+	indexofs = (int)dw->bytes;
+
+	for (i = 0; i < dw->numindex; i++)
+	{
+		v = LittleLong(dw->index[i].message);
+		DemoWriter_Write(dw, &v, 4);
+		v = LittleLong(dw->index[i].offset);
+		DemoWriter_Write(dw, &v, 4);
+		v = LittleLong(keybase + dw->index[i].keyoffset);
+		DemoWriter_Write(dw, &v, 4);
+	}
+
+	v = LittleLong(indexofs);
+	DemoWriter_Write(dw, &v, 4);
+	v = LittleLong(dw->numindex);
+	DemoWriter_Write(dw, &v, 4);
+	DemoWriter_Write(dw, DEMO_INDEX_MAGIC, 4);
+}
+
+static void
+DemoWriter_PrintStats(demowriter_t *dw)
+{
+	Com_Printf("%s: %i KB", dw->name, (int)(dw->bytes / 1024));
+
+	if (dw->numindex)
+	{
+		Com_Printf(", %i keyframes in %i KB", dw->numindex, dw->keysize / 1024);
+	}
+
+	if (dw->thread)
+	{
+		Com_Printf(", buffer high-water %i of %i KB, %i stalls",
+				dw->highwater / 1024, dw->size / 1024, dw->stalls);
+	}
+
+	Com_Printf("\n");
+}
+
+/*
+ * Terminates the message stream, writes all pending data,
+ * finishes the compressed stream and closes the file.
+ */
+void
+DemoWriter_Close(demowriter_t *dw)
+{
+	demowriter_t **link;
+	byte gztrailer[8];
+	int end = -1;
+	int i;
+
+	DemoWriter_Write(dw, &end, 4);
+
+	if (dw->numindex)
+	{
+		DemoWriter_WriteIndex(dw);
+	}
+
+	if (dw->thread)
+	{
+		__atomic_store_n(&dw->closing, 1, __ATOMIC_RELEASE);
+		Sys_JoinThread(dw->thread);
+	}
+
+	if (dw->compress)
+	{
+		DemoWriter_Store(dw, NULL, 0, true);
+		mz_deflateEnd(&dw->stream);
+
+		/* crc32 and size of the uncompressed data */
+		for (i = 0; i < 4; i++)
+		{
+			gztrailer[i] = (dw->crc >> (i * 8)) & 0xff;
+			gztrailer[i + 4] = (dw->rawsize >> (i * 8)) & 0xff;
+		}
+
+		if (fwrite(gztrailer, sizeof(gztrailer), 1, dw->file) != 1)
+		{
+			dw->failed = true;
+		}
+
+		Z_Free(dw->outbuf);
+	}
+
+	DemoWriter_Sync(dw, true);
+	fclose(dw->file);
+
+	if (dw->failed)
+	{
+		Com_Printf("WARNING: %s couldn't be written completely.\n", dw->name);
+	}
+
+	DemoWriter_PrintStats(dw);
+
+	for (link = &demowriters; *link; link = &(*link)->next)
+	{
+		if (*link == dw)
+		{
+			*link = dw->next;
+			break;
+		}
+	}
+
+	if (dw->ring)
+	{
+		Z_Free(dw->ring);
+	}
+
+	if (dw->keys)
+	{
+		Z_Free(dw->keys);
+	}
+
+	if (dw->index)
+	{
+		Z_Free(dw->index);
+	}
+
+	Z_Free(dw);
+}
+
+static void
+DemoWriter_Stats_f(void)
+{
+	demowriter_t *dw;
+
+	if (!demowriters)
+	{
+		Com_Printf("No demo is being recorded.\n");
+		return;
+	}
+
+	for (dw = demowriters; dw; dw = dw->next)
+	{
+		DemoWriter_PrintStats(dw);
+	}
+}
+
+void
+DemoWriter_Init(void)
+{
+	demo_async = Cvar_Get("demo_async", "1", CVAR_ARCHIVE);
+	demo_buffer = Cvar_Get("demo_buffer", "1024", CVAR_ARCHIVE);
+	demo_compress = Cvar_Get("demo_compress", "0", CVAR_ARCHIVE);
+	demo_fsync = Cvar_Get("demo_fsync", "0", CVAR_ARCHIVE);
+	demo_keyframes = Cvar_Get("demo_keyframes", "0", CVAR_ARCHIVE);
+
+	Cmd_AddCommand("demo_stats", DemoWriter_Stats_f);
+}
@@ -51,6 +51,7 @@ typedef struct
 	fsMode_t mode;
 	FILE *file;           /* Only one will be used. */
 	unzFile *zip;        /* (file or zip) */
+	int offset;          /* Start of the file inside a pak. */
 } fsHandle_t;
 
 typedef struct fsLink_s
@@ -488,7 +489,8 @@ FS_FOpenFile(const char *rawname, fileHandle_t *f, qboolean gamedir_only)
 
 						if (handle->file)
 						{
-							fseek(handle->file, pack->files[i].offset, SEEK_SET);
+							handle->offset = pack->files[i].offset;
+							fseek(handle->file, handle->offset, SEEK_SET);
 							return pack->files[i].size;
 						}
 					}
@@ -691,6 +693,52 @@ FS_FRead(void *buffer, int size, int count, fileHandle_t f)
 	return size;
 }
 
+/*
+ * Moves the read position to an absolute offset. Files
+ * inside pk3 archives are compressed, they're reopened
+ * and read up to the offset.
+ */
+qboolean
+FS_Seek(fileHandle_t f, int offset)
+{
+	byte buf[4096];
+	fsHandle_t *handle;
+	int r;
+
+	handle = FS_GetFileByHandle(f);
+
+	if (handle->file)
+	{
+		return fseek(handle->file, handle->offset + offset, SEEK_SET) == 0;
+	}
+	else if (handle->zip)
+	{
+		unzCloseCurrentFile(handle->zip);
+
+		if (unzOpenCurrentFile(handle->zip) != UNZ_OK)
+		{
+			return false;
+		}
+
+		while (offset > 0)
+		{
+			r = unzReadCurrentFile(handle->zip, buf,
+					offset < sizeof(buf) ? offset : sizeof(buf));
+
+			if (r <= 0)
+			{
+				return false;
+			}
+
+			offset -= r;
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
 /*
  * Filename are reletive to the quake search path. A null buffer will just
  * return the file length without loading.
@@ -36,6 +36,7 @@ cvar_t *cl_maxfps;
 cvar_t *dedicated;
 
 extern cvar_t *logfile_active;
+extern FILE *logfile;
 extern jmp_buf abortframe; /* an ERR_DROP occured, exit the entire frame */
 extern zhead_t z_chain;
 
@@ -48,6 +49,8 @@ cvar_t *vid_maxfps;
 cvar_t *host_speeds;
 cvar_t *log_stats;
 cvar_t *showtrace;
+#else
+cvar_t *eventwait;
 #endif
 
 // Forward declarations
@@ -191,7 +194,12 @@ Qcommon_Mainloop(void)
 			}
 		}
 #else
-		Sys_Nanosleep(850000);
+		/* With eventwait Qcommon_Frame() blocks
+		   until there's something to do. */
+		if (!eventwait->value)
+		{
+			Sys_Nanosleep(850000);
+		}
 #endif
 
 		newtime = Sys_Microseconds();
@@ -204,6 +212,74 @@ Qcommon_Mainloop(void)
 	}
 }
 
+/*
+ * Forks sv_instances - 1 copies of the dedicated server,
+ * each listening on the next port after the original. They
+ * share the already loaded map and game code copy-on-write
+ * until they change maps, but are otherwise independent.
+ */
+static void
+Qcommon_SpawnInstances(void)
+{
+	cvar_t *instances;
+	int baseport;
+	int count;
+	int i;
+
+	instances = Cvar_Get("sv_instances", "1", CVAR_NOSET);
+	Cvar_Get("sv_instance", "0", CVAR_NOSET);
+	count = (int)instances->value;
+
+	if (!dedicated->value || (count <= 1))
+	{
+		return;
+	}
+
+	baseport = (int)Cvar_Get("port", va("%i", PORT_SERVER), CVAR_NOSET)->value;
+
+	for (i = 1; i < count; i++)
+	{
+		int pid = Sys_Fork();
+
+		if (pid < 0)
+		{
+			Com_Printf("Couldn't start server instance %i.\n", i);
+			return;
+		}
+
+		if (pid == 0)
+		{
+			Cvar_FullSet("sv_instance", va("%i", i), CVAR_NOSET);
+			Cvar_FullSet("port", va("%i", baseport + i), CVAR_NOSET);
+
+			/* hand out other challenges than the parent */
+			randk_mix((unsigned int)i ^ (unsigned int)Sys_Microseconds());
+
+			/* log into our own file, see Com_VPrintf() */
+			if (logfile)
+			{
+				fclose(logfile);
+				logfile = NULL;
+			}
+
+			/* reopen the sockets on our own port */
+			NET_Config(false);
+			NET_Config(true);
+
+			Com_Printf("Server instance %i listening on port %i.\n",
+					i, baseport + i);
+
+			Cbuf_AddText(va("exec instance%i.cfg\n", i));
+			Cbuf_Execute();
+
+			return;
+		}
+	}
+
+	Com_Printf("Started %i server instances on ports %i to %i.\n",
+			count, baseport, baseport + count - 1);
+}
+
 void Qcommon_ExecConfigs(qboolean gameStartUp)
 {
 	Cbuf_AddText("exec default.cfg\n");
@@ -368,6 +444,7 @@ Qcommon_Init(int argc, char **argv)
 	showtrace = Cvar_Get("showtrace", "0", 0);
 #else
 	dedicated = Cvar_Get("dedicated", "1", CVAR_NOSET);
+	eventwait = Cvar_Get("eventwait", "1", CVAR_ARCHIVE);
 #endif
 
 	// We can't use the clients "quit" command when running dedicated.
@@ -380,6 +457,8 @@ Qcommon_Init(int argc, char **argv)
 	Sys_Init();
 	NET_Init();
 	Netchan_Init();
+	DemoWriter_Init();
+	Prof_Init();
 	SV_Init();
 #ifndef DEDICATED_ONLY
 	CL_Init();
@@ -410,6 +489,8 @@ Qcommon_Init(int argc, char **argv)
 	}
 #endif
 
+	Qcommon_SpawnInstances();
+
 	Com_Printf("==== Yamagi Quake II Initialized ====\n\n");
 	Com_Printf("*************************************\n\n");
 
@@ -728,6 +809,12 @@ Qcommon_Frame(int usec)
 	// Accumulated time since last server run.
 	static int servertimedelta = 0;
 
+	// Woken up by an incoming packet or console input.
+	static qboolean netactivity = false;
+
+	// Time to sleep at the end of the frame.
+	int timeout, svdelay;
+
 	/* A packetframe runs the server and the client,
 	   but not the renderer. The minimal interval of
 	   packetframes is about 10.000 microsec. If run
@@ -774,8 +861,8 @@ Qcommon_Frame(int usec)
 	servertimedelta += usec;
 
 
-	// Network frame time.
-	if (packetdelta < (1000000.0f / pfps)) {
+	// Network frame time. Packets are handled as soon as they arrive.
+	if ((packetdelta < (1000000.0f / pfps)) && !netactivity) {
 		packetframe = false;
 	}
 
@@ -794,12 +881,39 @@ Qcommon_Frame(int usec)
 
 	// Run the serverframe.
 	if (packetframe) {
-		SV_Frame(servertimedelta);
-		servertimedelta = 0;
+		/* The server counts in whole milliseconds,
+		   keep the rest for the next run. */
+		SV_Frame(servertimedelta - (servertimedelta % 1000));
+		servertimedelta %= 1000;
 
 		// Reset deltas if necessary.
 		packetdelta = 0;
 	}
+
+
+	/* Sleep until the next packetframe or server
+	   frame is due or a packet arrives. Wake up at
+	   least every 100ms for timers and the like. */
+	netactivity = false;
+
+	if (eventwait->value)
+	{
+		timeout = 100000;
+
+		if ((pfps > 0) && ((1000000 / pfps) - packetdelta < timeout))
+		{
+			timeout = (1000000 / pfps) - packetdelta;
+		}
+
+		svdelay = SV_FrameDelay();
+
+		if ((svdelay >= 0) && (svdelay * 1000 - servertimedelta < timeout))
+		{
+			timeout = svdelay * 1000 - servertimedelta;
+		}
+
+		netactivity = NET_Wait(timeout);
+	}
 }
 #endif
 
@@ -67,6 +67,8 @@ typedef struct sizebuf_s
 	int maxsize;
 	int cursize;
 	int readcount;
+	int bitpos;                 /* bits used in the last byte by MSG_WriteBits */
+	int readbit;                /* next bit to read by MSG_ReadBits */
 } sizebuf_t;
 
 void SZ_Init(sizebuf_t *buf, byte *data, int length);
@@ -95,8 +97,18 @@ void MSG_WriteDeltaUsercmd(sizebuf_t *sb, struct usercmd_s *from,
 void MSG_WriteDeltaEntity(struct entity_state_s *from,
 		struct entity_state_s *to, sizebuf_t *msg,
 		qboolean force, qboolean newentity);
+void MSG_WriteDeltaPlayerstate(player_state_t *from, player_state_t *to,
+		sizebuf_t *msg);
 void MSG_WriteDir(sizebuf_t *sb, vec3_t vector);
 
+void MSG_WriteBits(sizebuf_t *sb, unsigned value, int bits);
+void MSG_WriteVarBits(sizebuf_t *sb, unsigned value);
+void MSG_WriteDeltaBits(sizebuf_t *sb, int delta);
+void MSG_WriteEntityNumberBits(sizebuf_t *sb, int number, int lastnum);
+qboolean MSG_WriteDeltaEntityBits(struct entity_state_s *from,
+		struct entity_state_s *to, sizebuf_t *msg,
+		qboolean force, qboolean newentity, int lastnum);
+
 void MSG_BeginReading(sizebuf_t *sb);
 
 int MSG_ReadChar(sizebuf_t *sb);
@@ -119,6 +131,11 @@ void MSG_ReadDir(sizebuf_t *sb, vec3_t vector);
 
 void MSG_ReadData(sizebuf_t *sb, void *buffer, int size);
 
+unsigned MSG_ReadBits(sizebuf_t *sb, int bits);
+unsigned MSG_ReadVarBits(sizebuf_t *sb);
+int MSG_ReadDeltaBits(sizebuf_t *sb);
+int MSG_ReadEntityNumberBits(sizebuf_t *sb, int lastnum);
+
 /* ================================================================== */
 
 extern qboolean bigendien;
@@ -151,6 +168,16 @@ void Info_Print(char *s);
 
 #define PROTOCOL_VERSION 34
 
+/* Optional protocol extensions. The client offers them
+   with "ext=<bits>" in its connect string and the server
+   answers with the accepted subset in client_connect.
+   Peers without support just ignore the argument. */
+#define PROTOCOL_EXT_FRAGMENT 1     /* netchan messages up to MAX_BIGMSGLEN */
+#define PROTOCOL_EXT_BITDELTA 2     /* bit packed svc_bitentities */
+#define PROTOCOL_EXT_COMPRESS 4     /* deflated server messages */
+#define PROTOCOL_EXT_SUPPORTED (PROTOCOL_EXT_FRAGMENT | PROTOCOL_EXT_BITDELTA | \
+		PROTOCOL_EXT_COMPRESS)
+
 /* ========================================= */
 
 #define PORT_MASTER 27900
@@ -189,7 +216,10 @@ enum svc_ops_e
 	svc_playerinfo,             /* variable */
 	svc_packetentities,         /* [...] */
 	svc_deltapacketentities,    /* [...] */
-	svc_frame
+	svc_frame,
+
+	/* PROTOCOL_EXT_BITDELTA */
+	svc_bitentities             /* [...] */
 };
 
 /* ============================================== */
@@ -289,6 +319,33 @@ enum clc_ops_e
 #define U_SOUND (1 << 26)
 #define U_SOLID (1 << 27)
 
+/* entity_state_t communication with PROTOCOL_EXT_BITDELTA.
+   Each entity is written as a bit stream: the number as
+   distance to the previous one, a remove bit and then the
+   first byte of flags. BE_MORE adds the second byte. */
+#define BE_ORIGIN1 (1 << 0)     /* coordinates as delta to the old state */
+#define BE_ORIGIN2 (1 << 1)
+#define BE_ORIGIN3 (1 << 2)
+#define BE_ANGLE1 (1 << 3)
+#define BE_ANGLE2 (1 << 4)
+#define BE_ANGLE3 (1 << 5)
+#define BE_FRAME (1 << 6)       /* one bit if it's the next frame */
+#define BE_MORE (1 << 7)
+
+#define BE_OLDORIGIN (1 << 8)   /* delta to the new origin */
+#define BE_EVENT (1 << 9)
+#define BE_MODEL (1 << 10)
+#define BE_MODEL2 (1 << 11)
+#define BE_MODEL3 (1 << 12)
+#define BE_MODEL4 (1 << 13)
+#define BE_SKIN (1 << 14)
+#define BE_EFFECTS (1 << 15)
+#define BE_RENDERFX (1 << 16)
+#define BE_SOLID (1 << 17)
+#define BE_SOUND (1 << 18)
+
+#define BE_BITS 19
+
 /* CMD - Command text buffering and command execution */
 
 /*
@@ -486,10 +543,15 @@ extern qboolean userinfo_modified;
 /* this is set each time a CVAR_USERINFO variable is changed */
 /* so that the client knows to send it to the server */
 
+extern qboolean serverinfo_modified;
+/* this is set each time a CVAR_SERVERINFO variable is changed */
+/* so that the server knows to rebuild its status string */
+
 /* NET */
 
 #define PORT_ANY -1
 #define MAX_MSGLEN 1400             /* max length of a message */
+#define MAX_BIGMSGLEN 16384         /* max length of a fragmented message */
 #define PACKET_HEADER 10            /* two ints and a short */
 
 typedef enum
@@ -523,6 +585,8 @@ void NET_Config(qboolean multiplayer);
 qboolean NET_GetPacket(netsrc_t sock, netadr_t *net_from,
 		sizebuf_t *net_message);
 void NET_SendPacket(netsrc_t sock, int length, void *data, netadr_t to);
+void NET_BeginSendBatch(netsrc_t sock);
+void NET_FlushSendBatch(netsrc_t sock);
 
 qboolean NET_CompareAdr(netadr_t a, netadr_t b);
 qboolean NET_CompareBaseAdr(netadr_t a, netadr_t b);
@@ -530,6 +594,7 @@ qboolean NET_IsLocalAddress(netadr_t adr);
 char *NET_AdrToString(netadr_t a);
 qboolean NET_StringToAdr(const char *s, netadr_t *a);
 void NET_Sleep(int msec);
+qboolean NET_Wait(int usec);
 
 /*=================================================================== */
 
@@ -561,21 +626,37 @@ typedef struct
 	int reliable_sequence;                  /* single bit */
 	int last_reliable_sequence;             /* sequence number of last send */
 
-	/* reliable staging and holding areas */
+	/* reliable staging and holding areas. Without
+	   fragments only MAX_MSGLEN - 16 bytes are used */
 	sizebuf_t message;          /* writing buffer to send to server */
-	byte message_buf[MAX_MSGLEN - 16];          /* leave space for header */
+	byte message_buf[MAX_BIGMSGLEN - 16];       /* leave space for header */
 
 	/* message is copied to this buffer when it is first transfered */
 	int reliable_length;
-	byte reliable_buf[MAX_MSGLEN - 16];         /* unacked reliable message */
+	byte reliable_buf[MAX_BIGMSGLEN - 16];      /* unacked reliable message */
+
+	/* PROTOCOL_EXT_FRAGMENT was negotiated, messages
+	   larger than MAX_MSGLEN are sent in pieces */
+	qboolean fragments;
+	int fragment_sequence;          /* message currently reassembled */
+	int fragment_length;
+	byte fragment_buf[MAX_BIGMSGLEN];
+
+	/* PROTOCOL_EXT_COMPRESS was negotiated, the
+	   server deflates messages if they get smaller */
+	qboolean compression;
+	long long rawbytes;             /* payload before compression */
+	long long sentbytes;            /* payload after compression */
 } netchan_t;
 
 extern netadr_t net_from;
 extern sizebuf_t net_message;
-extern byte net_message_buffer[MAX_MSGLEN];
+extern byte net_message_buffer[MAX_BIGMSGLEN];
 
 void Netchan_Init(void);
 void Netchan_Setup(netsrc_t sock, netchan_t *chan, netadr_t adr, int qport);
+void Netchan_EnableFragments(netchan_t *chan);
+void Netchan_EnableCompression(netchan_t *chan);
 
 qboolean Netchan_NeedReliable(netchan_t *chan);
 void Netchan_Transmit(netchan_t *chan, int length, byte *data);
@@ -585,6 +666,46 @@ qboolean Netchan_Process(netchan_t *chan, sizebuf_t *msg);
 
 qboolean Netchan_CanReliable(netchan_t *chan);
 
+/* DEMO WRITER */
+
+#define DEMO_INDEX_MAGIC "YQ2I"
+
+typedef struct demowriter_s demowriter_t;
+
+void DemoWriter_Init(void);
+demowriter_t *DemoWriter_Open(const char *name);
+const char *DemoWriter_Name(demowriter_t *dw);
+void DemoWriter_Write(demowriter_t *dw, const void *data, int len);
+void DemoWriter_WriteMessage(demowriter_t *dw, const void *data, int len);
+qboolean DemoWriter_KeyframeDue(demowriter_t *dw);
+void DemoWriter_BeginKeyframe(demowriter_t *dw);
+void DemoWriter_EndKeyframe(demowriter_t *dw);
+void DemoWriter_AbortKeyframe(demowriter_t *dw);
+void DemoWriter_Close(demowriter_t *dw);
+
+/* PROFILER */
+
+typedef enum
+{
+	PROF_TRACE,
+	PROF_LINKEDICT,
+	PROF_NUMCOUNTERS
+} profcounter_t;
+
+extern qboolean prof_active;
+
+/* start time for Prof_Accumulate(), 0 when not profiling */
+#define PROF_START() (prof_active ? Sys_Microseconds() : 0)
+
+void Prof_Init(void);
+void Prof_BeginFrame(void);
+void Prof_EndFrame(void);
+int Prof_Begin(const char *name);
+void Prof_End(int handle);
+void Prof_Accumulate(profcounter_t counter, long long start);
+void Prof_ClearTotals(void);
+void Prof_PrintTotals(void);
+
 /* CMODEL */
 
 #include "files.h"
@@ -599,6 +720,12 @@ char *CM_EntityString(void);
 /* creates a clipping hull for an arbitrary box */
 int CM_HeadnodeForBox(vec3_t mins, vec3_t maxs);
 
+/* number of threads that may run collision queries
+   at the same time, see CM_AcquireSlot() */
+#define CM_MAX_THREADS 8
+int CM_AcquireSlot(void);
+void CM_ReleaseSlot(int slot);
+
 /* returns an ORed contents mask */
 int CM_PointContents(vec3_t p, int headnode);
 int CM_TransformedPointContents(vec3_t p, int headnode,
@@ -626,6 +753,7 @@ int CM_LeafArea(int leafnum);
 
 void CM_SetAreaPortalState(int portalnum, qboolean open);
 qboolean CM_AreasConnected(int area1, int area2);
+int CM_AreaFloodVersion(void);
 
 int CM_WriteAreaBits(byte *buffer, int area);
 qboolean CM_HeadnodeVisible(int headnode, byte *visbits);
@@ -670,6 +798,7 @@ int FS_FOpenFile(const char *name, fileHandle_t *f, qboolean gamedir_only);
 void FS_FCloseFile(fileHandle_t f);
 int FS_Read(void *buffer, int size, fileHandle_t f);
 int FS_FRead(void *buffer, int size, int count, fileHandle_t f);
+qboolean FS_Seek(fileHandle_t f, int offset);
 
 // returns the filename used to open f, but (if opened from pack) in correct case
 // returns NULL if f is no valid handle
@@ -748,6 +877,7 @@ byte COM_BlockSequenceCRCByte(byte *base, int length, int sequence);
 extern cvar_t *developer;
 extern cvar_t *modder;
 extern cvar_t *dedicated;
+extern cvar_t *eventwait;
 extern cvar_t *host_speeds;
 extern cvar_t *log_stats;
 
@@ -804,6 +934,7 @@ void SCR_BeginLoadingPlaque(void);
 void SV_Init(void);
 void SV_Shutdown(char *finalmsg, qboolean reconnect);
 void SV_Frame(int usec);
+int SV_FrameDelay(void);
 
 /* ======================================================================= */
 
@@ -829,6 +960,10 @@ void Sys_UnloadGame(void);
 void Sys_GetWorkDir(char *buffer, size_t len);
 qboolean Sys_SetWorkDir(char *path);
 qboolean Sys_Realpath(const char *in, char *out, size_t size);
+void *Sys_CreateThread(void (*func)(void *), void *arg);
+void Sys_JoinThread(void *thread);
+void Sys_SyncFile(FILE *f);
+int Sys_Fork(void);
 
 // Windows only (system.c)
 #ifdef _WIN32
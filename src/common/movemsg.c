@@ -26,6 +26,12 @@
 
 #include "header/common.h"
 
+#define ENTITYNUM_BITS 10   /* enough for MAX_EDICTS */
+
+/* what the client gets from MSG_WriteCoord() and MSG_WriteAngle() */
+#define MSG_PackCoord(f) ((short)(int)((f) * 8))
+#define MSG_PackAngle(f) ((int)((f) * 256 / 360) & 255)
+
 vec3_t bytedirs[NUMVERTEXNORMALS] = {
 	{-0.525731, 0.000000, 0.850651},
 	{-0.442863, 0.238856, 0.864188},
@@ -380,6 +386,254 @@ MSG_WriteDeltaUsercmd(sizebuf_t *buf, usercmd_t *from, usercmd_t *cmd)
 	MSG_WriteByte(buf, cmd->lightlevel);
 }
 
+/*
+ * Writes the difference between two player states.
+ * A NULL from sends a full update.
+ */
+void
+MSG_WriteDeltaPlayerstate(player_state_t *from, player_state_t *to,
+		sizebuf_t *msg)
+{
+	int i;
+	int pflags;
+	player_state_t *ps, *ops;
+	player_state_t dummy;
+	int statbits;
+
+	ps = to;
+
+	if (!from)
+	{
+		memset(&dummy, 0, sizeof(dummy));
+		ops = &dummy;
+	}
+	else
+	{
+		ops = from;
+	}
+
+	/* determine what needs to be sent */
+	pflags = 0;
+
+	if (ps->pmove.pm_type != ops->pmove.pm_type)
+	{
+		pflags |= PS_M_TYPE;
+	}
+
+	if ((ps->pmove.origin[0] != ops->pmove.origin[0]) ||
+		(ps->pmove.origin[1] != ops->pmove.origin[1]) ||
+		(ps->pmove.origin[2] != ops->pmove.origin[2]))
+	{
+		pflags |= PS_M_ORIGIN;
+	}
+
+	if ((ps->pmove.velocity[0] != ops->pmove.velocity[0]) ||
+		(ps->pmove.velocity[1] != ops->pmove.velocity[1]) ||
+		(ps->pmove.velocity[2] != ops->pmove.velocity[2]))
+	{
+		pflags |= PS_M_VELOCITY;
+	}
+
+	if (ps->pmove.pm_time != ops->pmove.pm_time)
+	{
+		pflags |= PS_M_TIME;
+	}
+
+	if (ps->pmove.pm_flags != ops->pmove.pm_flags)
+	{
+		pflags |= PS_M_FLAGS;
+	}
+
+	if (ps->pmove.gravity != ops->pmove.gravity)
+	{
+		pflags |= PS_M_GRAVITY;
+	}
+
+	if ((ps->pmove.delta_angles[0] != ops->pmove.delta_angles[0]) ||
+		(ps->pmove.delta_angles[1] != ops->pmove.delta_angles[1]) ||
+		(ps->pmove.delta_angles[2] != ops->pmove.delta_angles[2]))
+	{
+		pflags |= PS_M_DELTA_ANGLES;
+	}
+
+	if ((ps->viewoffset[0] != ops->viewoffset[0]) ||
+		(ps->viewoffset[1] != ops->viewoffset[1]) ||
+		(ps->viewoffset[2] != ops->viewoffset[2]))
+	{
+		pflags |= PS_VIEWOFFSET;
+	}
+
+	if ((ps->viewangles[0] != ops->viewangles[0]) ||
+		(ps->viewangles[1] != ops->viewangles[1]) ||
+		(ps->viewangles[2] != ops->viewangles[2]))
+	{
+		pflags |= PS_VIEWANGLES;
+	}
+
+	if ((ps->kick_angles[0] != ops->kick_angles[0]) ||
+		(ps->kick_angles[1] != ops->kick_angles[1]) ||
+		(ps->kick_angles[2] != ops->kick_angles[2]))
+	{
+		pflags |= PS_KICKANGLES;
+	}
+
+	if ((ps->blend[0] != ops->blend[0]) ||
+		(ps->blend[1] != ops->blend[1]) ||
+		(ps->blend[2] != ops->blend[2]) ||
+		(ps->blend[3] != ops->blend[3]))
+	{
+		pflags |= PS_BLEND;
+	}
+
+	if (ps->fov != ops->fov)
+	{
+		pflags |= PS_FOV;
+	}
+
+	if (ps->rdflags != ops->rdflags)
+	{
+		pflags |= PS_RDFLAGS;
+	}
+
+	if ((ps->gunframe != ops->gunframe) ||
+		/* added so weapon angle/offset update during pauseframes */
+		(ps->gunoffset[0] != ops->gunoffset[0]) ||
+		(ps->gunoffset[1] != ops->gunoffset[1]) ||
+		(ps->gunoffset[2] != ops->gunoffset[2]) ||
+
+		(ps->gunangles[0] != ops->gunangles[0]) ||
+		(ps->gunangles[1] != ops->gunangles[1]) ||
+		(ps->gunangles[2] != ops->gunangles[2]))
+	{
+		pflags |= PS_WEAPONFRAME;
+	}
+
+	pflags |= PS_WEAPONINDEX;
+
+	/* write it */
+	MSG_WriteByte(msg, svc_playerinfo);
+	MSG_WriteShort(msg, pflags);
+
+	/* write the pmove_state_t */
+	if (pflags & PS_M_TYPE)
+	{
+		MSG_WriteByte(msg, ps->pmove.pm_type);
+	}
+
+	if (pflags & PS_M_ORIGIN)
+	{
+		MSG_WriteShort(msg, ps->pmove.origin[0]);
+		MSG_WriteShort(msg, ps->pmove.origin[1]);
+		MSG_WriteShort(msg, ps->pmove.origin[2]);
+	}
+
+	if (pflags & PS_M_VELOCITY)
+	{
+		MSG_WriteShort(msg, ps->pmove.velocity[0]);
+		MSG_WriteShort(msg, ps->pmove.velocity[1]);
+		MSG_WriteShort(msg, ps->pmove.velocity[2]);
+	}
+
+	if (pflags & PS_M_TIME)
+	{
+		MSG_WriteByte(msg, ps->pmove.pm_time);
+	}
+
+	if (pflags & PS_M_FLAGS)
+	{
+		MSG_WriteByte(msg, ps->pmove.pm_flags);
+	}
+
+	if (pflags & PS_M_GRAVITY)
+	{
+		MSG_WriteShort(msg, ps->pmove.gravity);
+	}
+
+	if (pflags & PS_M_DELTA_ANGLES)
+	{
+		MSG_WriteShort(msg, ps->pmove.delta_angles[0]);
+		MSG_WriteShort(msg, ps->pmove.delta_angles[1]);
+		MSG_WriteShort(msg, ps->pmove.delta_angles[2]);
+	}
+
+	/* write the rest of the player_state_t */
+	if (pflags & PS_VIEWOFFSET)
+	{
+		MSG_WriteChar(msg, ps->viewoffset[0] * 4);
+		MSG_WriteChar(msg, ps->viewoffset[1] * 4);
+		MSG_WriteChar(msg, ps->viewoffset[2] * 4);
+	}
+
+	if (pflags & PS_VIEWANGLES)
+	{
+		MSG_WriteAngle16(msg, ps->viewangles[0]);
+		MSG_WriteAngle16(msg, ps->viewangles[1]);
+		MSG_WriteAngle16(msg, ps->viewangles[2]);
+	}
+
+	if (pflags & PS_KICKANGLES)
+	{
+		MSG_WriteChar(msg, ps->kick_angles[0] * 4);
+		MSG_WriteChar(msg, ps->kick_angles[1] * 4);
+		MSG_WriteChar(msg, ps->kick_angles[2] * 4);
+	}
+
+	if (pflags & PS_WEAPONINDEX)
+	{
+		MSG_WriteByte(msg, ps->gunindex);
+	}
+
+	if (pflags & PS_WEAPONFRAME)
+	{
+		MSG_WriteByte(msg, ps->gunframe);
+		MSG_WriteChar(msg, ps->gunoffset[0] * 4);
+		MSG_WriteChar(msg, ps->gunoffset[1] * 4);
+		MSG_WriteChar(msg, ps->gunoffset[2] * 4);
+		MSG_WriteChar(msg, ps->gunangles[0] * 4);
+		MSG_WriteChar(msg, ps->gunangles[1] * 4);
+		MSG_WriteChar(msg, ps->gunangles[2] * 4);
+	}
+
+	if (pflags & PS_BLEND)
+	{
+		MSG_WriteByte(msg, ps->blend[0] * 255);
+		MSG_WriteByte(msg, ps->blend[1] * 255);
+		MSG_WriteByte(msg, ps->blend[2] * 255);
+		MSG_WriteByte(msg, ps->blend[3] * 255);
+	}
+
+	if (pflags & PS_FOV)
+	{
+		MSG_WriteByte(msg, ps->fov);
+	}
+
+	if (pflags & PS_RDFLAGS)
+	{
+		MSG_WriteByte(msg, ps->rdflags);
+	}
+
+	/* send stats */
+	statbits = 0;
+
+	for (i = 0; i < MAX_STATS; i++)
+	{
+		if (ps->stats[i] != ops->stats[i])
+		{
+			statbits |= 1 << i;
+		}
+	}
+
+	MSG_WriteLong(msg, statbits);
+
+	for (i = 0; i < MAX_STATS; i++)
+	{
+		if (statbits & (1 << i))
+		{
+			MSG_WriteShort(msg, ps->stats[i]);
+		}
+	}
+}
+
 void
 MSG_WriteDir(sizebuf_t *sb, vec3_t dir)
 {
@@ -772,10 +1026,343 @@ MSG_WriteDeltaEntity(entity_state_t *from,
 	}
 }
 
+/*
+ * Bit level writing for PROTOCOL_EXT_BITDELTA. Bits are
+ * stored starting at the least significant bit of each
+ * byte. A byte sized write ends the bit sequence, the next
+ * MSG_WriteBits() starts in a fresh byte.
+ */
+void
+MSG_WriteBits(sizebuf_t *sb, unsigned value, int bits)
+{
+	byte *b;
+	int n;
+
+	while (bits > 0)
+	{
+		if (!sb->bitpos || !sb->cursize)
+		{
+			b = SZ_GetSpace(sb, 1);
+			*b = 0;
+		}
+
+		n = 8 - sb->bitpos;
+
+		if (n > bits)
+		{
+			n = bits;
+		}
+
+		sb->data[sb->cursize - 1] |= (value & ((1u << n) - 1)) << sb->bitpos;
+		sb->bitpos = (sb->bitpos + n) & 7;
+
+		value >>= n;
+		bits -= n;
+	}
+}
+
+/*
+ * Unsigned integer with a two bit size class
+ */
+void
+MSG_WriteVarBits(sizebuf_t *sb, unsigned value)
+{
+	if (value < (1 << 4))
+	{
+		MSG_WriteBits(sb, 0, 2);
+		MSG_WriteBits(sb, value, 4);
+	}
+	else if (value < (1 << 8))
+	{
+		MSG_WriteBits(sb, 1, 2);
+		MSG_WriteBits(sb, value, 8);
+	}
+	else if (value < (1 << 16))
+	{
+		MSG_WriteBits(sb, 2, 2);
+		MSG_WriteBits(sb, value, 16);
+	}
+	else
+	{
+		MSG_WriteBits(sb, 3, 2);
+		MSG_WriteBits(sb, value, 32);
+	}
+}
+
+/*
+ * Signed difference between two 16 bit network
+ * values, like coordinates, with a size class
+ */
+void
+MSG_WriteDeltaBits(sizebuf_t *sb, int delta)
+{
+	if ((delta >= -(1 << 5)) && (delta < (1 << 5)))
+	{
+		MSG_WriteBits(sb, 0, 2);
+		MSG_WriteBits(sb, delta, 6);
+	}
+	else if ((delta >= -(1 << 9)) && (delta < (1 << 9)))
+	{
+		MSG_WriteBits(sb, 1, 2);
+		MSG_WriteBits(sb, delta, 10);
+	}
+	else if ((delta >= -(1 << 12)) && (delta < (1 << 12)))
+	{
+		MSG_WriteBits(sb, 2, 2);
+		MSG_WriteBits(sb, delta, 13);
+	}
+	else
+	{
+		/* wraps around like the coordinates */
+		MSG_WriteBits(sb, 3, 2);
+		MSG_WriteBits(sb, delta, 16);
+	}
+}
+
+/*
+ * Entity numbers are increasing within a frame, so they're
+ * written as distance to the last one. 0 ends the list.
+ */
+void
+MSG_WriteEntityNumberBits(sizebuf_t *sb, int number, int lastnum)
+{
+	if (number == lastnum + 1)
+	{
+		MSG_WriteBits(sb, 1, 1);
+	}
+	else if ((number > lastnum) && (number - lastnum - 2 < (1 << 4)))
+	{
+		MSG_WriteBits(sb, 0, 1);
+		MSG_WriteBits(sb, 1, 1);
+		MSG_WriteBits(sb, number - lastnum - 2, 4);
+	}
+	else
+	{
+		MSG_WriteBits(sb, 0, 2);
+		MSG_WriteBits(sb, number, ENTITYNUM_BITS);
+	}
+}
+
+/*
+ * Bit packed version of MSG_WriteDeltaEntity(). Coordinates
+ * and angles are compared in network precision, the client
+ * can't tell smaller changes anyways. Origins are sent as
+ * difference to the old state and the old origin as
+ * difference to the new one. lastnum is the number of the
+ * entity written before, returns false if nothing was sent.
+ */
+qboolean
+MSG_WriteDeltaEntityBits(entity_state_t *from, entity_state_t *to,
+		sizebuf_t *msg, qboolean force, qboolean newentity, int lastnum)
+{
+	int oldcoord[3], coord[3];
+	int bits;
+	int i;
+
+	if (!to->number)
+	{
+		Com_Error(ERR_FATAL, "Unset entity number");
+	}
+
+	if (to->number >= MAX_EDICTS)
+	{
+		Com_Error(ERR_FATAL, "Entity number >= MAX_EDICTS");
+	}
+
+	bits = 0;
+
+	for (i = 0; i < 3; i++)
+	{
+		oldcoord[i] = MSG_PackCoord(from->origin[i]);
+		coord[i] = MSG_PackCoord(to->origin[i]);
+
+		if (coord[i] != oldcoord[i])
+		{
+			bits |= BE_ORIGIN1 << i;
+		}
+
+		if (MSG_PackAngle(to->angles[i]) != MSG_PackAngle(from->angles[i]))
+		{
+			bits |= BE_ANGLE1 << i;
+		}
+	}
+
+	if (to->frame != from->frame)
+	{
+		bits |= BE_FRAME;
+	}
+
+	if (newentity || (to->renderfx & RF_BEAM))
+	{
+		bits |= BE_OLDORIGIN;
+	}
+
+	/* event is not delta compressed, just 0 compressed */
+	if (to->event)
+	{
+		bits |= BE_EVENT;
+	}
+
+	if (to->modelindex != from->modelindex)
+	{
+		bits |= BE_MODEL;
+	}
+
+	if (to->modelindex2 != from->modelindex2)
+	{
+		bits |= BE_MODEL2;
+	}
+
+	if (to->modelindex3 != from->modelindex3)
+	{
+		bits |= BE_MODEL3;
+	}
+
+	if (to->modelindex4 != from->modelindex4)
+	{
+		bits |= BE_MODEL4;
+	}
+
+	if (to->skinnum != from->skinnum)
+	{
+		bits |= BE_SKIN;
+	}
+
+	if (to->effects != from->effects)
+	{
+		bits |= BE_EFFECTS;
+	}
+
+	if (to->renderfx != from->renderfx)
+	{
+		bits |= BE_RENDERFX;
+	}
+
+	if (to->solid != from->solid)
+	{
+		bits |= BE_SOLID;
+	}
+
+	if (to->sound != from->sound)
+	{
+		bits |= BE_SOUND;
+	}
+
+	if (!bits && !force)
+	{
+		return false; /* nothing to send! */
+	}
+
+	if (bits & ~0xff)
+	{
+		bits |= BE_MORE;
+	}
+
+	MSG_WriteEntityNumberBits(msg, to->number, lastnum);
+	MSG_WriteBits(msg, 0, 1); /* not removed */
+	MSG_WriteBits(msg, bits, 8);
+
+	if (bits & BE_MORE)
+	{
+		MSG_WriteBits(msg, bits >> 8, BE_BITS - 8);
+	}
+
+	for (i = 0; i < 3; i++)
+	{
+		if (bits & (BE_ORIGIN1 << i))
+		{
+			MSG_WriteDeltaBits(msg, coord[i] - oldcoord[i]);
+		}
+	}
+
+	for (i = 0; i < 3; i++)
+	{
+		if (bits & (BE_ANGLE1 << i))
+		{
+			MSG_WriteBits(msg, MSG_PackAngle(to->angles[i]), 8);
+		}
+	}
+
+	if (bits & BE_FRAME)
+	{
+		/* animations mostly advance by one */
+		if (to->frame == from->frame + 1)
+		{
+			MSG_WriteBits(msg, 1, 1);
+		}
+		else
+		{
+			MSG_WriteBits(msg, 0, 1);
+			MSG_WriteVarBits(msg, to->frame & 0xffff);
+		}
+	}
+
+	if (bits & BE_OLDORIGIN)
+	{
+		for (i = 0; i < 3; i++)
+		{
+			MSG_WriteDeltaBits(msg, MSG_PackCoord(to->old_origin[i]) - coord[i]);
+		}
+	}
+
+	if (bits & BE_EVENT)
+	{
+		MSG_WriteBits(msg, to->event, 8);
+	}
+
+	if (bits & BE_MODEL)
+	{
+		MSG_WriteBits(msg, to->modelindex, 8);
+	}
+
+	if (bits & BE_MODEL2)
+	{
+		MSG_WriteBits(msg, to->modelindex2, 8);
+	}
+
+	if (bits & BE_MODEL3)
+	{
+		MSG_WriteBits(msg, to->modelindex3, 8);
+	}
+
+	if (bits & BE_MODEL4)
+	{
+		MSG_WriteBits(msg, to->modelindex4, 8);
+	}
+
+	if (bits & BE_SKIN)
+	{
+		MSG_WriteVarBits(msg, to->skinnum);
+	}
+
+	if (bits & BE_EFFECTS)
+	{
+		MSG_WriteVarBits(msg, to->effects);
+	}
+
+	if (bits & BE_RENDERFX)
+	{
+		MSG_WriteVarBits(msg, to->renderfx);
+	}
+
+	if (bits & BE_SOLID)
+	{
+		MSG_WriteBits(msg, to->solid, 16);
+	}
+
+	if (bits & BE_SOUND)
+	{
+		MSG_WriteBits(msg, to->sound, 8);
+	}
+
+	return true;
+}
+
 void
 MSG_BeginReading(sizebuf_t *msg)
 {
 	msg->readcount = 0;
+	msg->readbit = 0;
 }
 
 int
@@ -1042,3 +1629,96 @@ MSG_ReadData(sizebuf_t *msg_read, void *data, int len)
 	}
 }
 
+/*
+ * Counterpart of MSG_WriteBits(). A byte sized read
+ * in between ends the bit sequence.
+ */
+unsigned
+MSG_ReadBits(sizebuf_t *msg_read, int bits)
+{
+	unsigned value;
+	int shift, pos, n, c;
+
+	/* continue in the partially read byte */
+	if (!(msg_read->readbit & 7) ||
+		((msg_read->readbit >> 3) != msg_read->readcount - 1))
+	{
+		msg_read->readbit = msg_read->readcount * 8;
+	}
+
+	value = 0;
+
+	for (shift = 0; shift < bits; shift += n)
+	{
+		pos = msg_read->readbit & 7;
+
+		if (!pos)
+		{
+			msg_read->readcount++;
+		}
+
+		if (msg_read->readcount > msg_read->cursize)
+		{
+			c = 0;
+		}
+		else
+		{
+			c = msg_read->data[msg_read->readcount - 1];
+		}
+
+		n = 8 - pos;
+
+		if (n > bits - shift)
+		{
+			n = bits - shift;
+		}
+
+		value |= ((c >> pos) & ((1u << n) - 1)) << shift;
+		msg_read->readbit += n;
+	}
+
+	return value;
+}
+
+unsigned
+MSG_ReadVarBits(sizebuf_t *msg_read)
+{
+	static const int sizes[4] = {4, 8, 16, 32};
+
+	return MSG_ReadBits(msg_read, sizes[MSG_ReadBits(msg_read, 2)]);
+}
+
+int
+MSG_ReadDeltaBits(sizebuf_t *msg_read)
+{
+	static const int sizes[4] = {6, 10, 13, 16};
+	int size, value;
+
+	size = sizes[MSG_ReadBits(msg_read, 2)];
+	value = MSG_ReadBits(msg_read, size);
+
+	/* sign extend */
+	if (value & (1 << (size - 1)))
+	{
+		value -= 1 << size;
+	}
+
+	return value;
+}
+
+int
+MSG_ReadEntityNumberBits(sizebuf_t *msg_read, int lastnum)
+{
+	if (MSG_ReadBits(msg_read, 1))
+	{
+		return lastnum + 1;
+	}
+
+	if (MSG_ReadBits(msg_read, 1))
+	{
+		return lastnum + 2 + MSG_ReadBits(msg_read, 4);
+	}
+
+	return MSG_ReadBits(msg_read, ENTITYNUM_BITS);
+}
+
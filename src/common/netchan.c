@@ -27,6 +27,7 @@
 #include <time.h>
 
 #include "header/common.h"
+#include "unzip/miniz.h"
 
 /*
  * packet header
@@ -81,15 +82,42 @@
  * frame, such as during the connection stage while waiting for the
  * client to load, then a packet only needs to be delivered if there is
  * something in the unacknowledged reliable
+ *
+ * If both sides negotiated PROTOCOL_EXT_FRAGMENT, messages larger than
+ * MAX_MSGLEN are split into several datagrams. All of them share the
+ * same sequence number, have bit 30 of the sequence set and carry an
+ * additional 16 bit field after the header:
+ *
+ * 15	byte offset of this fragment in the message
+ * 1	more fragments follow
+ *
+ * The receiver collects the fragments in order and hands the message
+ * out once the last one arrived. A lost fragment loses the whole
+ * message, the reliable part is retransmitted as usual.
+ *
+ * If PROTOCOL_EXT_COMPRESS was negotiated, the server deflates the
+ * payload of messages to the client. Compressed messages have bit 30
+ * of the acknowledge set. Each message is compressed on its own, so a
+ * lost packet doesn't affect the following ones. Compression happens
+ * before fragmentation, the receiver inflates the reassembled message.
  */
 
+#define FRAGMENT_BIT (1u << 30)
+#define FRAGMENT_MORE 0x8000
+#define FRAGMENT_SIZE (MAX_MSGLEN - 16)
+
+#define COMPRESS_BIT (1u << 30)
+#define COMPRESS_MINSIZE 64         /* smaller messages don't get smaller */
+#define COMPRESS_FLAGS (TDEFL_GREEDY_PARSING_FLAG | \
+		TDEFL_NONDETERMINISTIC_PARSING_FLAG | 16)
+
 cvar_t *showpackets;
 cvar_t *showdrop;
 cvar_t *qport;
 
 netadr_t net_from;
 sizebuf_t net_message;
-byte net_message_buffer[MAX_MSGLEN];
+byte net_message_buffer[MAX_BIGMSGLEN];
 
 void
 Netchan_Init(void)
@@ -173,10 +201,108 @@ Netchan_Setup(netsrc_t sock, netchan_t *chan, netadr_t adr, int qport)
 	chan->incoming_sequence = 0;
 	chan->outgoing_sequence = 1;
 
-	SZ_Init(&chan->message, chan->message_buf, sizeof(chan->message_buf));
+	SZ_Init(&chan->message, chan->message_buf, MAX_MSGLEN - 16);
 	chan->message.allowoverflow = true;
 }
 
+/*
+ * Called after PROTOCOL_EXT_FRAGMENT was negotiated,
+ * allows messages of up to MAX_BIGMSGLEN bytes.
+ */
+void
+Netchan_EnableFragments(netchan_t *chan)
+{
+	chan->fragments = true;
+	chan->message.maxsize = sizeof(chan->message_buf);
+}
+
+/*
+ * Called after PROTOCOL_EXT_COMPRESS was negotiated. The
+ * server compresses, the client accepts compressed messages.
+ */
+void
+Netchan_EnableCompression(netchan_t *chan)
+{
+	chan->compression = true;
+}
+
+/*
+ * Deflates the payload of the packet in send, starting at
+ * headerlen, if that makes it smaller. Returns true if the
+ * packet was compressed.
+ */
+static qboolean
+Netchan_Compress(netchan_t *chan, sizebuf_t *send, int headerlen)
+{
+	static tdefl_compressor *deflator;
+	static byte out[MAX_BIGMSGLEN];
+	size_t inlen, outlen;
+	int length;
+
+	length = send->cursize - headerlen;
+	chan->rawbytes += length;
+	chan->sentbytes += length;
+
+	if (length < COMPRESS_MINSIZE)
+	{
+		return false;
+	}
+
+	if (!deflator)
+	{
+		/* a few hundred KB, shared by all channels */
+		deflator = malloc(sizeof(*deflator));
+
+		if (!deflator)
+		{
+			return false;
+		}
+	}
+
+	tdefl_init(deflator, NULL, NULL, COMPRESS_FLAGS);
+
+	/* anything not smaller is sent as is */
+	inlen = length;
+	outlen = length - 1;
+
+	if (tdefl_compress(deflator, send->data + headerlen, &inlen,
+				out, &outlen, TDEFL_FINISH) != TDEFL_STATUS_DONE)
+	{
+		return false;
+	}
+
+	memcpy(send->data + headerlen, out, outlen);
+	send->cursize = headerlen + (int)outlen;
+	chan->sentbytes -= length - (int)outlen;
+
+	return true;
+}
+
+/*
+ * Inflates the payload of msg, starting at its readcount
+ */
+static qboolean
+Netchan_Decompress(netchan_t *chan, sizebuf_t *msg)
+{
+	static byte out[MAX_BIGMSGLEN];
+	size_t length;
+
+	length = tinfl_decompress_mem_to_mem(out, msg->maxsize - msg->readcount,
+			msg->data + msg->readcount, msg->cursize - msg->readcount, 0);
+
+	if (length == TINFL_DECOMPRESS_MEM_TO_MEM_FAILED)
+	{
+		Com_Printf("%s:Bad compressed message\n",
+				NET_AdrToString(chan->remote_address));
+		return false;
+	}
+
+	memcpy(msg->data + msg->readcount, out, length);
+	msg->cursize = msg->readcount + (int)length;
+
+	return true;
+}
+
 /*
  * Returns true if the last reliable message has acked
  */
@@ -214,6 +340,48 @@ Netchan_NeedReliable(netchan_t *chan)
 	return send_reliable;
 }
 
+/*
+ * Sends a message larger than MAX_MSGLEN as a
+ * series of fragments. send holds the complete
+ * packet, the payload starts at headerlen.
+ */
+static void
+Netchan_TransmitFragments(netchan_t *chan, sizebuf_t *send, int headerlen,
+		unsigned w1, unsigned w2)
+{
+	sizebuf_t frag;
+	byte frag_buf[MAX_MSGLEN];
+	int offset, length, total;
+
+	total = send->cursize - headerlen;
+
+	for (offset = 0; offset < total; offset += length)
+	{
+		length = total - offset;
+
+		if (length > FRAGMENT_SIZE)
+		{
+			length = FRAGMENT_SIZE;
+		}
+
+		SZ_Init(&frag, frag_buf, sizeof(frag_buf));
+
+		MSG_WriteLong(&frag, w1 | FRAGMENT_BIT);
+		MSG_WriteLong(&frag, w2);
+
+		if (chan->sock == NS_CLIENT)
+		{
+			MSG_WriteShort(&frag, chan->qport);
+		}
+
+		MSG_WriteShort(&frag, offset |
+				((offset + length < total) ? FRAGMENT_MORE : 0));
+		SZ_Write(&frag, send->data + headerlen + offset, length);
+
+		NET_SendPacket(chan->sock, frag.cursize, frag.data, chan->remote_address);
+	}
+}
+
 /*
  * tries to send an unreliable message to a connection, and handles the
  * transmition / retransmition of the reliable messages.
@@ -224,9 +392,10 @@ void
 Netchan_Transmit(netchan_t *chan, int length, byte *data)
 {
 	sizebuf_t send;
-	byte send_buf[MAX_MSGLEN];
+	byte send_buf[MAX_BIGMSGLEN];
 	qboolean send_reliable;
 	unsigned w1, w2;
+	int headerlen;
 
 	/* check for message overflow */
 	if (chan->message.overflowed)
@@ -247,8 +416,9 @@ Netchan_Transmit(netchan_t *chan, int length, byte *data)
 		chan->reliable_sequence ^= 1;
 	}
 
-	/* write the packet header */
-	SZ_Init(&send, send_buf, sizeof(send_buf));
+	/* write the packet header, fragmented
+	   messages may be larger than a datagram */
+	SZ_Init(&send, send_buf, chan->fragments ? sizeof(send_buf) : MAX_MSGLEN);
 
 	w1 = (chan->outgoing_sequence & ~(1 << 31)) | (send_reliable << 31);
 	w2 =
@@ -264,9 +434,11 @@ Netchan_Transmit(netchan_t *chan, int length, byte *data)
 	/* send the qport if we are a client */
 	if (chan->sock == NS_CLIENT)
 	{
-		MSG_WriteShort(&send, qport->value);
+		MSG_WriteShort(&send, chan->qport);
 	}
 
+	headerlen = send.cursize;
+
 	/* copy the reliable message to the packet first */
 	if (send_reliable)
 	{
@@ -284,8 +456,24 @@ Netchan_Transmit(netchan_t *chan, int length, byte *data)
 		Com_Printf("Netchan_Transmit: dumped unreliable\n");
 	}
 
+	/* mark compressed packets in bit 30
+	   of the little endian acknowledge */
+	if (chan->compression && (chan->sock == NS_SERVER) &&
+		Netchan_Compress(chan, &send, headerlen))
+	{
+		w2 |= COMPRESS_BIT;
+		send.data[7] |= COMPRESS_BIT >> 24;
+	}
+
 	/* send the datagram */
-	NET_SendPacket(chan->sock, send.cursize, send.data, chan->remote_address);
+	if (send.cursize > MAX_MSGLEN)
+	{
+		Netchan_TransmitFragments(chan, &send, headerlen, w1, w2);
+	}
+	else
+	{
+		NET_SendPacket(chan->sock, send.cursize, send.data, chan->remote_address);
+	}
 
 	if (showpackets->value)
 	{
@@ -306,6 +494,80 @@ Netchan_Transmit(netchan_t *chan, int length, byte *data)
 	}
 }
 
+/*
+ * Adds a fragment to the message being reassembled. Returns
+ * true once the message is complete, msg then contains the
+ * original packet header followed by the full payload.
+ */
+static qboolean
+Netchan_ProcessFragment(netchan_t *chan, sizebuf_t *msg, unsigned sequence)
+{
+	int offset, length;
+	qboolean more;
+
+	offset = MSG_ReadShort(msg) & 0xffff;
+	more = (offset & FRAGMENT_MORE) != 0;
+	offset &= ~FRAGMENT_MORE;
+
+	/* a fragment of a newer message, the
+	   old one will never be completed */
+	if (sequence != chan->fragment_sequence)
+	{
+		chan->fragment_sequence = sequence;
+		chan->fragment_length = 0;
+	}
+
+	/* fragments must arrive in order */
+	if (offset != chan->fragment_length)
+	{
+		if (showdrop->value)
+		{
+			Com_Printf("%s:Dropped fragment of %i at %i\n",
+					NET_AdrToString(chan->remote_address),
+					sequence, offset);
+		}
+
+		return false;
+	}
+
+	length = msg->cursize - msg->readcount;
+
+	if ((length < 0) || (chan->fragment_length + length > sizeof(chan->fragment_buf)))
+	{
+		Com_Printf("%s:Oversize fragmented message\n",
+				NET_AdrToString(chan->remote_address));
+		chan->fragment_length = 0;
+		return false;
+	}
+
+	memcpy(chan->fragment_buf + chan->fragment_length,
+			msg->data + msg->readcount, length);
+	chan->fragment_length += length;
+
+	if (more)
+	{
+		return false;
+	}
+
+	/* keep the 8 byte sequence header in front,
+	   demo recording expects it to be there */
+	if (chan->fragment_length + 8 > msg->maxsize)
+	{
+		Com_Printf("%s:Fragmented message too large\n",
+				NET_AdrToString(chan->remote_address));
+		chan->fragment_length = 0;
+		return false;
+	}
+
+	memcpy(msg->data + 8, chan->fragment_buf, chan->fragment_length);
+	msg->cursize = chan->fragment_length + 8;
+	msg->readcount = 8;
+
+	chan->fragment_length = 0;
+
+	return true;
+}
+
 /*
  * called when the current net_message is from remote_address
  * modifies net_message so that it points to the packet payload
@@ -315,6 +577,7 @@ Netchan_Process(netchan_t *chan, sizebuf_t *msg)
 {
 	unsigned sequence, sequence_ack;
 	unsigned reliable_ack, reliable_message;
+	qboolean fragmented, compressed;
 
 	/* get sequence numbers */
 	MSG_BeginReading(msg);
@@ -333,6 +596,22 @@ Netchan_Process(netchan_t *chan, sizebuf_t *msg)
 	sequence &= ~(1 << 31);
 	sequence_ack &= ~(1 << 31);
 
+	fragmented = false;
+
+	if (chan->fragments && (sequence & FRAGMENT_BIT))
+	{
+		fragmented = true;
+		sequence &= ~FRAGMENT_BIT;
+	}
+
+	compressed = false;
+
+	if (chan->compression && (sequence_ack & COMPRESS_BIT))
+	{
+		compressed = true;
+		sequence_ack &= ~COMPRESS_BIT;
+	}
+
 	if (showpackets->value)
 	{
 		if (reliable_message)
@@ -363,6 +642,17 @@ Netchan_Process(netchan_t *chan, sizebuf_t *msg)
 		return false;
 	}
 
+	/* wait until all fragments have arrived */
+	if (fragmented && !Netchan_ProcessFragment(chan, msg, sequence))
+	{
+		return false;
+	}
+
+	if (compressed && !Netchan_Decompress(chan, msg))
+	{
+		return false;
+	}
+
 	/* dropped packets don't keep the message from being used */
 	chan->dropped = sequence - (chan->incoming_sequence + 1);
 
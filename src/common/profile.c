@@ -0,0 +1,574 @@
+/*
+ * Copyright (C) 1997-2001 Id Software, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * =======================================================================
+ *
+ * Server frame profiler. Timed zones are recorded into a ring buffer
+ * holding the last PROF_FRAMES frames, which can be dumped as Chrome
+ * trace (chrome://tracing, Perfetto) or as a flat histogram. Functions
+ * called thousands of times per frame, like traces, are not recorded
+ * one by one but summed up per frame in counters.
+ *
+ * A profiler frame starts with the first SV_Frame() call after the
+ * last game frame and ends with the next game frame, so packets read
+ * between two game frames are accounted to the following one.
+ *
+ * =======================================================================
+ */
+
+#include "header/common.h"
+
+#define PROF_FRAMES 128
+#define PROF_EVENTS (1 << 17)
+#define PROF_MAXNAMES 1024
+#define PROF_HASHSIZE 256
+#define PROF_NUMBUCKETS 6
+
+typedef struct
+{
+	short name;
+	short depth;
+	int start;                  /* usec since the start of the frame */
+	int duration;
+} profevent_t;
+
+typedef struct
+{
+	long long start;
+	int duration;
+	int busy;                   /* time spent in top level zones */
+	unsigned firstevent;
+	int numevents;
+	int counters[PROF_NUMCOUNTERS];
+	int calls[PROF_NUMCOUNTERS];
+} profframe_t;
+
+static const char *prof_counternames[PROF_NUMCOUNTERS] = {
+	"SV_Trace",
+	"SV_LinkEdict"
+};
+
+qboolean prof_active;
+
+static cvar_t *prof;
+static cvar_t *prof_trigger;
+
+static profevent_t *prof_events;
+static unsigned prof_numevents;
+static profframe_t prof_frames[PROF_FRAMES];
+static unsigned prof_numframes;
+static profframe_t *prof_frame;     /* open frame or NULL */
+static YQ2_THREAD_LOCAL qboolean prof_framethread; /* runs the frames */
+static int prof_depth;
+
+/* zone names are copied, game strings
+   don't live longer than the level */
+static char *prof_names[PROF_MAXNAMES];
+static short prof_namenext[PROF_MAXNAMES];
+static short prof_namehash[PROF_HASHSIZE];
+static int prof_numnames;
+
+/* sums over a whole run, the ring
+   buffer only holds PROF_FRAMES frames */
+static int prof_totalcalls[PROF_MAXNAMES];
+static long long prof_total[PROF_MAXNAMES];
+static int prof_totalmax[PROF_MAXNAMES];
+static int prof_totalccalls[PROF_NUMCOUNTERS];
+static long long prof_totalctime[PROF_NUMCOUNTERS];
+static int prof_totalframes;
+
+static int
+Prof_Intern(const char *name)
+{
+	unsigned hash;
+	const char *s;
+	int i;
+
+	if (!name)
+	{
+		name = "unknown";
+	}
+
+	for (hash = 0, s = name; *s; s++)
+	{
+		hash = hash * 31 + *s;
+	}
+
+	hash &= PROF_HASHSIZE - 1;
+
+	for (i = prof_namehash[hash] - 1; i >= 0; i = prof_namenext[i] - 1)
+	{
+		if (!strcmp(prof_names[i], name))
+		{
+			return i;
+		}
+	}
+
+	if (prof_numnames == PROF_MAXNAMES)
+	{
+		return Prof_Intern("other");
+	}
+
+	i = prof_numnames++;
+	prof_names[i] = CopyString((char *)name);
+	prof_namenext[i] = prof_namehash[hash];
+	prof_namehash[hash] = i + 1;
+
+	return i;
+}
+
+/*
+ * Starts a timed zone. The returned handle
+ * must be passed to Prof_End().
+ */
+int
+Prof_Begin(const char *name)
+{
+	profevent_t *e;
+
+	if (!prof_frame || (prof_frame->numevents >= PROF_EVENTS / 2))
+	{
+		return -1;
+	}
+
+	e = &prof_events[prof_numevents & (PROF_EVENTS - 1)];
+	e->name = Prof_Intern(name);
+	e->depth = prof_depth++;
+	e->start = (int)(Sys_Microseconds() - prof_frame->start);
+	e->duration = 0;
+
+	prof_frame->numevents++;
+
+	return (prof_numevents++) & (PROF_EVENTS - 1);
+}
+
+void
+Prof_End(int handle)
+{
+	profevent_t *e;
+
+	if ((handle < 0) || !prof_frame)
+	{
+		return;
+	}
+
+	e = &prof_events[handle];
+	e->duration = (int)(Sys_Microseconds() - prof_frame->start) - e->start;
+	prof_depth--;
+
+	if (!e->depth)
+	{
+		prof_frame->busy += e->duration;
+	}
+
+	prof_totalcalls[e->name]++;
+	prof_total[e->name] += e->duration;
+
+	if (e->duration > prof_totalmax[e->name])
+	{
+		prof_totalmax[e->name] = e->duration;
+	}
+}
+
+/*
+ * Adds the time since start, taken with
+ * PROF_START(), to a per frame counter.
+ */
+void
+Prof_Accumulate(profcounter_t counter, long long start)
+{
+	/* the game may trace from other threads,
+	   only the frame's own thread is counted */
+	if (!prof_frame || !start || !prof_framethread)
+	{
+		return;
+	}
+
+	prof_frame->counters[counter] += (int)(Sys_Microseconds() - start);
+	prof_frame->calls[counter]++;
+}
+
+void
+Prof_BeginFrame(void)
+{
+	prof_framethread = true;
+
+	if (prof->modified)
+	{
+		prof->modified = false;
+		prof_active = prof->value != 0;
+
+		if (prof_active && !prof_events)
+		{
+			prof_events = Z_Malloc(PROF_EVENTS * sizeof(profevent_t));
+		}
+
+		prof_frame = NULL;
+		prof_numframes = 0;
+		prof_numevents = 0;
+	}
+
+	if (!prof_active || prof_frame)
+	{
+		return;
+	}
+
+	prof_frame = &prof_frames[prof_numframes % PROF_FRAMES];
+	memset(prof_frame, 0, sizeof(*prof_frame));
+
+	prof_frame->start = Sys_Microseconds();
+	prof_frame->firstevent = prof_numevents;
+	prof_depth = 0;
+}
+
+void
+Prof_EndFrame(void)
+{
+	profframe_t *frame;
+	int i;
+
+	if (!prof_frame)
+	{
+		return;
+	}
+
+	frame = prof_frame;
+	frame->duration = (int)(Sys_Microseconds() - frame->start);
+
+	prof_frame = NULL;
+	prof_numframes++;
+
+	for (i = 0; i < PROF_NUMCOUNTERS; i++)
+	{
+		prof_totalccalls[i] += frame->calls[i];
+		prof_totalctime[i] += frame->counters[i];
+	}
+
+	prof_totalframes++;
+
+	/* keep the spike in the buffer */
+	if ((prof_trigger->value > 0) && (frame->busy >= prof_trigger->value * 1000))
+	{
+		Com_Printf("Profiling stopped, frame took %.2f ms. Use prof_dump "
+				"or prof_hist.\n", frame->busy / 1000.0f);
+
+		prof_active = false;
+		Cvar_Set("prof", "0");
+		prof->modified = false;
+	}
+}
+
+/*
+ * Returns the index of the oldest frame whose
+ * events haven't been overwritten yet.
+ */
+static unsigned
+Prof_FirstFrame(void)
+{
+	unsigned i;
+
+	i = (prof_numframes > PROF_FRAMES) ? prof_numframes - PROF_FRAMES : 0;
+
+	while ((i < prof_numframes) &&
+		(prof_numevents - prof_frames[i % PROF_FRAMES].firstevent > PROF_EVENTS))
+	{
+		i++;
+	}
+
+	return i;
+}
+
+static void
+Prof_WriteName(FILE *f, const char *name)
+{
+	fputc('"', f);
+
+	for ( ; *name; name++)
+	{
+		if ((*name == '"') || (*name == '\\'))
+		{
+			fputc('\\', f);
+		}
+
+		if ((unsigned char)*name >= ' ')
+		{
+			fputc(*name, f);
+		}
+	}
+
+	fputc('"', f);
+}
+
+/*
+ * prof_dump [name]
+ * Writes the recorded frames as Chrome trace
+ */
+static void
+Prof_Dump_f(void)
+{
+	char name[MAX_OSPATH];
+	profframe_t *frame;
+	profevent_t *e;
+	long long base;
+	unsigned i, first;
+	qboolean comma;
+	FILE *f;
+	int j, c;
+
+	if (!prof_numframes)
+	{
+		Com_Printf("No frames recorded, set prof to 1.\n");
+		return;
+	}
+
+	Com_sprintf(name, sizeof(name), "%s/%s.json", FS_Gamedir(),
+			(Cmd_Argc() > 1) ? Cmd_Argv(1) : "profile");
+
+	if (strstr(Cmd_Argv(1), ".."))
+	{
+		Com_Printf("Illegal filename.\n");
+		return;
+	}
+
+	f = Q_fopen(name, "w");
+
+	if (!f)
+	{
+		Com_Printf("Couldn't open %s.\n", name);
+		return;
+	}
+
+	first = Prof_FirstFrame();
+	base = prof_frames[first % PROF_FRAMES].start;
+	comma = false;
+
+	fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	for (i = first; i < prof_numframes; i++)
+	{
+		frame = &prof_frames[i % PROF_FRAMES];
+
+		for (j = 0; j < frame->numevents; j++)
+		{
+			e = &prof_events[(frame->firstevent + j) & (PROF_EVENTS - 1)];
+
+			fprintf(f, "%s{\"name\":", comma ? ",\n" : "");
+			Prof_WriteName(f, prof_names[e->name]);
+			fprintf(f, ",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%lld,\"dur\":%i}",
+					frame->start - base + e->start, e->duration);
+			comma = true;
+		}
+
+		for (c = 0; c < PROF_NUMCOUNTERS; c++)
+		{
+			fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"ts\":%lld,"
+					"\"args\":{\"usec\":%i,\"calls\":%i}}", comma ? ",\n" : "",
+					prof_counternames[c], frame->start - base + frame->duration,
+					frame->counters[c], frame->calls[c]);
+			comma = true;
+		}
+	}
+
+	fprintf(f, "\n]}\n");
+	fclose(f);
+
+	Com_Printf("Wrote %u frames to %s.\n", prof_numframes - first, name);
+}
+
+/*
+ * Prints a table of zones sorted by their
+ * total time, followed by the counters
+ */
+static void
+Prof_PrintZones(const int *calls, const long long *total, const int *max,
+		const int *ccalls, const long long *ctotal, int frames)
+{
+	static short order[PROF_MAXNAMES];
+	int j, k, n;
+	short tmp;
+
+	/* sort by total time, the list is short */
+	for (j = 0, n = 0; j < prof_numnames; j++)
+	{
+		if (calls[j])
+		{
+			order[n++] = j;
+		}
+	}
+
+	for (j = 1; j < n; j++)
+	{
+		for (k = j; (k > 0) && (total[order[k]] > total[order[k - 1]]); k--)
+		{
+			tmp = order[k];
+			order[k] = order[k - 1];
+			order[k - 1] = tmp;
+		}
+	}
+
+	Com_Printf("zone                          calls  ms/frame   avg us   max us\n");
+
+	for (j = 0; j < prof_numnames && calls[order[j]] && j < 40; j++)
+	{
+		k = order[j];
+
+		Com_Printf("%-28.28s %6i %9.3f %8i %8i\n", prof_names[k], calls[k],
+				total[k] / 1000.0f / frames, (int)(total[k] / calls[k]), max[k]);
+	}
+
+	for (j = 0; j < PROF_NUMCOUNTERS; j++)
+	{
+		Com_Printf("%-28.28s %6i %9.3f %8i\n", prof_counternames[j], ccalls[j],
+				ctotal[j] / 1000.0f / frames, ccalls[j] ? (int)(ctotal[j] / ccalls[j]) : 0);
+	}
+}
+
+/*
+ * Prints the time spent in each zone
+ * over all recorded frames
+ */
+static void
+Prof_Hist_f(void)
+{
+	static int calls[PROF_MAXNAMES];
+	static long long total[PROF_MAXNAMES];
+	static int max[PROF_MAXNAMES];
+	static const int limits[PROF_NUMBUCKETS] = {1, 2, 5, 10, 20, 50};
+	int buckets[PROF_NUMBUCKETS + 1];
+	long long ctotal[PROF_NUMCOUNTERS];
+	int ccalls[PROF_NUMCOUNTERS];
+	profframe_t *frame;
+	profevent_t *e;
+	unsigned i, first;
+	int j, k, n, maxbusy;
+
+	if (!prof_numframes)
+	{
+		Com_Printf("No frames recorded, set prof to 1.\n");
+		return;
+	}
+
+	memset(calls, 0, sizeof(calls));
+	memset(total, 0, sizeof(total));
+	memset(max, 0, sizeof(max));
+	memset(buckets, 0, sizeof(buckets));
+	memset(ctotal, 0, sizeof(ctotal));
+	memset(ccalls, 0, sizeof(ccalls));
+	maxbusy = 0;
+
+	first = Prof_FirstFrame();
+
+	for (i = first; i < prof_numframes; i++)
+	{
+		frame = &prof_frames[i % PROF_FRAMES];
+
+		for (j = 0; j < frame->numevents; j++)
+		{
+			e = &prof_events[(frame->firstevent + j) & (PROF_EVENTS - 1)];
+
+			calls[e->name]++;
+			total[e->name] += e->duration;
+
+			if (e->duration > max[e->name])
+			{
+				max[e->name] = e->duration;
+			}
+		}
+
+		for (j = 0; j < PROF_NUMCOUNTERS; j++)
+		{
+			ctotal[j] += frame->counters[j];
+			ccalls[j] += frame->calls[j];
+		}
+
+		for (k = 0; k < PROF_NUMBUCKETS; k++)
+		{
+			if (frame->busy < limits[k] * 1000)
+			{
+				break;
+			}
+		}
+
+		buckets[k]++;
+
+		if (frame->busy > maxbusy)
+		{
+			maxbusy = frame->busy;
+		}
+	}
+
+	n = prof_numframes - first;
+
+	Com_Printf("%i frames, slowest %.2f ms\n", n, maxbusy / 1000.0f);
+	Prof_PrintZones(calls, total, max, ccalls, ctotal, n);
+
+	Com_Printf("frame times:");
+
+	for (k = 0; k < PROF_NUMBUCKETS; k++)
+	{
+		Com_Printf(" <%ims: %i", limits[k], buckets[k]);
+	}
+
+	Com_Printf(" more: %i\n", buckets[k]);
+}
+
+/*
+ * Starts summing up zones over all
+ * following frames, see Prof_PrintTotals()
+ */
+void
+Prof_ClearTotals(void)
+{
+	memset(prof_totalcalls, 0, sizeof(prof_totalcalls));
+	memset(prof_total, 0, sizeof(prof_total));
+	memset(prof_totalmax, 0, sizeof(prof_totalmax));
+	memset(prof_totalccalls, 0, sizeof(prof_totalccalls));
+	memset(prof_totalctime, 0, sizeof(prof_totalctime));
+	prof_totalframes = 0;
+}
+
+/*
+ * Prints the time spent in each zone
+ * since the last Prof_ClearTotals()
+ */
+void
+Prof_PrintTotals(void)
+{
+	if (!prof_totalframes)
+	{
+		Com_Printf("No frames recorded, set prof to 1.\n");
+		return;
+	}
+
+	Prof_PrintZones(prof_totalcalls, prof_total, prof_totalmax,
+			prof_totalccalls, prof_totalctime, prof_totalframes);
+}
+
+void
+Prof_Init(void)
+{
+	prof = Cvar_Get("prof", "0", 0);
+	prof_trigger = Cvar_Get("prof_trigger", "0", 0);
+
+	/* pick up prof set on the command line */
+	prof->modified = true;
+
+	Cmd_AddCommand("prof_dump", Prof_Dump_f);
+	Cmd_AddCommand("prof_hist", Prof_Hist_f);
+}
@@ -74,13 +74,40 @@ crandk(void)
 }
 
 /*
- * Seeds the PRNG
+ * Mixes a value into the state, so processes
+ * started from the same state produce
+ * different sequences.
+ */
+void
+randk_mix(unsigned int value)
+{
+	uint64_t i;
+
+	cng ^= value * 0x9e3779b97f4a7c15ULL;
+	xs ^= ((uint64_t)value << 32) | value | 1;
+
+	for (i = 0; i < 256; i++)
+	{
+		randk();
+	}
+}
+
+/*
+ * Seeds the PRNG. The state is reset
+ * first, so every call starts the same
+ * sequence. The server benchmark needs
+ * that when the game is loaded again.
  */
 void
 randk_seed(void)
 {
 	uint64_t i;
 
+	j = 0;
+	carry = 0;
+	xs = 0;
+	cng = 0;
+
 	/* Seed QARY[] with CNG+XS: */
 	for (i = 0; i < QSIZE; i++)
 	{
@@ -66,6 +66,7 @@ SZ_GetSpace(sizebuf_t *buf, int length)
 
 	data = buf->data + buf->cursize;
 	buf->cursize += length;
+	buf->bitpos = 0;
 
 	return data;
 }
@@ -33,6 +33,31 @@ qboolean enemy_infront;
 int enemy_range;
 float enemy_yaw;
 
+/*
+ * Line of sight results of the current
+ * frame. Several AI routines ask if the
+ * same monster sees the same player in
+ * one frame, the trace is done once.
+ * Entries are valid while their generation
+ * is the current one, it's bumped each
+ * frame and whenever a brush model moves.
+ */
+#define SIGHT_CACHE_SIZE 1024
+
+typedef struct
+{
+	int generation;
+	qboolean visible;
+	edict_t *self;
+	edict_t *other;
+	vec3_t spot1;
+	vec3_t spot2;
+} sightcache_t;
+
+static sightcache_t sightcache[SIGHT_CACHE_SIZE];
+static int sightcache_frame = -1;
+static int sightcache_generation = 1;
+
 qboolean FindTarget(edict_t *self);
 qboolean ai_checkattack(edict_t *self);
 
@@ -88,6 +113,19 @@ AI_SetSightClient(void)
 	}
 }
 
+/*
+ * Forgets all cached line of sight
+ * results. Called when a level is
+ * spawned or loaded and when a door
+ * or another brush model is linked
+ * or unlinked, it may block the sight.
+ */
+void
+AI_ClearSightCache(void)
+{
+	sightcache_generation++;
+}
+
 /*
  * Move the specified distance at current facing.
  */
@@ -341,6 +379,7 @@ visible(edict_t *self, edict_t *other)
 	vec3_t spot1;
 	vec3_t spot2;
 	trace_t trace;
+	sightcache_t *cache;
 
 	if (!self || !other)
 	{
@@ -351,14 +390,41 @@ visible(edict_t *self, edict_t *other)
 	spot1[2] += self->viewheight;
 	VectorCopy(other->s.origin, spot2);
 	spot2[2] += other->viewheight;
-	trace = gi.trace(spot1, vec3_origin, vec3_origin, spot2, self, MASK_OPAQUE);
 
-	if (trace.fraction == 1.0)
+	if (sightcache_frame != level.framenum)
 	{
-		return true;
+		sightcache_generation++;
+		sightcache_frame = level.framenum;
 	}
 
-	return false;
+	cache = &sightcache[((self - g_edicts) * 31 + (other - g_edicts)) &
+		(SIGHT_CACHE_SIZE - 1)];
+
+	if ((cache->generation == sightcache_generation) &&
+		(cache->self == self) && (cache->other == other) &&
+		VectorCompare(cache->spot1, spot1) && VectorCompare(cache->spot2, spot2))
+	{
+		return cache->visible;
+	}
+
+	cache->generation = sightcache_generation;
+	cache->self = self;
+	cache->other = other;
+	VectorCopy(spot1, cache->spot1);
+	VectorCopy(spot2, cache->spot2);
+
+	/* the PVS is conservative, nothing
+	   outside of it can be seen */
+	if (!gi.inPVS(spot1, spot2))
+	{
+		cache->visible = false;
+		return false;
+	}
+
+	trace = gi.trace(spot1, vec3_origin, vec3_origin, spot2, self, MASK_OPAQUE);
+	cache->visible = (trace.fraction == 1.0);
+
+	return cache->visible;
 }
 
 /*
@@ -474,7 +540,7 @@ FoundTarget(edict_t *self)
 	self->monsterinfo.aiflags |= AI_COMBAT_POINT;
 
 	/* clear the targetname, that point is ours! */
-	self->movetarget->targetname = NULL;
+	G_SetTargetname(self->movetarget, NULL);
 	self->monsterinfo.pausetime = 0;
 
 	/* run for it */
@@ -617,11 +683,8 @@ FindTarget(edict_t *self)
 			return false;
 		}
 
-		if (!visible(self, client))
-		{
-			return false;
-		}
-
+		/* the cheap checks first, the
+		   trace is done last */
 		if (r == RANGE_NEAR)
 		{
 			if ((client->show_hostile < level.time) && !infront(self, client))
@@ -637,6 +700,11 @@ FindTarget(edict_t *self)
 			}
 		}
 
+		if (!visible(self, client))
+		{
+			return false;
+		}
+
 		self->enemy = client;
 
 		if (strcmp(self->enemy->classname, "player_noise") != 0)
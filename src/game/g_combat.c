@@ -528,6 +528,9 @@ T_Damage(edict_t *targ, edict_t *inflictor, edict_t *attacker,
 		return;
 	}
 
+	/* pain and die may need a think */
+	G_WakeEdict(targ);
+
 	/* friendly fire avoidance if enabled you
 	   can't hurt teammates (but you can hurt
 	   yourself) knockback still occurs */
@@ -87,6 +87,11 @@ cvar_t *gib_on;
 
 cvar_t *aimfix;
 cvar_t *g_machinegun_norecoil;
+cvar_t *g_entitycache;
+cvar_t *g_monsternav;
+cvar_t *g_thinkqueue;
+cvar_t *g_radiuscheck;
+cvar_t *g_threads;
 
 void SpawnEntities(char *mapname, char *entities, char *spawnpoint);
 void ClientThink(edict_t *ent, usercmd_t *cmd);
@@ -100,6 +105,7 @@ void WriteGame(char *filename, qboolean autosave);
 void ReadGame(char *filename);
 void WriteLevel(char *filename);
 void ReadLevel(char *filename);
+void FreeLevelBuffer(void);
 void InitGame(void);
 void G_RunFrame(void);
 
@@ -110,6 +116,10 @@ ShutdownGame(void)
 {
 	gi.dprintf("==== ShutdownGame ====\n");
 
+	G_ShutdownThreads();
+	FreeLevelBuffer();
+	ED_FreeEntityCache();
+
 	gi.FreeTags(TAG_LEVEL);
 	gi.FreeTags(TAG_GAME);
 }
@@ -220,7 +230,7 @@ CreateTargetChangeLevel(char *map)
 	}
 
 	ent = G_Spawn();
-	ent->classname = "target_changelevel";
+	G_SetClassname(ent, "target_changelevel");
 	Com_sprintf(level.nextmap, sizeof(level.nextmap), "%s", map);
 	ent->map = level.nextmap;
 	return ent;
@@ -434,6 +444,9 @@ G_RunFrame(void)
 	/* choose a client for monsters to target this frame */
 	AI_SetSightClient();
 
+	/* sample more of the navigation graph */
+	Nav_RunFrame();
+
 	/* exit intermissions */
 	if (level.exitintermission)
 	{
@@ -441,15 +454,25 @@ G_RunFrame(void)
 		return;
 	}
 
-	/* treat each object in turn
-	   even the world gets a chance
-	   to think */
-	ent = &g_edicts[0];
+	/* wake up the sleeping entities
+	   that have to think this frame */
+	G_WakeDueEdicts();
+
+	/* trace the moves of tossed and
+	   flying entities in parallel */
+	G_RunPretraces();
 
-	for (i = 0; i < globals.num_edicts; i++, ent++)
+	/* treat each awake object in
+	   turn, even the world gets a
+	   chance to think */
+	for (i = G_NextAwakeEdict(0); i < globals.num_edicts;
+		 i = G_NextAwakeEdict(i + 1))
 	{
+		ent = &g_edicts[i];
+
 		if (!ent->inuse)
 		{
+			G_SleepEdict(ent);
 			continue;
 		}
 
@@ -477,6 +500,8 @@ G_RunFrame(void)
 		}
 
 		G_RunEntity(ent);
+
+		G_SleepEdict(ent);
 	}
 
 	/* see if it is time to end a deathmatch */
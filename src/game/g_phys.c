@@ -140,6 +140,304 @@ SV_RunThink(edict_t *ent)
 	return false;
 }
 
+/*
+ * The think queue. Most entities without physics, like
+ * triggers, targets and lights, sleep most of the time.
+ * Those with MOVETYPE_NONE are taken out of the frame
+ * loop when they have nothing to do. A sleeping entity
+ * whose nextthink is set waits in a heap ordered by that
+ * time and is woken when it's due.
+ *
+ * Other entities can change a sleeping one through its
+ * use, touch, pain and die functions, or by linking it.
+ * All callers of these wake it up first. Waking an
+ * entity that doesn't need it is harmless, it just goes
+ * back to sleep after its next run, so the heap isn't
+ * cleaned up when an entity is woken early.
+ */
+typedef struct
+{
+	float time;
+	int entnum;
+} thinkslot_t;
+
+static unsigned *think_awake;       /* one bit per entity */
+static thinkslot_t *think_heap;
+static int think_heapsize;
+static int think_heapmax;
+static qboolean think_sleeping;     /* anybody asleep */
+static void (*think_linkentity)(edict_t *ent);
+static void (*think_unlinkentity)(edict_t *ent);
+
+/*
+ * Doors and other brush models block the
+ * sight of monsters wherever they move.
+ */
+static qboolean
+G_BlocksSight(edict_t *ent)
+{
+	return (ent->solid == SOLID_BSP) || (ent->movetype == MOVETYPE_PUSH);
+}
+
+static void
+G_LinkEntity(edict_t *ent)
+{
+	G_WakeEdict(ent);
+	think_linkentity(ent);
+	G_RefileEdict(ent);
+
+	if (G_BlocksSight(ent))
+	{
+		AI_ClearSightCache();
+	}
+}
+
+static void
+G_UnlinkEntity(edict_t *ent)
+{
+	think_unlinkentity(ent);
+
+	if (G_BlocksSight(ent))
+	{
+		AI_ClearSightCache();
+	}
+}
+
+/*
+ * Allocates the think queue, must be called
+ * whenever g_edicts is allocated.
+ */
+void
+G_InitThinkQueue(void)
+{
+	think_awake = gi.TagMalloc(((game.maxentities + 31) / 32) *
+			sizeof(unsigned), TAG_GAME);
+	think_heapmax = game.maxentities * 2;
+	think_heap = gi.TagMalloc(think_heapmax * sizeof(thinkslot_t), TAG_GAME);
+
+	/* linking an entity wakes it up, refiles it for
+	   findradius() and may change the line of sight */
+	if (gi.linkentity != G_LinkEntity)
+	{
+		think_linkentity = gi.linkentity;
+		gi.linkentity = G_LinkEntity;
+	}
+
+	if (gi.unlinkentity != G_UnlinkEntity)
+	{
+		think_unlinkentity = gi.unlinkentity;
+		gi.unlinkentity = G_UnlinkEntity;
+	}
+
+	G_ClearThinkQueue();
+}
+
+/*
+ * Wakes up all entities, used when
+ * all entities are wiped.
+ */
+void
+G_ClearThinkQueue(void)
+{
+	memset(think_awake, 0xff, ((game.maxentities + 31) / 32) * sizeof(unsigned));
+	think_heapsize = 0;
+	think_sleeping = false;
+}
+
+void
+G_WakeEdict(edict_t *ent)
+{
+	int i;
+
+	if (!ent)
+	{
+		return;
+	}
+
+	i = ent - g_edicts;
+
+	if ((i >= 0) && (i < game.maxentities))
+	{
+		think_awake[i >> 5] |= 1u << (i & 31);
+	}
+}
+
+static qboolean
+G_PushThink(edict_t *ent)
+{
+	thinkslot_t slot;
+	int i, parent;
+
+	if (think_heapsize == think_heapmax)
+	{
+		return false;
+	}
+
+	slot.time = ent->nextthink;
+	slot.entnum = ent - g_edicts;
+
+	for (i = think_heapsize++; i > 0; i = parent)
+	{
+		parent = (i - 1) / 2;
+
+		if (think_heap[parent].time <= slot.time)
+		{
+			break;
+		}
+
+		think_heap[i] = think_heap[parent];
+	}
+
+	think_heap[i] = slot;
+
+	return true;
+}
+
+static void
+G_PopThink(void)
+{
+	thinkslot_t last;
+	int i, child;
+
+	last = think_heap[--think_heapsize];
+
+	for (i = 0; (child = i * 2 + 1) < think_heapsize; i = child)
+	{
+		if ((child + 1 < think_heapsize) &&
+			(think_heap[child + 1].time < think_heap[child].time))
+		{
+			child++;
+		}
+
+		if (think_heap[child].time >= last.time)
+		{
+			break;
+		}
+
+		think_heap[i] = think_heap[child];
+	}
+
+	think_heap[i] = last;
+}
+
+/*
+ * Wakes up all entities whose think is due
+ * this frame. Must be called before the
+ * frame loop.
+ */
+void
+G_WakeDueEdicts(void)
+{
+	/* g_thinkqueue was turned off */
+	if (!g_thinkqueue->value && think_sleeping)
+	{
+		G_ClearThinkQueue();
+		return;
+	}
+
+	/* the same test as in SV_RunThink() */
+	while (think_heapsize && (think_heap[0].time <= level.time + 0.001))
+	{
+		think_awake[think_heap[0].entnum >> 5] |= 1u << (think_heap[0].entnum & 31);
+		G_PopThink();
+	}
+}
+
+/*
+ * Returns the first awake entity starting
+ * at i or globals.num_edicts if there's none.
+ */
+int
+G_NextAwakeEdict(int i)
+{
+	unsigned bits;
+
+	while (i < globals.num_edicts)
+	{
+		bits = think_awake[i >> 5] >> (i & 31);
+
+		if (!bits)
+		{
+			i = (i | 31) + 1;
+			continue;
+		}
+
+		while (!(bits & 1))
+		{
+			bits >>= 1;
+			i++;
+		}
+
+		return i;
+	}
+
+	return globals.num_edicts;
+}
+
+/*
+ * Puts an entity to sleep after it was run
+ * if the next frames would be a no-op for
+ * it until its nextthink.
+ */
+void
+G_SleepEdict(edict_t *ent)
+{
+	int i;
+
+	if (!g_thinkqueue->value)
+	{
+		return;
+	}
+
+	i = ent - g_edicts;
+
+	/* the world and the clients are always run */
+	if (i <= game.maxclients)
+	{
+		return;
+	}
+
+	if (ent->inuse)
+	{
+		if ((ent->movetype != MOVETYPE_NONE) || ent->prethink ||
+			ent->groundentity || ent->client ||
+			!VectorCompare(ent->s.origin, ent->s.old_origin))
+		{
+			return;
+		}
+
+		if (ent->nextthink > 0)
+		{
+			if ((ent->nextthink <= level.time + 0.001) || !G_PushThink(ent))
+			{
+				return;
+			}
+		}
+	}
+
+	think_awake[i >> 5] &= ~(1u << (i & 31));
+	think_sleeping = true;
+}
+
+/*
+ * Returns how many entities in use are asleep.
+ */
+int
+G_SleepingEdicts(void)
+{
+	int i, count;
+
+	for (i = game.maxclients + 1, count = 0; i < globals.num_edicts; i++)
+	{
+		if (g_edicts[i].inuse && !(think_awake[i >> 5] & (1u << (i & 31))))
+		{
+			count++;
+		}
+	}
+
+	return count;
+}
+
 /*
  * Two entities have touched, so
  * run their touch functions
@@ -156,6 +454,9 @@ SV_Impact(edict_t *e1, trace_t *trace)
 
 	e2 = trace->ent;
 
+	G_WakeEdict(e1);
+	G_WakeEdict(e2);
+
 	if (e1->touch && (e1->solid != SOLID_NOT))
 	{
 		e1->touch(e1, e2, &trace->plane, trace->surface);
@@ -524,7 +825,11 @@ retry:
 		mask = MASK_SOLID;
 	}
 
-	trace = gi.trace(start, ent->mins, ent->maxs, end, ent, mask);
+	/* the move may have been traced by the game threads */
+	if (!G_Pretraced(ent, start, end, mask, &trace))
+	{
+		trace = gi.trace(start, ent->mins, ent->maxs, end, ent, mask);
+	}
 
 	if (trace.startsolid || trace.allsolid)
 	{
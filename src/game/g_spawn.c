@@ -271,185 +271,405 @@ spawn_t spawns[] = {
 };
 
 /*
- * Finds the spawn function for
- * the entity and calls it
+ * Hash tables over the spawn functions,
+ * the item classnames and the fields
+ * that can be set from the entity
+ * string. Built once by InitGame().
  */
+#define SPAWN_HASH_SIZE 1024
+
+typedef struct
+{
+	const char *name;
+	void (*spawn)(edict_t *ent);
+	gitem_t *item;
+} spawnslot_t;
+
+static spawnslot_t spawnslots[SPAWN_HASH_SIZE];
+static field_t *fieldslots[SPAWN_HASH_SIZE];
+
+static unsigned
+ED_HashName(const char *name, qboolean nocase)
+{
+	unsigned hash = 5381;
+	int c;
+
+	while ((c = (unsigned char)*name++) != 0)
+	{
+		if (nocase && (c >= 'A') && (c <= 'Z'))
+		{
+			c += 'a' - 'A';
+		}
+
+		hash = hash * 33 + c;
+	}
+
+	return hash & (SPAWN_HASH_SIZE - 1);
+}
+
+static void
+ED_AddSpawn(const char *name, void (*spawn)(edict_t *ent), gitem_t *item)
+{
+	unsigned h;
+
+	/* the first entry wins, like the
+	   linear search did: items before
+	   the normal spawn functions */
+	for (h = ED_HashName(name, false); spawnslots[h].name;
+		 h = (h + 1) & (SPAWN_HASH_SIZE - 1))
+	{
+		if (!strcmp(spawnslots[h].name, name))
+		{
+			return;
+		}
+	}
+
+	spawnslots[h].name = name;
+	spawnslots[h].spawn = spawn;
+	spawnslots[h].item = item;
+}
+
 void
-ED_CallSpawn(edict_t *ent)
+ED_InitSpawnTables(void)
 {
 	spawn_t *s;
-	gitem_t *item;
+	field_t *f;
+	unsigned h;
 	int i;
 
-	if (!ent)
+	memset(spawnslots, 0, sizeof(spawnslots));
+	memset(fieldslots, 0, sizeof(fieldslots));
+
+	for (i = 0; i < game.num_items; i++)
 	{
-		return;
+		if (itemlist[i].classname)
+		{
+			ED_AddSpawn(itemlist[i].classname, NULL, &itemlist[i]);
+		}
 	}
 
-	if (!ent->classname)
+	for (s = spawns; s->name; s++)
 	{
-		gi.dprintf("ED_CallSpawn: NULL classname\n");
-		G_FreeEdict(ent);
-		return;
+		ED_AddSpawn(s->name, s->spawn, NULL);
 	}
 
-	/* check item spawn functions */
-	for (i = 0, item = itemlist; i < game.num_items; i++, item++)
+	for (f = fields; f->name; f++)
 	{
-		if (!item->classname)
+		if (f->flags & FFL_NOSPAWN)
 		{
 			continue;
 		}
 
-		if (!strcmp(item->classname, ent->classname))
+		for (h = ED_HashName(f->name, true); fieldslots[h];
+			 h = (h + 1) & (SPAWN_HASH_SIZE - 1))
 		{
-			/* found it */
-			SpawnItem(ent, item);
-			return;
+			if (!Q_strcasecmp(fieldslots[h]->name, f->name))
+			{
+				break;
+			}
+		}
+
+		if (!fieldslots[h])
+		{
+			fieldslots[h] = f;
 		}
 	}
+}
 
-	/* check normal spawn functions */
-	for (s = spawns; s->name; s++)
+static field_t *
+ED_FindField(const char *key)
+{
+	unsigned h;
+
+	for (h = ED_HashName(key, true); fieldslots[h];
+		 h = (h + 1) & (SPAWN_HASH_SIZE - 1))
 	{
-		if (!strcmp(s->name, ent->classname))
+		if (!Q_strcasecmp(fieldslots[h]->name, (char *)key))
 		{
-			/* found it */
-			s->spawn(ent);
-			return;
+			return fieldslots[h];
 		}
 	}
 
-	gi.dprintf("%s doesn't have a spawn function\n", ent->classname);
+	return NULL;
 }
 
-char *
-ED_NewString(const char *string)
+/*
+ * Finds the spawn function for
+ * the entity and calls it
+ */
+void
+ED_CallSpawn(edict_t *ent)
 {
-	char *newb, *new_p;
-	int i, l;
+	unsigned h;
 
-	if (!string)
+	if (!ent)
 	{
-		return NULL;
+		return;
 	}
 
-	l = strlen(string) + 1;
+	if (!ent->classname)
+	{
+		gi.dprintf("ED_CallSpawn: NULL classname\n");
+		G_FreeEdict(ent);
+		return;
+	}
+
+	for (h = ED_HashName(ent->classname, false); spawnslots[h].name;
+		 h = (h + 1) & (SPAWN_HASH_SIZE - 1))
+	{
+		if (!strcmp(spawnslots[h].name, ent->classname))
+		{
+			/* found it */
+			if (spawnslots[h].item)
+			{
+				SpawnItem(ent, spawnslots[h].item);
+			}
+			else
+			{
+				spawnslots[h].spawn(ent);
+			}
 
-	newb = gi.TagMalloc(l, TAG_LEVEL);
+			return;
+		}
+	}
 
-	new_p = newb;
+	gi.dprintf("%s doesn't have a spawn function\n", ent->classname);
+}
+
+/*
+ * Copies a string, replacing "\n"
+ * with a newline. Returns the length
+ * of the copy including the trailing
+ * zero. out may be NULL.
+ */
+static int
+ED_Unescape(const char *string, char *out)
+{
+	int i, l, len;
+
+	l = strlen(string) + 1;
+	len = 0;
 
 	for (i = 0; i < l; i++)
 	{
-		if ((string[i] == '\\') && (i < l - 1))
+		if ((string[i] == '\\') && (i < l - 2))
 		{
 			i++;
 
-			if (string[i] == 'n')
+			if (out)
 			{
-				*new_p++ = '\n';
-			}
-			else
-			{
-				*new_p++ = '\\';
+				out[len] = (string[i] == 'n') ? '\n' : '\\';
 			}
 		}
-		else
+		else if (out)
 		{
-			*new_p++ = string[i];
+			out[len] = string[i];
 		}
+
+		len++;
+	}
+
+	return len;
+}
+
+char *
+ED_NewString(const char *string)
+{
+	char *newb;
+
+	if (!string)
+	{
+		return NULL;
 	}
 
+	newb = gi.TagMalloc(strlen(string) + 1, TAG_LEVEL);
+	ED_Unescape(string, newb);
+
 	return newb;
 }
 
+/* =================================================================== */
+
 /*
- * Takes a key/value pair and sets
- * the binary values in an edict
+ * The entity string of a map is parsed into
+ * a list of entities with their fields already
+ * looked up and their values converted. With
+ * g_entitycache set the last lists are kept
+ * and a map that is loaded again spawns from
+ * its list without parsing the string.
  */
-void
-ED_ParseField(const char *key, const char *value, edict_t *ent)
+#define MAX_ENTITYCACHE 16
+
+typedef struct
 {
-	field_t *f;
-	byte *b;
-	float v;
-	vec3_t vec;
+	field_t *field;     /* NULL if the key isn't a field */
+	int string;         /* offset into the string pool */
+	int ivalue;
+	vec3_t fvalue;
+} entpair_t;
+
+typedef struct
+{
+	int firstpair;
+	int numpairs;
+	qboolean init;
+} entdef_t;
+
+typedef struct
+{
+	char mapname[MAX_QPATH];
+	unsigned long long checksum;
+	int length;
+	int lastused;
+
+	entdef_t *defs;
+	int numdefs;
+	int maxdefs;
+
+	entpair_t *pairs;
+	int numpairs;
+	int maxpairs;
 
-	if (!key || !value)
+	char *strings;
+	int stringsize;
+	int maxstrings;
+} entlist_t;
+
+static entlist_t *entitycache[MAX_ENTITYCACHE];
+static int entitycache_sequence;
+
+static void *
+ED_Grow(void *data, int *max, int count, size_t size)
+{
+	int newmax;
+
+	if (count <= *max)
 	{
-		return;
+		return data;
 	}
 
-	for (f = fields; f->name; f++)
+	newmax = *max ? *max : 64;
+
+	while (newmax < count)
 	{
-		if (!(f->flags & FFL_NOSPAWN) && !Q_strcasecmp(f->name, (char *)key))
-		{
-			/* found it */
-			if (f->flags & FFL_SPAWNTEMP)
-			{
-				b = (byte *)&st;
-			}
-			else
-			{
-				b = (byte *)ent;
-			}
+		newmax *= 2;
+	}
 
-			switch (f->type)
-			{
-				case F_LSTRING:
-					*(char **)(b + f->ofs) = ED_NewString(value);
-					break;
-				case F_VECTOR:
-					sscanf(value, "%f %f %f", &vec[0], &vec[1], &vec[2]);
-					((float *)(b + f->ofs))[0] = vec[0];
-					((float *)(b + f->ofs))[1] = vec[1];
-					((float *)(b + f->ofs))[2] = vec[2];
-					break;
-				case F_INT:
-					*(int *)(b + f->ofs) = (int)strtol(value, (char **)NULL, 10);
-					break;
-				case F_FLOAT:
-					*(float *)(b + f->ofs) = (float)strtod(value, (char **)NULL);
-					break;
-				case F_ANGLEHACK:
-					v = (float)strtod(value, (char **)NULL);
-					((float *)(b + f->ofs))[0] = 0;
-					((float *)(b + f->ofs))[1] = v;
-					((float *)(b + f->ofs))[2] = 0;
-					break;
-				case F_IGNORE:
-					break;
-				default:
-					break;
-			}
+	data = realloc(data, newmax * size);
 
-			return;
-		}
+	if (!data)
+	{
+		gi.error("ED_Grow: couldn't allocate %i bytes", (int)(newmax * size));
 	}
 
-	gi.dprintf("%s is not a field\n", key);
+	*max = newmax;
+
+	return data;
+}
+
+static void
+ED_FreeEntityList(entlist_t *list)
+{
+	free(list->defs);
+	free(list->pairs);
+	free(list->strings);
+	free(list);
+}
+
+static int
+ED_AddString(entlist_t *list, const char *string, qboolean unescape)
+{
+	int ofs, len;
+
+	len = unescape ? ED_Unescape(string, NULL) : strlen(string) + 1;
+	list->strings = ED_Grow(list->strings, &list->maxstrings,
+			list->stringsize + len, 1);
+
+	ofs = list->stringsize;
+
+	if (unescape)
+	{
+		ED_Unescape(string, list->strings + ofs);
+	}
+	else
+	{
+		memcpy(list->strings + ofs, string, len);
+	}
+
+	list->stringsize += len;
+
+	return ofs;
 }
 
 /*
- * Parses an edict out of the given string,
- * returning the new position ed should be
- * a properly initialized empty edict.
+ * Takes a key/value pair, looks
+ * up the field and converts the
+ * value into its binary form
  */
-char *
-ED_ParseEdict(char *data, edict_t *ent)
+static void
+ED_ParseField(entlist_t *list, const char *key, const char *value)
 {
-	qboolean init;
-	char keyname[256];
-	const char *com_token;
+	entpair_t *pair;
+	field_t *f;
 
-	if (!ent)
+	list->pairs = ED_Grow(list->pairs, &list->maxpairs, list->numpairs + 1,
+			sizeof(entpair_t));
+	pair = &list->pairs[list->numpairs++];
+	memset(pair, 0, sizeof(*pair));
+
+	f = ED_FindField(key);
+
+	if (!f)
 	{
-		return NULL;
+		/* keep the key to complain
+		   about it on each spawn */
+		pair->string = ED_AddString(list, key, false);
+		return;
 	}
 
-	init = false;
-	memset(&st, 0, sizeof(st));
+	pair->field = f;
+
+	switch (f->type)
+	{
+		case F_LSTRING:
+			pair->string = ED_AddString(list, value, true);
+			break;
+		case F_VECTOR:
+			sscanf(value, "%f %f %f", &pair->fvalue[0], &pair->fvalue[1],
+					&pair->fvalue[2]);
+			break;
+		case F_INT:
+			pair->ivalue = (int)strtol(value, (char **)NULL, 10);
+			break;
+		case F_FLOAT:
+			pair->fvalue[0] = (float)strtod(value, (char **)NULL);
+			break;
+		case F_ANGLEHACK:
+			pair->fvalue[1] = (float)strtod(value, (char **)NULL);
+			break;
+		case F_IGNORE:
+			break;
+		default:
+			break;
+	}
+}
+
+/*
+ * Parses an edict out of the given string,
+ * returning the new position
+ */
+static char *
+ED_ParseEdict(char *data, entlist_t *list)
+{
+	entdef_t *def;
+	char keyname[256];
+	const char *com_token;
+
+	list->defs = ED_Grow(list->defs, &list->maxdefs, list->numdefs + 1,
+			sizeof(entdef_t));
+	def = &list->defs[list->numdefs++];
+	def->firstpair = list->numpairs;
+	def->init = false;
 
 	/* go through all the dictionary pairs */
 	while (1)
@@ -482,7 +702,7 @@ ED_ParseEdict(char *data, edict_t *ent)
 			gi.error("ED_ParseEntity: closing brace without data");
 		}
 
-		init = true;
+		def->init = true;
 
 		/* keynames with a leading underscore are
 		   used for utility comments, and are
@@ -492,15 +712,240 @@ ED_ParseEdict(char *data, edict_t *ent)
 			continue;
 		}
 
-		ED_ParseField(keyname, com_token, ent);
+		ED_ParseField(list, keyname, com_token);
+	}
+
+	def->numpairs = list->numpairs - def->firstpair;
+
+	return data;
+}
+
+static entlist_t *
+ED_ParseEntities(char *entities)
+{
+	entlist_t *list;
+	const char *com_token;
+
+	list = calloc(1, sizeof(entlist_t));
+
+	if (!list)
+	{
+		gi.error("ED_ParseEntities: couldn't allocate entity list");
+	}
+
+	/* parse ents */
+	while (1)
+	{
+		/* parse the opening brace */
+		com_token = COM_Parse(&entities);
+
+		if (!entities)
+		{
+			break;
+		}
+
+		if (com_token[0] != '{')
+		{
+			gi.error("ED_LoadFromFile: found %s when expecting {", com_token);
+		}
+
+		entities = ED_ParseEdict(entities, list);
+	}
+
+	return list;
+}
+
+static unsigned long long
+ED_Checksum(const char *entities, int *length)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	const char *s;
+
+	for (s = entities; *s; s++)
+	{
+		hash ^= (unsigned char)*s;
+		hash *= 1099511628211ULL;
+	}
+
+	*length = s - entities;
+
+	return hash;
+}
+
+/*
+ * Returns the parsed entity list of
+ * the map, from the cache if it's
+ * enabled and holds the map. *cached
+ * is set if the list is owned by the
+ * cache, otherwise the caller frees it.
+ */
+static entlist_t *
+ED_LoadEntities(const char *mapname, char *entities, qboolean *cached)
+{
+	unsigned long long checksum;
+	entlist_t *list;
+	int size, length;
+	int i, oldest;
+
+	size = (int)g_entitycache->value;
+
+	if (size > MAX_ENTITYCACHE)
+	{
+		size = MAX_ENTITYCACHE;
+	}
+
+	if (size < 0)
+	{
+		size = 0;
+	}
+
+	/* drop lists that don't fit
+	   anymore if it was shrunk */
+	for (i = size; i < MAX_ENTITYCACHE; i++)
+	{
+		if (entitycache[i])
+		{
+			ED_FreeEntityList(entitycache[i]);
+			entitycache[i] = NULL;
+		}
+	}
+
+	*cached = false;
+
+	if (!size)
+	{
+		return ED_ParseEntities(entities);
+	}
+
+	checksum = ED_Checksum(entities, &length);
+	oldest = 0;
+
+	for (i = 0; i < size; i++)
+	{
+		list = entitycache[i];
+
+		if (!list)
+		{
+			oldest = i;
+			break;
+		}
+
+		if ((list->checksum == checksum) && (list->length == length) &&
+			!Q_stricmp(list->mapname, (char *)mapname))
+		{
+			list->lastused = ++entitycache_sequence;
+			*cached = true;
+
+			return list;
+		}
+
+		if (list->lastused < entitycache[oldest]->lastused)
+		{
+			oldest = i;
+		}
+	}
+
+	list = ED_ParseEntities(entities);
+	Q_strlcpy(list->mapname, mapname, sizeof(list->mapname));
+	list->checksum = checksum;
+	list->length = length;
+	list->lastused = ++entitycache_sequence;
+
+	if (entitycache[oldest])
+	{
+		ED_FreeEntityList(entitycache[oldest]);
 	}
 
-	if (!init)
+	entitycache[oldest] = list;
+	*cached = true;
+
+	return list;
+}
+
+/*
+ * Drops all cached entity lists.
+ * Called when the game library
+ * is shut down.
+ */
+void
+ED_FreeEntityCache(void)
+{
+	int i;
+
+	for (i = 0; i < MAX_ENTITYCACHE; i++)
+	{
+		if (entitycache[i])
+		{
+			ED_FreeEntityList(entitycache[i]);
+			entitycache[i] = NULL;
+		}
+	}
+}
+
+/*
+ * Sets the parsed fields of an entity
+ * in an edict. The edict must be
+ * properly initialized and empty.
+ */
+static void
+ED_SpawnEdict(entlist_t *list, entdef_t *def, edict_t *ent)
+{
+	entpair_t *pair;
+	field_t *f;
+	byte *b;
+	int i, len;
+
+	memset(&st, 0, sizeof(st));
+
+	if (!def->init)
 	{
+		G_UnindexEdict(ent);
 		memset(ent, 0, sizeof(*ent));
+		return;
 	}
 
-	return data;
+	for (i = 0, pair = list->pairs + def->firstpair; i < def->numpairs; i++, pair++)
+	{
+		f = pair->field;
+
+		if (!f)
+		{
+			gi.dprintf("%s is not a field\n", list->strings + pair->string);
+			continue;
+		}
+
+		if (f->flags & FFL_SPAWNTEMP)
+		{
+			b = (byte *)&st;
+		}
+		else
+		{
+			b = (byte *)ent;
+		}
+
+		switch (f->type)
+		{
+			case F_LSTRING:
+				len = strlen(list->strings + pair->string) + 1;
+				*(char **)(b + f->ofs) = gi.TagMalloc(len, TAG_LEVEL);
+				memcpy(*(char **)(b + f->ofs), list->strings + pair->string, len);
+				break;
+			case F_VECTOR:
+			case F_ANGLEHACK:
+				memcpy(b + f->ofs, pair->fvalue, sizeof(vec3_t));
+				break;
+			case F_INT:
+				*(int *)(b + f->ofs) = pair->ivalue;
+				break;
+			case F_FLOAT:
+				*(float *)(b + f->ofs) = pair->fvalue[0];
+				break;
+			case F_IGNORE:
+				break;
+			default:
+				break;
+		}
+	}
 }
 
 /*
@@ -581,7 +1026,8 @@ SpawnEntities(const char *mapname, char *entities, const char *spawnpoint)
 {
 	edict_t *ent;
 	int inhibit;
-	const char *com_token;
+	entlist_t *list;
+	qboolean cached;
 	int i;
 	float skill_level;
 
@@ -613,6 +1059,14 @@ SpawnEntities(const char *mapname, char *entities, const char *spawnpoint)
 
 	memset(&level, 0, sizeof(level));
 	memset(g_edicts, 0, game.maxentities * sizeof(g_edicts[0]));
+	G_ClearEdictIndex();
+
+	/* the edicts of the last map are
+	   free now and must be reused */
+	G_RebuildFreeEdicts();
+	G_ClearThinkQueue();
+	AI_ClearSightCache();
+	Nav_Init();
 
 	Q_strlcpy(level.mapname, mapname, sizeof(level.mapname));
 	Q_strlcpy(game.spawnpoint, spawnpoint, sizeof(game.spawnpoint));
@@ -623,26 +1077,13 @@ SpawnEntities(const char *mapname, char *entities, const char *spawnpoint)
 		g_edicts[i + 1].client = game.clients + i;
 	}
 
-	ent = NULL;
+	list = ED_LoadEntities(mapname, entities, &cached);
 	inhibit = 0;
 
-	/* parse ents */
-	while (1)
+	/* spawn ents */
+	for (i = 0; i < list->numdefs; i++)
 	{
-		/* parse the opening brace */
-		com_token = COM_Parse(&entities);
-
-		if (!entities)
-		{
-			break;
-		}
-
-		if (com_token[0] != '{')
-		{
-			gi.error("ED_LoadFromFile: found %s when expecting {", com_token);
-		}
-
-		if (!ent)
+		if (!i)
 		{
 			ent = g_edicts;
 		}
@@ -651,7 +1092,8 @@ SpawnEntities(const char *mapname, char *entities, const char *spawnpoint)
 			ent = G_Spawn();
 		}
 
-		entities = ED_ParseEdict(entities, ent);
+		ED_SpawnEdict(list, &list->defs[i], ent);
+		G_IndexEdict(ent);
 
 		/* yet another map hack */
 		if (!Q_stricmp(level.mapname, "command") &&
@@ -700,6 +1142,11 @@ SpawnEntities(const char *mapname, char *entities, const char *spawnpoint)
 		ED_CallSpawn(ent);
 	}
 
+	if (!cached)
+	{
+		ED_FreeEntityList(list);
+	}
+
 	gi.dprintf("%i entities inhibited.\n", inhibit);
 
 	G_FindTeams();
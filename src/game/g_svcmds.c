@@ -344,6 +344,14 @@ ServerCommand(void)
 	{
 		SVCmd_WriteIP_f();
 	}
+	else if (Q_stricmp(cmd, "edicts") == 0)
+	{
+		G_EdictStats();
+	}
+	else if (Q_stricmp(cmd, "nav") == 0)
+	{
+		Nav_Stats();
+	}
 	else
 	{
 		gi.cprintf(NULL, PRINT_HIGH, "Unknown server command \"%s\"\n", cmd);
@@ -0,0 +1,606 @@
+/*
+ * Copyright (C) 1997-2001 Id Software, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * =======================================================================
+ *
+ * Worker threads tracing the moves of tossed and flying entities in
+ * parallel before they're run.
+ *
+ * Think, touch and blocked functions change other entities, the level
+ * and the multicast buffer, so the entities themselves are still run
+ * one after another. But most of the time spent on gibs, debris and
+ * projectiles goes into the trace of their move, and that trace only
+ * reads the world. Before the entities are run, the move each of them
+ * is going to make is traced by a pool of threads. When the entity
+ * is run, the precomputed trace is taken if nothing it depends on has
+ * changed in the meantime: the same start, end, size and mask, and the
+ * same entities with the same solid, owner, position and size in the
+ * area the move crosses. Otherwise the entity is traced again. This
+ * makes the game logic exactly the same as without threads.
+ *
+ * =======================================================================
+ */
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "header/local.h"
+
+#define PRETRACE_MAX 256        /* moves traced per frame */
+#define PRETRACE_TOUCHES 16     /* entities near a move */
+#define PRETRACE_THREADS 7      /* the main thread helps */
+
+typedef struct
+{
+	edict_t *ent;
+	edict_t *owner;
+	int solid;
+	int svflags;
+	int modelindex;
+	vec3_t origin;
+	vec3_t angles;
+	vec3_t mins, maxs;
+} pretouch_t;
+
+typedef struct
+{
+	edict_t *ent;
+	int framenum;
+	qboolean valid;
+
+	/* the inputs of the trace */
+	edict_t *owner;
+	vec3_t start, end;
+	vec3_t mins, maxs;
+	int mask;
+
+	trace_t trace;
+	int numtouch;               /* -1 when blocked by the world */
+	pretouch_t touch[PRETRACE_TOUCHES];
+} pretrace_t;
+
+static pretrace_t *pretraces;
+static int numpretraces;
+static int nextpretrace;
+static int *pretrace_index;     /* per entity, -1 for none */
+
+#ifdef _WIN32
+typedef HANDLE gthread_t;
+static CRITICAL_SECTION pool_lock;
+static CONDITION_VARIABLE pool_wake;
+static CONDITION_VARIABLE pool_done;
+#else
+typedef pthread_t gthread_t;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+#endif
+
+static gthread_t pool_threads[PRETRACE_THREADS];
+static int pool_numthreads;
+static int pool_generation;
+static int pool_busy;
+static qboolean pool_quit;
+
+#ifdef _WIN32
+#define Pool_Lock() EnterCriticalSection(&pool_lock)
+#define Pool_Unlock() LeaveCriticalSection(&pool_lock)
+#define Pool_Wait(cond) SleepConditionVariableCS(&cond, &pool_lock, INFINITE)
+#define Pool_WakeAll(cond) WakeAllConditionVariable(&cond)
+#else
+#define Pool_Lock() pthread_mutex_lock(&pool_lock)
+#define Pool_Unlock() pthread_mutex_unlock(&pool_lock)
+#define Pool_Wait(cond) pthread_cond_wait(&cond, &pool_lock)
+#define Pool_WakeAll(cond) pthread_cond_broadcast(&cond)
+#endif
+
+/* ================================================================== */
+
+/*
+ * The same box SV_Trace() collects
+ * the entities to clip against in.
+ */
+static void
+G_PretraceBounds(pretrace_t *p, vec3_t boxmins, vec3_t boxmaxs)
+{
+	int i;
+
+	for (i = 0; i < 3; i++)
+	{
+		if (p->end[i] > p->start[i])
+		{
+			boxmins[i] = p->start[i] + p->mins[i] - 1;
+			boxmaxs[i] = p->end[i] + p->maxs[i] + 1;
+		}
+		else
+		{
+			boxmins[i] = p->end[i] + p->mins[i] - 1;
+			boxmaxs[i] = p->start[i] + p->maxs[i] + 1;
+		}
+	}
+}
+
+/*
+ * Everything of an entity the
+ * trace clips against depends on.
+ */
+static void
+G_SnapshotTouch(pretouch_t *t, edict_t *ent)
+{
+	memset(t, 0, sizeof(*t));
+
+	t->ent = ent;
+	t->owner = ent->owner;
+	t->solid = ent->solid;
+	t->svflags = ent->svflags;
+	t->modelindex = ent->s.modelindex;
+	VectorCopy(ent->s.origin, t->origin);
+	VectorCopy(ent->s.angles, t->angles);
+	VectorCopy(ent->mins, t->mins);
+	VectorCopy(ent->maxs, t->maxs);
+}
+
+static void
+G_RunPretrace(pretrace_t *p)
+{
+	edict_t *touch[MAX_EDICTS];
+	vec3_t boxmins, boxmaxs;
+	int i, num;
+
+	p->numtouch = 0;
+	p->trace = gi.trace(p->start, p->mins, p->maxs, p->end, p->ent, p->mask);
+
+	/* the entities weren't looked at */
+	if ((p->trace.fraction == 0) && (p->trace.ent == g_edicts))
+	{
+		p->numtouch = -1;
+		p->valid = true;
+		return;
+	}
+
+	G_PretraceBounds(p, boxmins, boxmaxs);
+	num = gi.BoxEdicts(boxmins, boxmaxs, touch, MAX_EDICTS, AREA_SOLID);
+
+	for (i = 0; i < num; i++)
+	{
+		/* the trace ignores the moving entity,
+		   its angles change before the move */
+		if (touch[i] == p->ent)
+		{
+			continue;
+		}
+
+		if (p->numtouch == PRETRACE_TOUCHES)
+		{
+			return;
+		}
+
+		G_SnapshotTouch(&p->touch[p->numtouch], touch[i]);
+		p->numtouch++;
+	}
+
+	p->valid = true;
+}
+
+static void
+G_RunPretraceJobs(void)
+{
+	int i;
+
+	while ((i = __atomic_fetch_add(&nextpretrace, 1, __ATOMIC_RELAXED)) < numpretraces)
+	{
+		G_RunPretrace(&pretraces[i]);
+	}
+}
+
+/* ================================================================== */
+
+#ifdef _WIN32
+static DWORD WINAPI
+G_PretraceThread(LPVOID arg)
+#else
+static void *
+G_PretraceThread(void *arg)
+#endif
+{
+	int generation = 0;
+
+	for ( ; ; )
+	{
+		Pool_Lock();
+
+		while ((pool_generation == generation) && !pool_quit)
+		{
+			Pool_Wait(pool_wake);
+		}
+
+		if (pool_quit)
+		{
+			Pool_Unlock();
+			break;
+		}
+
+		generation = pool_generation;
+		Pool_Unlock();
+
+		G_RunPretraceJobs();
+
+		Pool_Lock();
+
+		if (--pool_busy == 0)
+		{
+			Pool_WakeAll(pool_done);
+		}
+
+		Pool_Unlock();
+	}
+
+	return 0;
+}
+
+/*
+ * Joins all worker threads, must be called
+ * before the game library is unloaded.
+ */
+void
+G_ShutdownThreads(void)
+{
+	int i;
+
+	if (!pool_numthreads)
+	{
+		return;
+	}
+
+	Pool_Lock();
+	pool_quit = true;
+	Pool_WakeAll(pool_wake);
+	Pool_Unlock();
+
+	for (i = 0; i < pool_numthreads; i++)
+	{
+#ifdef _WIN32
+		WaitForSingleObject(pool_threads[i], INFINITE);
+		CloseHandle(pool_threads[i]);
+#else
+		pthread_join(pool_threads[i], NULL);
+#endif
+	}
+
+	pool_numthreads = 0;
+	pool_generation = 0;
+	pool_quit = false;
+}
+
+static void
+G_StartThreads(int num)
+{
+#ifdef _WIN32
+	static qboolean initialized;
+
+	if (!initialized)
+	{
+		InitializeCriticalSection(&pool_lock);
+		InitializeConditionVariable(&pool_wake);
+		InitializeConditionVariable(&pool_done);
+		initialized = true;
+	}
+#endif
+
+	while (pool_numthreads < num)
+	{
+#ifdef _WIN32
+		pool_threads[pool_numthreads] = CreateThread(NULL, 0,
+				G_PretraceThread, NULL, 0, NULL);
+
+		if (!pool_threads[pool_numthreads])
+#else
+		if (pthread_create(&pool_threads[pool_numthreads], NULL,
+					G_PretraceThread, NULL) != 0)
+#endif
+		{
+			gi.dprintf("Couldn't start more than %i game threads.\n",
+					pool_numthreads);
+			break;
+		}
+
+		pool_numthreads++;
+	}
+}
+
+/*
+ * Brings the number of worker threads in line with g_threads,
+ * capped by the threads the server allows to trace at once.
+ * Servers without sv_tracethreads can't trace in parallel.
+ */
+static void
+G_CheckThreads(void)
+{
+	cvar_t *sv_tracethreads;
+	int num;
+
+	sv_tracethreads = gi.cvar("sv_tracethreads", "0", 0);
+
+	num = (int)g_threads->value;
+
+	if (num > (int)sv_tracethreads->value)
+	{
+		num = (int)sv_tracethreads->value;
+	}
+
+	if (num > PRETRACE_THREADS)
+	{
+		num = PRETRACE_THREADS;
+	}
+
+	if (num < 0)
+	{
+		num = 0;
+	}
+
+	if (num != pool_numthreads)
+	{
+		G_ShutdownThreads();
+		G_StartThreads(num);
+	}
+}
+
+/* ================================================================== */
+
+/*
+ * Allocates the precomputed traces, must
+ * be called whenever g_edicts is allocated.
+ */
+void
+G_InitPretraces(void)
+{
+	int i;
+
+	pretraces = gi.TagMalloc(PRETRACE_MAX * sizeof(pretrace_t), TAG_GAME);
+	pretrace_index = gi.TagMalloc(game.maxentities * sizeof(int), TAG_GAME);
+
+	for (i = 0; i < game.maxentities; i++)
+	{
+		pretrace_index[i] = -1;
+	}
+
+	numpretraces = 0;
+}
+
+/*
+ * Queues the move SV_Physics_Toss() would make
+ * for an entity if it was run right now.
+ */
+static void
+G_QueuePretrace(edict_t *ent)
+{
+	pretrace_t *p;
+	edict_t *ground;
+	vec3_t velocity, move;
+
+	if (ent->flags & FL_TEAMSLAVE)
+	{
+		return;
+	}
+
+	ground = ent->groundentity;
+
+	if (ground && (ground->linkcount != ent->groundentity_linkcount))
+	{
+		ground = NULL;
+	}
+
+	if ((ent->velocity[2] > 0) || (ground && !ground->inuse))
+	{
+		ground = NULL;
+	}
+
+	if (ground)
+	{
+		return;
+	}
+
+	/* the same math as SV_CheckVelocity() and SV_AddGravity() */
+	VectorCopy(ent->velocity, velocity);
+
+	if (VectorLength(velocity) > sv_maxvelocity->value)
+	{
+		VectorNormalize(velocity);
+		VectorScale(velocity, sv_maxvelocity->value, velocity);
+	}
+
+	if ((ent->movetype != MOVETYPE_FLY) &&
+		(ent->movetype != MOVETYPE_FLYMISSILE))
+	{
+		velocity[2] -= ent->gravity * sv_gravity->value * FRAMETIME;
+	}
+
+	VectorScale(velocity, FRAMETIME, move);
+
+	p = &pretraces[numpretraces];
+	p->ent = ent;
+	p->framenum = level.framenum;
+	p->valid = false;
+	p->owner = ent->owner;
+	VectorCopy(ent->s.origin, p->start);
+	VectorAdd(p->start, move, p->end);
+	VectorCopy(ent->mins, p->mins);
+	VectorCopy(ent->maxs, p->maxs);
+
+	if (ent->clipmask)
+	{
+		p->mask = ent->clipmask;
+	}
+	else
+	{
+		p->mask = MASK_SOLID;
+	}
+
+	pretrace_index[ent - g_edicts] = numpretraces;
+	numpretraces++;
+}
+
+/*
+ * Traces the moves of all awake tossed and flying
+ * entities in parallel, called before they're run.
+ */
+void
+G_RunPretraces(void)
+{
+	edict_t *ent;
+	int i;
+
+	G_CheckThreads();
+
+	for (i = 0; i < numpretraces; i++)
+	{
+		pretrace_index[pretraces[i].ent - g_edicts] = -1;
+	}
+
+	numpretraces = 0;
+
+	if (!pool_numthreads)
+	{
+		return;
+	}
+
+	for (i = G_NextAwakeEdict((int)maxclients->value + 1);
+		 (i < globals.num_edicts) && (numpretraces < PRETRACE_MAX);
+		 i = G_NextAwakeEdict(i + 1))
+	{
+		ent = &g_edicts[i];
+
+		if (!ent->inuse)
+		{
+			continue;
+		}
+
+		switch ((int)ent->movetype)
+		{
+			case MOVETYPE_TOSS:
+			case MOVETYPE_BOUNCE:
+			case MOVETYPE_FLY:
+			case MOVETYPE_FLYMISSILE:
+				G_QueuePretrace(ent);
+				break;
+			default:
+				break;
+		}
+	}
+
+	/* not worth waking up the threads */
+	if (numpretraces < 2)
+	{
+		return;
+	}
+
+	nextpretrace = 0;
+
+	Pool_Lock();
+	pool_busy = pool_numthreads;
+	pool_generation++;
+	Pool_WakeAll(pool_wake);
+	Pool_Unlock();
+
+	G_RunPretraceJobs();
+
+	Pool_Lock();
+
+	while (pool_busy)
+	{
+		Pool_Wait(pool_done);
+	}
+
+	Pool_Unlock();
+}
+
+/*
+ * Returns the precomputed trace of an entity's move if
+ * it's exactly what gi.trace() would return right now.
+ */
+qboolean
+G_Pretraced(edict_t *ent, vec3_t start, vec3_t end, int mask, trace_t *trace)
+{
+	edict_t *touch[MAX_EDICTS];
+	vec3_t boxmins, boxmaxs;
+	pretouch_t snapshot;
+	pretrace_t *p;
+	int i, j, num;
+
+	i = pretrace_index[ent - g_edicts];
+
+	if (i < 0)
+	{
+		return false;
+	}
+
+	/* a retried move traces again */
+	pretrace_index[ent - g_edicts] = -1;
+	p = &pretraces[i];
+
+	if (!p->valid || (p->framenum != level.framenum) ||
+		(p->mask != mask) || (p->owner != ent->owner) ||
+		memcmp(p->start, start, sizeof(vec3_t)) ||
+		memcmp(p->end, end, sizeof(vec3_t)) ||
+		memcmp(p->mins, ent->mins, sizeof(vec3_t)) ||
+		memcmp(p->maxs, ent->maxs, sizeof(vec3_t)))
+	{
+		return false;
+	}
+
+	if (p->numtouch >= 0)
+	{
+		G_PretraceBounds(p, boxmins, boxmaxs);
+		num = gi.BoxEdicts(boxmins, boxmaxs, touch, MAX_EDICTS, AREA_SOLID);
+
+		for (i = 0, j = 0; i < num; i++)
+		{
+			if (touch[i] == ent)
+			{
+				continue;
+			}
+
+			if (j == p->numtouch)
+			{
+				return false;
+			}
+
+			G_SnapshotTouch(&snapshot, touch[i]);
+
+			if (memcmp(&snapshot, &p->touch[j], sizeof(snapshot)))
+			{
+				return false;
+			}
+
+			j++;
+		}
+
+		if (j != p->numtouch)
+		{
+			return false;
+		}
+	}
+
+	*trace = p->trace;
+
+	return true;
+}
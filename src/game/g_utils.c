@@ -38,6 +38,395 @@ G_ProjectSource(vec3_t point, vec3_t distance, vec3_t forward,
 				distance[2];
 }
 
+/*
+ * Hash indices over the classname and targetname
+ * of all entities. Each bucket is a list sorted by
+ * entity number, so G_Find() can walk it in the
+ * same order as a linear scan. The links are kept
+ * outside of edict_t to keep savegames compatible.
+ */
+#define EDICT_HASH_SIZE 1024
+
+typedef struct
+{
+	edict_t *next, *prev;
+	int bucket; /* hash bucket + 1, 0 if not indexed */
+} edictlink_t;
+
+typedef struct
+{
+	int fieldofs;
+	edict_t *heads[EDICT_HASH_SIZE];
+	edictlink_t *links;
+} edictindex_t;
+
+static edictindex_t classname_index = {FOFS(classname)};
+static edictindex_t targetname_index = {FOFS(targetname)};
+
+static int
+G_HashName(const char *name)
+{
+	unsigned hash = 0;
+	int c;
+
+	while ((c = *name++) != 0)
+	{
+		if ((c >= 'A') && (c <= 'Z'))
+		{
+			c += 'a' - 'A';
+		}
+
+		hash = hash * 31 + c;
+	}
+
+	return hash & (EDICT_HASH_SIZE - 1);
+}
+
+static void
+G_UnlinkIndex(edictindex_t *index, edict_t *ent)
+{
+	edictlink_t *link = &index->links[ent - g_edicts];
+
+	if (!link->bucket)
+	{
+		return;
+	}
+
+	if (link->prev)
+	{
+		index->links[link->prev - g_edicts].next = link->next;
+	}
+	else
+	{
+		index->heads[link->bucket - 1] = link->next;
+	}
+
+	if (link->next)
+	{
+		index->links[link->next - g_edicts].prev = link->prev;
+	}
+
+	link->next = link->prev = NULL;
+	link->bucket = 0;
+}
+
+static void
+G_LinkIndex(edictindex_t *index, edict_t *ent)
+{
+	edictlink_t *link = &index->links[ent - g_edicts];
+	edict_t *prev, *next;
+	char *s;
+	int bucket;
+
+	G_UnlinkIndex(index, ent);
+
+	s = *(char **)((byte *)ent + index->fieldofs);
+
+	if (!s)
+	{
+		return;
+	}
+
+	bucket = G_HashName(s);
+
+	/* keep the bucket sorted by entity number */
+	prev = NULL;
+	next = index->heads[bucket];
+
+	while (next && (next < ent))
+	{
+		prev = next;
+		next = index->links[next - g_edicts].next;
+	}
+
+	link->prev = prev;
+	link->next = next;
+	link->bucket = bucket + 1;
+
+	if (prev)
+	{
+		index->links[prev - g_edicts].next = ent;
+	}
+	else
+	{
+		index->heads[bucket] = ent;
+	}
+
+	if (next)
+	{
+		index->links[next - g_edicts].prev = ent;
+	}
+}
+
+/*
+ * findradius() index. Entities are filed by
+ * the cell of a 2D grid their bbox center was
+ * in when they were last linked into the world.
+ * Spawned entities that weren't linked yet are
+ * kept in an extra list searched every time.
+ * Entities that were moved without relinking
+ * them are refiled by a pass over all entities
+ * before the first search of each frame. If
+ * such an entity moves after that search, later
+ * searches in the same frame look for it in
+ * its old cell.
+ */
+#define RADIUS_CELL_SIZE 256
+#define RADIUS_HASH_SIZE 1024
+#define RADIUS_LOOSE RADIUS_HASH_SIZE   /* not linked since spawned */
+#define RADIUS_MAX_CELLS 64             /* wider searches scan all entities */
+
+static edict_t *radius_heads[RADIUS_HASH_SIZE + 1];
+static edictlink_t *radius_links;
+static int radius_visited[RADIUS_HASH_SIZE];
+static int radius_visitcount;
+static int radius_changes;              /* bumped when an entity is refiled */
+static int radius_framenum = -1;        /* of the last pass over all entities */
+static void (*radius_setmodel)(edict_t *ent, char *name);
+
+static int
+G_RadiusHash(int x, int y)
+{
+	return ((unsigned)x * 73856093u ^ (unsigned)y * 19349663u) &
+		(RADIUS_HASH_SIZE - 1);
+}
+
+static int
+G_RadiusCell(float f)
+{
+	return (int)floor(f / RADIUS_CELL_SIZE);
+}
+
+static void
+G_UnlinkRadius(edict_t *ent)
+{
+	edictlink_t *link = &radius_links[ent - g_edicts];
+
+	if (!link->bucket)
+	{
+		return;
+	}
+
+	if (link->prev)
+	{
+		radius_links[link->prev - g_edicts].next = link->next;
+	}
+	else
+	{
+		radius_heads[link->bucket - 1] = link->next;
+	}
+
+	if (link->next)
+	{
+		radius_links[link->next - g_edicts].prev = link->prev;
+	}
+
+	link->next = link->prev = NULL;
+	link->bucket = 0;
+	radius_changes++;
+}
+
+static void
+G_LinkRadius(edict_t *ent, int bucket)
+{
+	edictlink_t *link = &radius_links[ent - g_edicts];
+
+	if (link->bucket == bucket + 1)
+	{
+		return;
+	}
+
+	G_UnlinkRadius(ent);
+
+	link->prev = NULL;
+	link->next = radius_heads[bucket];
+	link->bucket = bucket + 1;
+
+	if (link->next)
+	{
+		radius_links[link->next - g_edicts].prev = ent;
+	}
+
+	radius_heads[bucket] = ent;
+	radius_changes++;
+}
+
+/*
+ * Files the entity under the cell of its
+ * current bbox center. Called whenever
+ * it's linked into the world.
+ */
+void
+G_RefileEdict(edict_t *ent)
+{
+	float x, y;
+
+	x = ent->s.origin[0] + (ent->mins[0] + ent->maxs[0]) * 0.5;
+	y = ent->s.origin[1] + (ent->mins[1] + ent->maxs[1]) * 0.5;
+
+	G_LinkRadius(ent, G_RadiusHash(G_RadiusCell(x), G_RadiusCell(y)));
+}
+
+/*
+ * gi.setmodel() links inline models
+ * into the world with their new size.
+ */
+static void
+G_SetModel(edict_t *ent, char *name)
+{
+	radius_setmodel(ent, name);
+
+	if (name && (name[0] == '*'))
+	{
+		G_RefileEdict(ent);
+		AI_ClearSightCache();
+	}
+}
+
+/*
+ * Allocates the entity indices, must be
+ * called whenever g_edicts is allocated.
+ */
+void
+G_InitEdictIndex(void)
+{
+	classname_index.links = gi.TagMalloc(game.maxentities *
+			sizeof(edictlink_t), TAG_GAME);
+	targetname_index.links = gi.TagMalloc(game.maxentities *
+			sizeof(edictlink_t), TAG_GAME);
+	radius_links = gi.TagMalloc(game.maxentities *
+			sizeof(edictlink_t), TAG_GAME);
+
+	/* inline models are linked by gi.setmodel() */
+	if (gi.setmodel != G_SetModel)
+	{
+		radius_setmodel = gi.setmodel;
+		gi.setmodel = G_SetModel;
+	}
+
+	G_ClearEdictIndex();
+}
+
+/*
+ * Empties the indices, used when
+ * all entities are wiped.
+ */
+void
+G_ClearEdictIndex(void)
+{
+	memset(classname_index.heads, 0, sizeof(classname_index.heads));
+	memset(targetname_index.heads, 0, sizeof(targetname_index.heads));
+	memset(classname_index.links, 0, game.maxentities * sizeof(edictlink_t));
+	memset(targetname_index.links, 0, game.maxentities * sizeof(edictlink_t));
+	memset(radius_heads, 0, sizeof(radius_heads));
+	memset(radius_links, 0, game.maxentities * sizeof(edictlink_t));
+	radius_framenum = -1;
+	radius_changes++;
+}
+
+/*
+ * Reindexes all entities in use, e.g.
+ * after they were read from a savegame.
+ */
+void
+G_RebuildEdictIndex(void)
+{
+	int i;
+
+	G_ClearEdictIndex();
+
+	for (i = 0; i < globals.num_edicts; i++)
+	{
+		if (g_edicts[i].inuse)
+		{
+			G_IndexEdict(&g_edicts[i]);
+			G_RefileEdict(&g_edicts[i]);
+		}
+	}
+}
+
+/*
+ * Updates the indices after the classname or
+ * targetname of an entity was changed.
+ */
+void
+G_IndexEdict(edict_t *ent)
+{
+	G_LinkIndex(&classname_index, ent);
+	G_LinkIndex(&targetname_index, ent);
+}
+
+void
+G_UnindexEdict(edict_t *ent)
+{
+	G_UnlinkIndex(&classname_index, ent);
+	G_UnlinkIndex(&targetname_index, ent);
+	G_UnlinkRadius(ent);
+}
+
+/*
+ * Entities are only found by G_Find() if their
+ * classname or targetname is set through these.
+ */
+void
+G_SetClassname(edict_t *ent, char *classname)
+{
+	ent->classname = classname;
+	G_LinkIndex(&classname_index, ent);
+}
+
+void
+G_SetTargetname(edict_t *ent, char *targetname)
+{
+	ent->targetname = targetname;
+	G_LinkIndex(&targetname_index, ent);
+}
+
+static edict_t *
+G_FindIndexed(edictindex_t *index, edict_t *from, char *match)
+{
+	edict_t *e;
+	char *s;
+	int bucket;
+
+	bucket = G_HashName(match);
+
+	/* continue where the last search stopped */
+	if (from && (index->links[from - g_edicts].bucket == bucket + 1))
+	{
+		e = index->links[from - g_edicts].next;
+	}
+	else
+	{
+		for (e = index->heads[bucket]; e && from && (e <= from);
+			 e = index->links[e - g_edicts].next)
+		{
+		}
+	}
+
+	for ( ; e; e = index->links[e - g_edicts].next)
+	{
+		if (e >= &g_edicts[globals.num_edicts])
+		{
+			break;
+		}
+
+		if (!e->inuse)
+		{
+			continue;
+		}
+
+		s = *(char **)((byte *)e + index->fieldofs);
+
+		if (s && !Q_stricmp(s, match))
+		{
+			return e;
+		}
+	}
+
+	return NULL;
+}
+
 /*
  * Searches all active entities for the next
  * one that holds the matching string at fieldofs
@@ -52,6 +441,16 @@ G_Find(edict_t *from, int fieldofs, char *match)
 {
 	char *s;
 
+	if (match && (fieldofs == FOFS(classname)))
+	{
+		return G_FindIndexed(&classname_index, from, match);
+	}
+
+	if (match && (fieldofs == FOFS(targetname)))
+	{
+		return G_FindIndexed(&targetname_index, from, match);
+	}
+
 	if (!from)
 	{
 		from = g_edicts;
@@ -89,15 +488,178 @@ G_Find(edict_t *from, int fieldofs, char *match)
 	return NULL;
 }
 
+/*
+ * Candidates of the last findradius() search,
+ * sorted by entity number. A search loop keeps
+ * using them as long as it continues with the
+ * same origin and radius from the last result
+ * and no entity was refiled. A count of -1
+ * means that all entities are scanned.
+ */
+static edict_t *radius_list[MAX_EDICTS];
+static int radius_count;
+static int radius_next;
+static vec3_t radius_org;
+static float radius_rad;
+static edict_t *radius_last;
+static int radius_listchanges;
+
+static void
+G_RefileAllEdicts(void)
+{
+	int i;
+
+	for (i = 0; i < globals.num_edicts; i++)
+	{
+		if (g_edicts[i].inuse)
+		{
+			G_RefileEdict(&g_edicts[i]);
+		}
+		else
+		{
+			G_UnlinkRadius(&g_edicts[i]);
+		}
+	}
+
+	radius_framenum = level.framenum;
+}
+
+static int
+RadiusCompare(const void *a, const void *b)
+{
+	const edict_t *e1 = *(const edict_t **)a;
+	const edict_t *e2 = *(const edict_t **)b;
+
+	return (e1 > e2) - (e1 < e2);
+}
+
+static void
+G_AddRadiusBucket(edict_t *from, int bucket)
+{
+	edict_t *e;
+
+	for (e = radius_heads[bucket]; e; e = radius_links[e - g_edicts].next)
+	{
+		if (e >= from)
+		{
+			radius_list[radius_count++] = e;
+		}
+	}
+}
+
+static void
+FindRadiusCandidates(edict_t *from, vec3_t org, float rad)
+{
+	int x, y, x0, y0, x1, y1;
+	int bucket;
+
+	VectorCopy(org, radius_org);
+	radius_rad = rad;
+	radius_listchanges = radius_changes;
+	radius_count = 0;
+	radius_next = 0;
+
+	/* one unit more for rounding errors
+	   in the distance test */
+	x0 = G_RadiusCell(org[0] - rad - 1);
+	y0 = G_RadiusCell(org[1] - rad - 1);
+	x1 = G_RadiusCell(org[0] + rad + 1);
+	y1 = G_RadiusCell(org[1] + rad + 1);
+
+	if ((rad < 0) || ((x1 - x0 + 1) * (y1 - y0 + 1) > RADIUS_MAX_CELLS))
+	{
+		radius_count = -1;
+		return;
+	}
+
+	/* cells sharing a bucket are added once */
+	radius_visitcount++;
+
+	for (x = x0; x <= x1; x++)
+	{
+		for (y = y0; y <= y1; y++)
+		{
+			bucket = G_RadiusHash(x, y);
+
+			if (radius_visited[bucket] == radius_visitcount)
+			{
+				continue;
+			}
+
+			radius_visited[bucket] = radius_visitcount;
+			G_AddRadiusBucket(from, bucket);
+		}
+	}
+
+	G_AddRadiusBucket(from, RADIUS_LOOSE);
+
+	qsort(radius_list, radius_count, sizeof(radius_list[0]), RadiusCompare);
+}
+
+static qboolean
+G_InRadius(edict_t *e, vec3_t org, float rad)
+{
+	vec3_t eorg;
+	int j;
+
+	if (!e->inuse)
+	{
+		return false;
+	}
+
+	if (e->solid == SOLID_NOT)
+	{
+		return false;
+	}
+
+	for (j = 0; j < 3; j++)
+	{
+		eorg[j] = org[j] - (e->s.origin[j] +
+				   (e->mins[j] + e->maxs[j]) * 0.5);
+	}
+
+	if (VectorLength(eorg) > rad)
+	{
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * The search of Vanilla Quake II,
+ * checks every entity after from.
+ */
+static edict_t *
+FindRadiusLinear(edict_t *from, vec3_t org, float rad)
+{
+	for ( ; from < &g_edicts[globals.num_edicts]; from++)
+	{
+		if (G_InRadius(from, org, rad))
+		{
+			return from;
+		}
+	}
+
+	return NULL;
+}
+
 /*
  * Returns entities that have origins
  * within a spherical area
+ *
+ * Gives the same entities in the same order
+ * as checking all entities. Candidates are
+ * taken from the grid, wide searches fall
+ * back to checking all entities. The only
+ * exception are entities moved without
+ * relinking them after the first search
+ * of a frame, see the index above.
  */
 edict_t *
 findradius(edict_t *from, vec3_t org, float rad)
 {
-	vec3_t eorg;
-	int j;
+	edict_t *e, *check;
 
 	if (!from)
 	{
@@ -108,33 +670,58 @@ findradius(edict_t *from, vec3_t org, float rad)
 		from++;
 	}
 
-	for ( ; from < &g_edicts[globals.num_edicts]; from++)
+	if (radius_framenum != level.framenum)
 	{
-		if (!from->inuse)
-		{
-			continue;
-		}
+		G_RefileAllEdicts();
+	}
 
-		if (from->solid == SOLID_NOT)
-		{
-			continue;
-		}
+	if ((from == g_edicts) || (from - 1 != radius_last) ||
+		!VectorCompare(org, radius_org) || (rad != radius_rad) ||
+		(radius_listchanges != radius_changes))
+	{
+		FindRadiusCandidates(from, org, rad);
+	}
+
+	e = NULL;
 
-		for (j = 0; j < 3; j++)
+	if (radius_count < 0)
+	{
+		e = FindRadiusLinear(from, org, rad);
+	}
+	else
+	{
+		while (radius_next < radius_count)
 		{
-			eorg[j] = org[j] - (from->s.origin[j] +
-					   (from->mins[j] + from->maxs[j]) * 0.5);
+			check = radius_list[radius_next++];
+
+			if (check >= &g_edicts[globals.num_edicts])
+			{
+				break;
+			}
+
+			if (G_InRadius(check, org, rad))
+			{
+				e = check;
+				break;
+			}
 		}
+	}
+
+	radius_last = e;
 
-		if (VectorLength(eorg) > rad)
+	if (g_radiuscheck->value)
+	{
+		check = FindRadiusLinear(from, org, rad);
+
+		if (check != e)
 		{
-			continue;
+			gi.dprintf("findradius: got entity %i, checking all entities gives %i\n",
+					e ? (int)(e - g_edicts) : -1,
+					check ? (int)(check - g_edicts) : -1);
 		}
-
-		return from;
 	}
 
-	return NULL;
+	return e;
 }
 
 /*
@@ -226,7 +813,7 @@ G_UseTargets(edict_t *ent, edict_t *activator)
 	{
 		/* create a temp object to fire at a later time */
 		t = G_Spawn();
-		t->classname = "DelayedUse";
+		G_SetClassname(t, "DelayedUse");
 		t->nextthink = level.time + ent->delay;
 		t->think = Think_Delay;
 		t->activator = activator;
@@ -314,6 +901,7 @@ G_UseTargets(edict_t *ent, edict_t *activator)
 			{
 				if (t->use)
 				{
+					G_WakeEdict(t);
 					t->use(t, ent, activator);
 				}
 			}
@@ -489,13 +1077,175 @@ G_CopyString(char *in)
 	return out;
 }
 
+/*
+ * Freed entities are queued in the order they were
+ * freed, so the oldest one is always at the head.
+ * Like the edict index the links are kept outside
+ * of edict_t.
+ */
+typedef struct
+{
+	edict_t *next, *prev;
+	qboolean queued;
+} freelink_t;
+
+static freelink_t *free_links;
+static edict_t *free_head, *free_tail;
+static int free_count;
+static int desperate_count;
+
+static void
+G_DequeueFreeEdict(edict_t *e)
+{
+	freelink_t *link = &free_links[e - g_edicts];
+
+	if (!link->queued)
+	{
+		return;
+	}
+
+	if (link->prev)
+	{
+		free_links[link->prev - g_edicts].next = link->next;
+	}
+	else
+	{
+		free_head = link->next;
+	}
+
+	if (link->next)
+	{
+		free_links[link->next - g_edicts].prev = link->prev;
+	}
+	else
+	{
+		free_tail = link->prev;
+	}
+
+	link->next = link->prev = NULL;
+	link->queued = false;
+	free_count--;
+}
+
+static void
+G_QueueFreeEdict(edict_t *e)
+{
+	freelink_t *link = &free_links[e - g_edicts];
+
+	G_DequeueFreeEdict(e);
+
+	link->prev = free_tail;
+	link->next = NULL;
+	link->queued = true;
+
+	if (free_tail)
+	{
+		free_links[free_tail - g_edicts].next = e;
+	}
+	else
+	{
+		free_head = e;
+	}
+
+	free_tail = e;
+	free_count++;
+}
+
+/*
+ * Allocates the queue of free entities, must
+ * be called whenever g_edicts is allocated.
+ */
+void
+G_InitFreeEdicts(void)
+{
+	free_links = gi.TagMalloc(game.maxentities * sizeof(freelink_t), TAG_GAME);
+
+	G_ClearFreeEdicts();
+}
+
+void
+G_ClearFreeEdicts(void)
+{
+	memset(free_links, 0, game.maxentities * sizeof(freelink_t));
+	free_head = free_tail = NULL;
+	free_count = 0;
+	desperate_count = 0;
+}
+
+static int
+FreetimeCompare(const void *a, const void *b)
+{
+	const edict_t *e1 = *(const edict_t **)a;
+	const edict_t *e2 = *(const edict_t **)b;
+
+	if (e1->freetime != e2->freetime)
+	{
+		return (e1->freetime > e2->freetime) ? 1 : -1;
+	}
+
+	return (e1 > e2) - (e1 < e2);
+}
+
+/*
+ * Queues all free entities, e.g. after
+ * they were read from a savegame.
+ */
+void
+G_RebuildFreeEdicts(void)
+{
+	edict_t **list;
+	int count;
+	int i;
+
+	G_ClearFreeEdicts();
+
+	list = gi.TagMalloc(game.maxentities * sizeof(edict_t *), TAG_GAME);
+	count = 0;
+
+	for (i = game.maxclients + 1; i < globals.num_edicts; i++)
+	{
+		if (!g_edicts[i].inuse)
+		{
+			list[count++] = &g_edicts[i];
+		}
+	}
+
+	qsort(list, count, sizeof(list[0]), FreetimeCompare);
+
+	for (i = 0; i < count; i++)
+	{
+		G_QueueFreeEdict(list[i]);
+	}
+
+	gi.TagFree(list);
+}
+
+/*
+ * Prints how many entities are used, free
+ * and had to be reused before their time.
+ */
+void
+G_EdictStats(void)
+{
+	gi.cprintf(NULL, PRINT_HIGH, "%i of %i entities allocated, %i of them free.\n",
+			globals.num_edicts, game.maxentities, free_count);
+	gi.cprintf(NULL, PRINT_HIGH, "%i desperate allocations on this level.\n",
+			desperate_count);
+	gi.cprintf(NULL, PRINT_HIGH, "%i entities asleep in the think queue.\n",
+			G_SleepingEdicts());
+}
+
 void
 G_InitEdict(edict_t *e)
 {
+	G_DequeueFreeEdict(e);
+
 	e->inuse = true;
-	e->classname = "noclass";
+	G_SetClassname(e, "noclass");
+	G_LinkRadius(e, RADIUS_LOOSE);
 	e->gravity = 1.0;
 	e->s.number = e - g_edicts;
+	G_WakeEdict(e);
 }
 
 /*
@@ -506,6 +1256,10 @@ G_InitEdict(edict_t *e)
  * morphed into something else instead of
  * being removed and recreated, which can
  * cause interpolated angles and bad trails.
+ *
+ * The free entities are queued oldest first,
+ * so if the head was freed too recently all
+ * others were as well.
  */
 #define POLICY_DEFAULT		0
 #define POLICY_DESPERATE	1
@@ -513,18 +1267,20 @@ G_InitEdict(edict_t *e)
 static edict_t *
 G_FindFreeEdict(int policy)
 {
-	edict_t *e;
+	edict_t *e = free_head;
 
-	for (e = g_edicts + game.maxclients + 1 ; e < &g_edicts[globals.num_edicts] ; e++)
+	if (!e)
 	{
-		/* the first couple seconds of server time can involve a lot of
-		   freeing and allocating, so relax the replacement policy
-		*/
-		if (!e->inuse && (policy == POLICY_DESPERATE || e->freetime < 2.0f || (level.time - e->freetime) > 0.5f))
-		{
-			G_InitEdict (e);
-			return e;
-		}
+		return NULL;
+	}
+
+	/* the first couple seconds of server time can involve a lot of
+	   freeing and allocating, so relax the replacement policy
+	*/
+	if (policy == POLICY_DESPERATE || e->freetime < 2.0f || (level.time - e->freetime) > 0.5f)
+	{
+		G_InitEdict (e);
+		return e;
 	}
 
 	return NULL;
@@ -542,7 +1298,14 @@ G_SpawnOptional(void)
 
 	if (globals.num_edicts >= game.maxentities)
 	{
-		return G_FindFreeEdict (POLICY_DESPERATE);
+		e = G_FindFreeEdict (POLICY_DESPERATE);
+
+		if (e)
+		{
+			desperate_count++;
+		}
+
+		return e;
 	}
 
 	e = &g_edicts[globals.num_edicts++];
@@ -585,10 +1348,13 @@ G_FreeEdict(edict_t *ed)
 		}
 	}
 
+	G_UnindexEdict(ed);
 	memset(ed, 0, sizeof(*ed));
 	ed->classname = "freed";
 	ed->freetime = level.time;
 	ed->inuse = false;
+
+	G_QueueFreeEdict(ed);
 }
 
 void
@@ -627,6 +1393,7 @@ G_TouchTriggers(edict_t *ent)
 			continue;
 		}
 
+		G_WakeEdict(hit);
 		hit->touch(hit, ent, NULL, NULL);
 	}
 }
@@ -664,6 +1431,7 @@ G_TouchSolids(edict_t *ent)
 
 		if (ent->touch)
 		{
+			G_WakeEdict(hit);
 			ent->touch(hit, ent, NULL, NULL);
 		}
 
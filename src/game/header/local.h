@@ -550,6 +550,11 @@ extern cvar_t *sv_maplist;
 
 extern cvar_t *aimfix;
 extern cvar_t *g_machinegun_norecoil;
+extern cvar_t *g_entitycache;
+extern cvar_t *g_monsternav;
+extern cvar_t *g_thinkqueue;
+extern cvar_t *g_radiuscheck;
+extern cvar_t *g_threads;
 
 #define world (&g_edicts[0])
 
@@ -598,6 +603,10 @@ extern gitem_t itemlist[];
 /* g_cmds.c */
 void Cmd_Help_f(edict_t *ent);
 
+/* g_spawn.c */
+void ED_InitSpawnTables(void);
+void ED_FreeEntityCache(void);
+
 /* g_items.c */
 void PrecacheItem(gitem_t *it);
 void InitItems(void);
@@ -623,12 +632,24 @@ qboolean KillBox(edict_t *ent);
 void G_ProjectSource(vec3_t point, vec3_t distance, vec3_t forward,
 		vec3_t right, vec3_t result);
 edict_t *G_Find(edict_t *from, int fieldofs, char *match);
+void G_InitEdictIndex(void);
+void G_ClearEdictIndex(void);
+void G_RebuildEdictIndex(void);
+void G_IndexEdict(edict_t *ent);
+void G_UnindexEdict(edict_t *ent);
+void G_RefileEdict(edict_t *ent);
+void G_SetClassname(edict_t *ent, char *classname);
+void G_SetTargetname(edict_t *ent, char *targetname);
 edict_t *findradius(edict_t *from, vec3_t org, float rad);
 edict_t *G_PickTarget(char *targetname);
 void G_UseTargets(edict_t *ent, edict_t *activator);
 void G_SetMovedir(vec3_t angles, vec3_t movedir);
 
 void G_InitEdict(edict_t *e);
+void G_InitFreeEdicts(void);
+void G_ClearFreeEdicts(void);
+void G_RebuildFreeEdicts(void);
+void G_EdictStats(void);
 edict_t *G_SpawnOptional(void);
 edict_t *G_Spawn(void);
 void G_FreeEdict(edict_t *e);
@@ -707,6 +728,7 @@ void BecomeExplosion1(edict_t *self);
 
 /* g_ai.c */
 void AI_SetSightClient(void);
+void AI_ClearSightCache(void);
 
 void ai_stand(edict_t *self, float dist);
 void ai_move(edict_t *self, float dist);
@@ -788,8 +810,29 @@ qboolean M_walkmove(edict_t *ent, float yaw, float dist);
 void M_MoveToGoal(edict_t *ent, float dist);
 void M_ChangeYaw(edict_t *ent);
 
+/* nav.c */
+void Nav_Init(void);
+void Nav_RunFrame(void);
+qboolean Nav_FollowPath(edict_t *ent, edict_t *goal, float dist);
+qboolean Nav_StartPath(edict_t *ent, edict_t *goal, float dist);
+void Nav_Stats(void);
+
 /* g_phys.c */
 void G_RunEntity(edict_t *ent);
+void G_InitThinkQueue(void);
+void G_ClearThinkQueue(void);
+void G_WakeEdict(edict_t *ent);
+void G_WakeDueEdicts(void);
+int G_NextAwakeEdict(int i);
+void G_SleepEdict(edict_t *ent);
+int G_SleepingEdicts(void);
+
+/* g_threads.c */
+void G_InitPretraces(void);
+void G_RunPretraces(void);
+qboolean G_Pretraced(edict_t *ent, vec3_t start, vec3_t end, int mask,
+		trace_t *trace);
+void G_ShutdownThreads(void);
 
 /* g_main.c */
 void SaveClientData(void);
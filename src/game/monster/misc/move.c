@@ -657,10 +657,16 @@ M_MoveToGoal(edict_t *ent, float dist)
 		return;
 	}
 
+	/* stay on the path of the navigation graph */
+	if (Nav_FollowPath(ent, goal, dist))
+	{
+		return;
+	}
+
 	/* bump around... */
 	if (((randk() & 3) == 1) || !SV_StepDirection(ent, ent->ideal_yaw, dist))
 	{
-		if (ent->inuse)
+		if (ent->inuse && !Nav_StartPath(ent, goal, dist))
 		{
 			SV_NewChaseDir(ent, goal, dist);
 		}
@@ -0,0 +1,661 @@
+/*
+ * Copyright (C) 1997-2001 Id Software, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * =======================================================================
+ *
+ * Navigation graph for ground monsters. The walkable floor is sampled
+ * on a grid while the level runs, starting at the places monsters ask
+ * paths from and to. A monster that is stuck searches a path with A*
+ * and follows it for a while.
+ *
+ * =======================================================================
+ */
+
+#include "../../header/local.h"
+
+#define STEPSIZE 18
+
+#define NAV_CELL 32
+#define NAV_MAX_NODES 16384
+#define NAV_HASH_SIZE 32768 /* power of two, twice NAV_MAX_NODES */
+#define NAV_EXPAND_PER_FRAME 16
+#define NAV_MAX_PATH 32
+#define NAV_MAX_SEARCH 4096
+#define NAV_PATH_TIME 2.0
+
+/* everything a walking monster can't pass */
+#define NAV_MASK (CONTENTS_SOLID | CONTENTS_MONSTERCLIP | CONTENTS_WINDOW)
+
+qboolean SV_StepDirection(edict_t *ent, float yaw, float dist);
+
+/* the graph is build for the hull of a soldier */
+static vec3_t nav_mins = {-16, -16, -24};
+static vec3_t nav_maxs = {16, 16, 32};
+
+static const int nav_dirs[8][2] = {
+	{1, 0}, {1, 1}, {0, 1}, {-1, 1}, {-1, 0}, {-1, -1}, {0, -1}, {1, -1}
+};
+
+typedef struct
+{
+	vec3_t origin; /* of a monster with nav_mins standing here */
+	int cell[2];
+	int links[8]; /* neighbour in each of nav_dirs, -1 if blocked */
+} navnode_t;
+
+typedef struct
+{
+	edict_t *goal;
+	int nodes[NAV_MAX_PATH];
+	int numnodes;
+	int current;
+	float time;
+} navpath_t;
+
+/* all of this is TAG_LEVEL memory */
+static navnode_t *nav_nodes;
+static int *nav_hash; /* node index + 1, 0 marks an empty slot */
+static navpath_t *nav_paths;
+static float *nav_cost;
+static float *nav_estimate;
+static int *nav_parent;
+static int *nav_visited;
+static int *nav_closed;
+static int *nav_heap;
+
+static int nav_numnodes;
+static int nav_expanded;
+static int nav_search;
+static int nav_heapsize;
+static int nav_route[NAV_MAX_SEARCH + 1];
+
+static int nav_searches;
+static int nav_failed;
+static int nav_steps;
+
+/*
+ * Forgets the graph. Called when a level is
+ * spawned or loaded, after the level memory
+ * was freed.
+ */
+void
+Nav_Init(void)
+{
+	nav_nodes = NULL;
+	nav_numnodes = 0;
+	nav_expanded = 0;
+	nav_search = 0;
+
+	nav_searches = 0;
+	nav_failed = 0;
+	nav_steps = 0;
+}
+
+static void
+Nav_Alloc(void)
+{
+	nav_nodes = gi.TagMalloc(NAV_MAX_NODES * sizeof(navnode_t), TAG_LEVEL);
+	nav_hash = gi.TagMalloc(NAV_HASH_SIZE * sizeof(int), TAG_LEVEL);
+	nav_paths = gi.TagMalloc(game.maxentities * sizeof(navpath_t), TAG_LEVEL);
+	nav_cost = gi.TagMalloc(NAV_MAX_NODES * sizeof(float), TAG_LEVEL);
+	nav_estimate = gi.TagMalloc(NAV_MAX_NODES * sizeof(float), TAG_LEVEL);
+	nav_parent = gi.TagMalloc(NAV_MAX_NODES * sizeof(int), TAG_LEVEL);
+	nav_visited = gi.TagMalloc(NAV_MAX_NODES * sizeof(int), TAG_LEVEL);
+	nav_closed = gi.TagMalloc(NAV_MAX_NODES * sizeof(int), TAG_LEVEL);
+	nav_heap = gi.TagMalloc(NAV_MAX_SEARCH * 8 * sizeof(int), TAG_LEVEL);
+}
+
+static unsigned
+Nav_HashCell(int x, int y)
+{
+	return ((unsigned)x * 73856093u ^ (unsigned)y * 19349663u) &
+		(NAV_HASH_SIZE - 1);
+}
+
+/*
+ * Returns the node in the given cell
+ * whose height is closest to z and
+ * between zmin and zmax, or -1.
+ */
+static int
+Nav_FindNode(int x, int y, float z, float zmin, float zmax)
+{
+	navnode_t *node;
+	unsigned h;
+	int i, best;
+
+	best = -1;
+
+	for (h = Nav_HashCell(x, y); (i = nav_hash[h]);
+		 h = (h + 1) & (NAV_HASH_SIZE - 1))
+	{
+		node = &nav_nodes[i - 1];
+
+		if ((node->cell[0] != x) || (node->cell[1] != y) ||
+			(node->origin[2] < zmin) || (node->origin[2] > zmax))
+		{
+			continue;
+		}
+
+		if ((best < 0) ||
+			(fabsf(node->origin[2] - z) < fabsf(nav_nodes[best].origin[2] - z)))
+		{
+			best = i - 1;
+		}
+	}
+
+	return best;
+}
+
+static int
+Nav_AddNode(vec3_t origin, int x, int y)
+{
+	navnode_t *node;
+	unsigned h;
+	int i;
+
+	if (nav_numnodes == NAV_MAX_NODES)
+	{
+		return -1;
+	}
+
+	node = &nav_nodes[nav_numnodes];
+	VectorCopy(origin, node->origin);
+	node->cell[0] = x;
+	node->cell[1] = y;
+
+	for (i = 0; i < 8; i++)
+	{
+		node->links[i] = -1;
+	}
+
+	for (h = Nav_HashCell(x, y); nav_hash[h]; h = (h + 1) & (NAV_HASH_SIZE - 1))
+	{
+	}
+
+	nav_hash[h] = ++nav_numnodes;
+
+	return nav_numnodes - 1;
+}
+
+/*
+ * Traces the monster hull. Doors that open
+ * for monsters by themself don't block.
+ */
+static trace_t
+Nav_Trace(vec3_t start, vec3_t end)
+{
+	trace_t trace;
+	edict_t *ent;
+
+	trace = gi.trace(start, nav_mins, nav_maxs, end, NULL, NAV_MASK);
+	ent = trace.ent;
+
+	if (ent && (ent != g_edicts) && (ent->solid == SOLID_BSP) &&
+		ent->classname && !strncmp(ent->classname, "func_door", 9) &&
+		!ent->targetname)
+	{
+		trace = gi.trace(start, nav_mins, nav_maxs, end, ent, NAV_MASK);
+	}
+
+	return trace;
+}
+
+/*
+ * Finds the floor below a point that's
+ * STEPSIZE over the expected height.
+ */
+static qboolean
+Nav_DropToFloor(vec3_t start, vec3_t spot)
+{
+	trace_t trace;
+	vec3_t end, bottom;
+
+	VectorCopy(start, end);
+	end[2] -= STEPSIZE * 2;
+
+	trace = Nav_Trace(start, end);
+
+	if (trace.allsolid || trace.startsolid || (trace.fraction == 1.0) ||
+		(trace.plane.normal[2] < 0.7))
+	{
+		return false;
+	}
+
+	/* don't lead monsters into lava or slime */
+	VectorCopy(trace.endpos, bottom);
+	bottom[2] += nav_mins[2] + 1;
+
+	if (gi.pointcontents(bottom) & (CONTENTS_LAVA | CONTENTS_SLIME))
+	{
+		return false;
+	}
+
+	VectorCopy(trace.endpos, spot);
+
+	return true;
+}
+
+/*
+ * Links a node with the walkable
+ * cells around it, adding nodes
+ * for cells not seen before.
+ */
+static void
+Nav_ExpandNode(int n)
+{
+	vec3_t start, end, spot;
+	trace_t trace;
+	int i, x, y, other;
+
+	for (i = 0; i < 8; i++)
+	{
+		x = nav_nodes[n].cell[0] + nav_dirs[i][0];
+		y = nav_nodes[n].cell[1] + nav_dirs[i][1];
+
+		VectorCopy(nav_nodes[n].origin, start);
+		start[2] += STEPSIZE;
+
+		end[0] = (x + 0.5f) * NAV_CELL;
+		end[1] = (y + 0.5f) * NAV_CELL;
+		end[2] = start[2];
+
+		trace = Nav_Trace(start, end);
+
+		if (trace.allsolid || trace.startsolid || (trace.fraction < 1.0))
+		{
+			continue;
+		}
+
+		if (!Nav_DropToFloor(end, spot))
+		{
+			continue;
+		}
+
+		other = Nav_FindNode(x, y, spot[2], spot[2] - STEPSIZE,
+				spot[2] + STEPSIZE);
+
+		if (other < 0)
+		{
+			other = Nav_AddNode(spot, x, y);
+		}
+
+		nav_nodes[n].links[i] = other;
+	}
+}
+
+/*
+ * Samples some more cells of the level.
+ * Called once each frame.
+ */
+void
+Nav_RunFrame(void)
+{
+	int i;
+
+	if (!g_monsternav->value)
+	{
+		return;
+	}
+
+	if (!nav_nodes)
+	{
+		Nav_Alloc();
+	}
+
+	for (i = 0; (i < NAV_EXPAND_PER_FRAME) && (nav_expanded < nav_numnodes); i++)
+	{
+		Nav_ExpandNode(nav_expanded++);
+	}
+}
+
+/*
+ * Returns the node an entity stands on.
+ * If the cell wasn't sampled yet and the
+ * entity is on ground, a node is added
+ * and the graph grows from there.
+ */
+static int
+Nav_NodeForEntity(edict_t *ent)
+{
+	vec3_t start, spot;
+	float z;
+	int x, y, i, n;
+
+	/* height of a soldier standing there */
+	z = ent->s.origin[2] + ent->mins[2] - nav_mins[2];
+	x = (int)floor(ent->s.origin[0] / NAV_CELL);
+	y = (int)floor(ent->s.origin[1] / NAV_CELL);
+
+	/* entities in the air are over the
+	   floor they are going to land on */
+	n = Nav_FindNode(x, y, z, z - (ent->groundentity ? STEPSIZE : 128),
+			z + STEPSIZE);
+
+	if (n >= 0)
+	{
+		return n;
+	}
+
+	for (i = 0; i < 8; i++)
+	{
+		n = Nav_FindNode(x + nav_dirs[i][0], y + nav_dirs[i][1], z,
+				z - STEPSIZE, z + STEPSIZE);
+
+		if (n >= 0)
+		{
+			return n;
+		}
+	}
+
+	if (!ent->groundentity)
+	{
+		return -1;
+	}
+
+	start[0] = (x + 0.5f) * NAV_CELL;
+	start[1] = (y + 0.5f) * NAV_CELL;
+	start[2] = z + STEPSIZE;
+
+	if (!Nav_DropToFloor(start, spot))
+	{
+		return -1;
+	}
+
+	return Nav_AddNode(spot, x, y);
+}
+
+static void
+Nav_HeapPush(int n)
+{
+	int i, parent;
+
+	if (nav_heapsize == NAV_MAX_SEARCH * 8)
+	{
+		return;
+	}
+
+	for (i = nav_heapsize++; i > 0; i = parent)
+	{
+		parent = (i - 1) / 2;
+
+		if (nav_estimate[nav_heap[parent]] <= nav_estimate[n])
+		{
+			break;
+		}
+
+		nav_heap[i] = nav_heap[parent];
+	}
+
+	nav_heap[i] = n;
+}
+
+static int
+Nav_HeapPop(void)
+{
+	int top, last, i, child;
+
+	top = nav_heap[0];
+	last = nav_heap[--nav_heapsize];
+
+	for (i = 0; (child = i * 2 + 1) < nav_heapsize; i = child)
+	{
+		if ((child + 1 < nav_heapsize) &&
+			(nav_estimate[nav_heap[child + 1]] < nav_estimate[nav_heap[child]]))
+		{
+			child++;
+		}
+
+		if (nav_estimate[last] <= nav_estimate[nav_heap[child]])
+		{
+			break;
+		}
+
+		nav_heap[i] = nav_heap[child];
+	}
+
+	nav_heap[i] = last;
+
+	return top;
+}
+
+/*
+ * A* search from start to goal. Writes the
+ * first nodes of the path, start included,
+ * and returns their count or 0 if the goal
+ * wasn't reached.
+ */
+static int
+Nav_Search(int start, int goal, int *path, int maxpath)
+{
+	vec3_t delta;
+	float cost;
+	int n, i, other, closed, len;
+
+	nav_search++;
+	nav_heapsize = 0;
+	nav_searches++;
+
+	nav_visited[start] = nav_search;
+	nav_cost[start] = 0;
+	nav_parent[start] = -1;
+	VectorSubtract(nav_nodes[goal].origin, nav_nodes[start].origin, delta);
+	nav_estimate[start] = VectorLength(delta);
+	Nav_HeapPush(start);
+
+	closed = 0;
+
+	while (nav_heapsize && (closed < NAV_MAX_SEARCH))
+	{
+		n = Nav_HeapPop();
+
+		if (nav_closed[n] == nav_search)
+		{
+			continue;
+		}
+
+		nav_closed[n] = nav_search;
+		closed++;
+
+		if (n == goal)
+		{
+			break;
+		}
+
+		for (i = 0; i < 8; i++)
+		{
+			other = nav_nodes[n].links[i];
+
+			if ((other < 0) || (nav_closed[other] == nav_search))
+			{
+				continue;
+			}
+
+			VectorSubtract(nav_nodes[other].origin, nav_nodes[n].origin, delta);
+			cost = nav_cost[n] + VectorLength(delta);
+
+			if ((nav_visited[other] == nav_search) && (nav_cost[other] <= cost))
+			{
+				continue;
+			}
+
+			nav_visited[other] = nav_search;
+			nav_cost[other] = cost;
+			nav_parent[other] = n;
+			VectorSubtract(nav_nodes[goal].origin, nav_nodes[other].origin, delta);
+			nav_estimate[other] = cost + VectorLength(delta);
+			Nav_HeapPush(other);
+		}
+	}
+
+	if (nav_closed[goal] != nav_search)
+	{
+		nav_failed++;
+		return 0;
+	}
+
+	/* the route is found backwards */
+	for (len = 0, n = goal; (n >= 0) && (len <= NAV_MAX_SEARCH); n = nav_parent[n])
+	{
+		nav_route[len++] = n;
+	}
+
+	for (i = 0; (i < len) && (i < maxpath); i++)
+	{
+		path[i] = nav_route[len - 1 - i];
+	}
+
+	return i;
+}
+
+/*
+ * Steps towards the next node of the path,
+ * advancing when a node is reached.
+ */
+static qboolean
+Nav_StepPath(edict_t *ent, navpath_t *path, float dist)
+{
+	vec3_t delta;
+	float len;
+
+	while (path->current < path->numnodes)
+	{
+		VectorSubtract(nav_nodes[path->nodes[path->current]].origin,
+				ent->s.origin, delta);
+		delta[2] = 0;
+		len = VectorLength(delta);
+
+		/* too far away, pushed or teleported */
+		if (len > NAV_CELL * 3)
+		{
+			break;
+		}
+
+		/* step right onto the node, cutting
+		   corners runs into walls */
+		if (len > 1)
+		{
+			if (SV_StepDirection(ent, vectoyaw(delta), (len < dist) ? len : dist))
+			{
+				nav_steps++;
+				return true;
+			}
+
+			break;
+		}
+
+		path->current++;
+	}
+
+	path->numnodes = 0;
+
+	return false;
+}
+
+/*
+ * Keeps a monster on the path it
+ * follows. Returns false if it has
+ * none or the path ended.
+ */
+qboolean
+Nav_FollowPath(edict_t *ent, edict_t *goal, float dist)
+{
+	navpath_t *path;
+
+	if (!g_monsternav->value || !nav_nodes || !ent || !goal)
+	{
+		return false;
+	}
+
+	path = &nav_paths[ent - g_edicts];
+
+	if ((path->goal != goal) || !path->numnodes ||
+		(level.time > path->time + NAV_PATH_TIME))
+	{
+		return false;
+	}
+
+	return Nav_StepPath(ent, path, dist);
+}
+
+/*
+ * Searches a path for a monster that
+ * is stuck and takes the first step.
+ */
+qboolean
+Nav_StartPath(edict_t *ent, edict_t *goal, float dist)
+{
+	navpath_t *path;
+	int start, end;
+
+	if (!g_monsternav->value || !nav_nodes || !ent || !goal)
+	{
+		return false;
+	}
+
+	if (ent->flags & (FL_FLY | FL_SWIM))
+	{
+		return false;
+	}
+
+	path = &nav_paths[ent - g_edicts];
+
+	/* don't search again and again
+	   for a goal that's unreachable */
+	if ((path->goal == goal) && (level.time <= path->time + NAV_PATH_TIME))
+	{
+		return false;
+	}
+
+	path->goal = goal;
+	path->time = level.time;
+	path->numnodes = 0;
+	path->current = 1;
+
+	start = Nav_NodeForEntity(ent);
+	end = Nav_NodeForEntity(goal);
+
+	if ((start < 0) || (end < 0) || (start == end))
+	{
+		return false;
+	}
+
+	path->numnodes = Nav_Search(start, end, path->nodes, NAV_MAX_PATH);
+
+	return Nav_StepPath(ent, path, dist);
+}
+
+/*
+ * Prints the size of the graph and
+ * how much it was used.
+ */
+void
+Nav_Stats(void)
+{
+	if (!nav_nodes)
+	{
+		gi.cprintf(NULL, PRINT_HIGH, "No navigation graph, g_monsternav is 0.\n");
+		return;
+	}
+
+	gi.cprintf(NULL, PRINT_HIGH, "%i nodes, %i not yet sampled, %i max\n",
+			nav_numnodes, nav_numnodes - nav_expanded, NAV_MAX_NODES);
+	gi.cprintf(NULL, PRINT_HIGH, "%i path searches, %i failed, %i steps along paths\n",
+			nav_searches, nav_failed, nav_steps);
+}
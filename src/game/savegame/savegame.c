@@ -65,6 +65,7 @@
  */
 
 #include "../header/local.h"
+#include "../../common/unzip/miniz.h"
 
 /*
  * When ever the savegame version is changed, q2 will refuse to
@@ -150,6 +151,56 @@ typedef struct
     char arch[32];
 } savegameHeader_t;
 
+/*
+ * Level files are written as one
+ * deflated block behind this header.
+ * Files starting with the edict size
+ * instead of the ident are in the old
+ * uncompressed format and still load.
+ */
+#define LEVELHEADER (('L' << 24) + ('Q' << 16) + ('2' << 8) + 'Y') /* little-endian "Y2QL" */
+#define LEVELVERSION 1
+
+typedef struct
+{
+	int ident;
+	int version;
+	int edictsize;
+	int rawsize;
+	int packedsize;
+} levelHeader_t;
+
+/*
+ * The savegame helpers write either
+ * straight into a file or, when f is
+ * NULL, into a growing memory buffer.
+ */
+typedef struct
+{
+	FILE *f;
+	byte *data;
+	size_t cursize;
+	size_t maxsize;
+	size_t readcount;
+} savefile_t;
+
+/*
+ * The last written record of each
+ * edict. An edict that didn't change
+ * since the last save is written by
+ * copying its record.
+ */
+typedef struct
+{
+	edict_t snapshot;
+	byte *record;
+	int recordlen;
+	int recordsize;
+} savecache_t;
+
+static savecache_t *save_cache;
+static savefile_t save_levelbuf;
+
 /* ========================================================= */
 
 /*
@@ -185,6 +236,8 @@ mmoveList_t mmoveList[] = {
 	#include "tables/gamemmove_list.h"
 };
 
+static void InitSaveTables(void);
+
 /*
  * Fields to be saved
  */
@@ -221,6 +274,9 @@ InitGame(void)
 	gi.dprintf("Game is starting up.\n");
 	gi.dprintf("Game is %s built on %s.\n", GAMEVERSION, BUILD_DATE);
 
+	InitSaveTables();
+	save_cache = NULL;
+
 	gun_x = gi.cvar("gun_x", "0", 0);
 	gun_y = gi.cvar("gun_y", "0", 0);
 	gun_z = gi.cvar("gun_z", "0", 0);
@@ -274,9 +330,15 @@ InitGame(void)
 	/* others */
 	aimfix = gi.cvar("aimfix", "0", CVAR_ARCHIVE);
 	g_machinegun_norecoil = gi.cvar("g_machinegun_norecoil", "0", CVAR_ARCHIVE);
+	g_entitycache = gi.cvar("g_entitycache", "0", CVAR_ARCHIVE);
+	g_monsternav = gi.cvar("g_monsternav", "0", CVAR_ARCHIVE);
+	g_thinkqueue = gi.cvar("g_thinkqueue", "1", CVAR_ARCHIVE);
+	g_radiuscheck = gi.cvar("g_radiuscheck", "0", 0);
+	g_threads = gi.cvar("g_threads", "0", CVAR_ARCHIVE);
 
 	/* items */
 	InitItems();
+	ED_InitSpawnTables();
 
 	game.helpmessage1[0] = 0;
 	game.helpmessage2[0] = 0;
@@ -286,6 +348,10 @@ InitGame(void)
 	g_edicts = gi.TagMalloc(game.maxentities * sizeof(g_edicts[0]), TAG_GAME);
 	globals.edicts = g_edicts;
 	globals.max_edicts = game.maxentities;
+	G_InitEdictIndex();
+	G_InitFreeEdicts();
+	G_InitThinkQueue();
+	G_InitPretraces();
 
 	/* initialize all clients for this game */
 	game.maxclients = maxclients->value;
@@ -295,6 +361,128 @@ InitGame(void)
 
 /* ========================================================= */
 
+/*
+ * Hash tables over the function and
+ * mmove_t lists, indexed by pointer
+ * and by name. Each slot holds the
+ * list index + 1, 0 marks an empty
+ * slot. Built once by InitGame().
+ */
+#define SAVE_HASH_SIZE 4096
+
+static int functionsByAddress[SAVE_HASH_SIZE];
+static int functionsByName[SAVE_HASH_SIZE];
+static int mmovesByAddress[SAVE_HASH_SIZE];
+static int mmovesByName[SAVE_HASH_SIZE];
+
+static unsigned
+HashAddress(const void *adr)
+{
+	size_t v = (size_t)adr;
+
+	v ^= v >> 16;
+	return (unsigned)(v * 2654435761u) & (SAVE_HASH_SIZE - 1);
+}
+
+static unsigned
+HashName(const char *name)
+{
+	unsigned hash = 5381;
+
+	while (*name)
+	{
+		hash = hash * 33 + (unsigned char)*name++;
+	}
+
+	return hash & (SAVE_HASH_SIZE - 1);
+}
+
+/*
+ * Fills the hash tables. Duplicates
+ * aren't inserted, so lookups return
+ * the first entry of the lists like
+ * a linear search did.
+ */
+static void
+InitSaveTables(void)
+{
+	unsigned h;
+	int i, j;
+
+	if ((sizeof(functionList) / sizeof(functionList[0]) > SAVE_HASH_SIZE / 2) ||
+		(sizeof(mmoveList) / sizeof(mmoveList[0]) > SAVE_HASH_SIZE / 2))
+	{
+		gi.error("InitSaveTables: SAVE_HASH_SIZE too small");
+	}
+
+	memset(functionsByAddress, 0, sizeof(functionsByAddress));
+	memset(functionsByName, 0, sizeof(functionsByName));
+	memset(mmovesByAddress, 0, sizeof(mmovesByAddress));
+	memset(mmovesByName, 0, sizeof(mmovesByName));
+
+	for (i = 0; functionList[i].funcStr; i++)
+	{
+		for (h = HashAddress(functionList[i].funcPtr); (j = functionsByAddress[h]);
+			 h = (h + 1) & (SAVE_HASH_SIZE - 1))
+		{
+			if (functionList[j - 1].funcPtr == functionList[i].funcPtr)
+			{
+				break;
+			}
+		}
+
+		if (!j)
+		{
+			functionsByAddress[h] = i + 1;
+		}
+
+		for (h = HashName(functionList[i].funcStr); (j = functionsByName[h]);
+			 h = (h + 1) & (SAVE_HASH_SIZE - 1))
+		{
+			if (!strcmp(functionList[j - 1].funcStr, functionList[i].funcStr))
+			{
+				break;
+			}
+		}
+
+		if (!j)
+		{
+			functionsByName[h] = i + 1;
+		}
+	}
+
+	for (i = 0; mmoveList[i].mmoveStr; i++)
+	{
+		for (h = HashAddress(mmoveList[i].mmovePtr); (j = mmovesByAddress[h]);
+			 h = (h + 1) & (SAVE_HASH_SIZE - 1))
+		{
+			if (mmoveList[j - 1].mmovePtr == mmoveList[i].mmovePtr)
+			{
+				break;
+			}
+		}
+
+		if (!j)
+		{
+			mmovesByAddress[h] = i + 1;
+		}
+
+		for (h = HashName(mmoveList[i].mmoveStr); (j = mmovesByName[h]);
+			 h = (h + 1) & (SAVE_HASH_SIZE - 1))
+		{
+			if (!strcmp(mmoveList[j - 1].mmoveStr, mmoveList[i].mmoveStr))
+			{
+				break;
+			}
+		}
+
+		if (!j)
+		{
+			mmovesByName[h] = i + 1;
+		}
+	}
+}
+
 /*
  * Helper function to get
  * the human readable function
@@ -305,13 +493,15 @@ InitGame(void)
 functionList_t *
 GetFunctionByAddress(byte *adr)
 {
+	unsigned h;
 	int i;
 
-	for (i = 0; functionList[i].funcStr; i++)
+	for (h = HashAddress(adr); (i = functionsByAddress[h]);
+		 h = (h + 1) & (SAVE_HASH_SIZE - 1))
 	{
-		if (functionList[i].funcPtr == adr)
+		if (functionList[i - 1].funcPtr == adr)
 		{
-			return &functionList[i];
+			return &functionList[i - 1];
 		}
 	}
 
@@ -328,13 +518,15 @@ GetFunctionByAddress(byte *adr)
 byte *
 FindFunctionByName(char *name)
 {
+	unsigned h;
 	int i;
 
-	for (i = 0; functionList[i].funcStr; i++)
+	for (h = HashName(name); (i = functionsByName[h]);
+		 h = (h + 1) & (SAVE_HASH_SIZE - 1))
 	{
-		if (!strcmp(name, functionList[i].funcStr))
+		if (!strcmp(name, functionList[i - 1].funcStr))
 		{
-			return functionList[i].funcPtr;
+			return functionList[i - 1].funcPtr;
 		}
 	}
 
@@ -349,13 +541,15 @@ FindFunctionByName(char *name)
 mmoveList_t *
 GetMmoveByAddress(mmove_t *adr)
 {
+	unsigned h;
 	int i;
 
-	for (i = 0; mmoveList[i].mmoveStr; i++)
+	for (h = HashAddress(adr); (i = mmovesByAddress[h]);
+		 h = (h + 1) & (SAVE_HASH_SIZE - 1))
 	{
-		if (mmoveList[i].mmovePtr == adr)
+		if (mmoveList[i - 1].mmovePtr == adr)
 		{
-			return &mmoveList[i];
+			return &mmoveList[i - 1];
 		}
 	}
 
@@ -370,13 +564,15 @@ GetMmoveByAddress(mmove_t *adr)
 mmove_t *
 FindMmoveByName(char *name)
 {
+	unsigned h;
 	int i;
 
-	for (i = 0; mmoveList[i].mmoveStr; i++)
+	for (h = HashName(name); (i = mmovesByName[h]);
+		 h = (h + 1) & (SAVE_HASH_SIZE - 1))
 	{
-		if (!strcmp(name, mmoveList[i].mmoveStr))
+		if (!strcmp(name, mmoveList[i - 1].mmoveStr))
 		{
-			return mmoveList[i].mmovePtr;
+			return mmoveList[i - 1].mmovePtr;
 		}
 	}
 
@@ -384,6 +580,65 @@ FindMmoveByName(char *name)
 }
 
 
+/* ========================================================= */
+
+static void
+WriteBlock(savefile_t *f, const void *data, size_t len)
+{
+	size_t newsize;
+	byte *newdata;
+
+	if (f->f)
+	{
+		fwrite(data, len, 1, f->f);
+		return;
+	}
+
+	if (f->cursize + len > f->maxsize)
+	{
+		newsize = f->maxsize ? f->maxsize : 0x10000;
+
+		while (f->cursize + len > newsize)
+		{
+			newsize *= 2;
+		}
+
+		newdata = realloc(f->data, newsize);
+
+		if (!newdata)
+		{
+			gi.error("WriteBlock: couldn't allocate %i bytes", (int)newsize);
+		}
+
+		f->data = newdata;
+		f->maxsize = newsize;
+	}
+
+	memcpy(f->data + f->cursize, data, len);
+	f->cursize += len;
+}
+
+static qboolean
+ReadBlock(savefile_t *f, void *data, size_t len)
+{
+	if (f->f)
+	{
+		return fread(data, len, 1, f->f) == 1;
+	}
+
+	if (f->readcount + len > f->cursize)
+	{
+		memset(data, 0, len);
+		f->readcount = f->cursize;
+		return false;
+	}
+
+	memcpy(data, f->data + f->readcount, len);
+	f->readcount += len;
+
+	return true;
+}
+
 /* ========================================================= */
 
 /*
@@ -393,7 +648,7 @@ FindMmoveByName(char *name)
  * below this block into files.
  */
 void
-WriteField1(FILE *f, field_t *field, byte *base)
+WriteField1(savefile_t *f, field_t *field, byte *base)
 {
 	void *p;
 	int len;
@@ -516,7 +771,7 @@ WriteField1(FILE *f, field_t *field, byte *base)
 }
 
 void
-WriteField2(FILE *f, field_t *field, byte *base)
+WriteField2(savefile_t *f, field_t *field, byte *base)
 {
 	int len;
 	void *p;
@@ -537,7 +792,7 @@ WriteField2(FILE *f, field_t *field, byte *base)
 			if (*(char **)p)
 			{
 				len = strlen(*(char **)p) + 1;
-				fwrite(*(char **)p, len, 1, f);
+				WriteBlock(f, *(char **)p, len);
 			}
 
 			break;
@@ -553,7 +808,7 @@ WriteField2(FILE *f, field_t *field, byte *base)
 				}
 
 				len = strlen(func->funcStr)+1;
-				fwrite (func->funcStr, len, 1, f);
+				WriteBlock(f, func->funcStr, len);
 			}
 
 			break;
@@ -568,7 +823,7 @@ WriteField2(FILE *f, field_t *field, byte *base)
 				}
 
 				len = strlen(mmove->mmoveStr)+1;
-				fwrite (mmove->mmoveStr, len, 1, f);
+				WriteBlock(f, mmove->mmoveStr, len);
 			}
 
 			break;
@@ -587,7 +842,7 @@ WriteField2(FILE *f, field_t *field, byte *base)
  * below
  */
 void
-ReadField(FILE *f, field_t *field, byte *base)
+ReadField(savefile_t *f, field_t *field, byte *base)
 {
 	void *p;
 	int len;
@@ -620,7 +875,7 @@ ReadField(FILE *f, field_t *field, byte *base)
 			else
 			{
 				*(char **)p = gi.TagMalloc(32 + len, TAG_LEVEL);
-				fread(*(char **)p, len, 1, f);
+				ReadBlock(f, *(char **)p, len);
 			}
 
 			break;
@@ -678,7 +933,7 @@ ReadField(FILE *f, field_t *field, byte *base)
 							(int)sizeof(funcStr));
 				}
 
-				fread (funcStr, len, 1, f);
+				ReadBlock(f, funcStr, len);
 
 				if ( !(*(byte **)p = FindFunctionByName (funcStr)) )
 				{
@@ -702,7 +957,7 @@ ReadField(FILE *f, field_t *field, byte *base)
 							(int)sizeof(funcStr));
 				}
 
-				fread (funcStr, len, 1, f);
+				ReadBlock(f, funcStr, len);
 
 				if ( !(*(mmove_t **)p = FindMmoveByName (funcStr)) )
 				{
@@ -722,7 +977,7 @@ ReadField(FILE *f, field_t *field, byte *base)
  * Write the client struct into a file.
  */
 void
-WriteClient(FILE *f, gclient_t *client)
+WriteClient(savefile_t *f, gclient_t *client)
 {
 	field_t *field;
 	gclient_t temp;
@@ -737,7 +992,7 @@ WriteClient(FILE *f, gclient_t *client)
 	}
 
 	/* write the block */
-	fwrite(&temp, sizeof(temp), 1, f);
+	WriteBlock(f, &temp, sizeof(temp));
 
 	/* now write any allocated data following the edict */
 	for (field = clientfields; field->name; field++)
@@ -750,11 +1005,11 @@ WriteClient(FILE *f, gclient_t *client)
  * Read the client struct from a file
  */
 void
-ReadClient(FILE *f, gclient_t *client, short save_ver)
+ReadClient(savefile_t *f, gclient_t *client, short save_ver)
 {
 	field_t *field;
 
-	fread(client, sizeof(*client), 1, f);
+	ReadBlock(f, client, sizeof(*client));
 
 	for (field = clientfields; field->name; field++)
 	{
@@ -785,6 +1040,7 @@ void
 WriteGame(const char *filename, qboolean autosave)
 {
 	savegameHeader_t sv;
+	savefile_t sf;
 	FILE *f;
 	int i;
 
@@ -814,9 +1070,12 @@ WriteGame(const char *filename, qboolean autosave)
 	fwrite(&game, sizeof(game), 1, f);
 	game.autosaved = false;
 
+	memset(&sf, 0, sizeof(sf));
+	sf.f = f;
+
 	for (i = 0; i < game.maxclients; i++)
 	{
-		WriteClient(f, &game.clients[i]);
+		WriteClient(&sf, &game.clients[i]);
 	}
 
 	fclose(f);
@@ -831,12 +1090,14 @@ void
 ReadGame(const char *filename)
 {
 	savegameHeader_t sv;
+	savefile_t sf;
 	FILE *f;
 	int i;
 
 	short save_ver = 0;
 
 	gi.FreeTags(TAG_GAME);
+	save_cache = NULL;
 
 	f = Q_fopen(filename, "rb");
 
@@ -931,14 +1192,21 @@ ReadGame(const char *filename)
 
 	g_edicts = gi.TagMalloc(game.maxentities * sizeof(g_edicts[0]), TAG_GAME);
 	globals.edicts = g_edicts;
+	G_InitEdictIndex();
+	G_InitFreeEdicts();
+	G_InitThinkQueue();
+	G_InitPretraces();
 
 	fread(&game, sizeof(game), 1, f);
 	game.clients = gi.TagMalloc(game.maxclients * sizeof(game.clients[0]),
 			TAG_GAME);
 
+	memset(&sf, 0, sizeof(sf));
+	sf.f = f;
+
 	for (i = 0; i < game.maxclients; i++)
 	{
-		ReadClient(f, &game.clients[i], save_ver);
+		ReadClient(&sf, &game.clients[i], save_ver);
 	}
 
 	fclose(f);
@@ -952,7 +1220,7 @@ ReadGame(const char *filename)
  * WriteLevel.
  */
 void
-WriteEdict(FILE *f, edict_t *ent)
+WriteEdict(savefile_t *f, edict_t *ent)
 {
 	field_t *field;
 	edict_t temp;
@@ -967,7 +1235,7 @@ WriteEdict(FILE *f, edict_t *ent)
 	}
 
 	/* write the block */
-	fwrite(&temp, sizeof(temp), 1, f);
+	WriteBlock(f, &temp, sizeof(temp));
 
 	/* now write any allocated data following the edict */
 	for (field = fields; field->name; field++)
@@ -982,7 +1250,7 @@ WriteEdict(FILE *f, edict_t *ent)
  * Called by WriteLevel.
  */
 void
-WriteLevelLocals(FILE *f)
+WriteLevelLocals(savefile_t *f)
 {
 	field_t *field;
 	level_locals_t temp;
@@ -997,7 +1265,7 @@ WriteLevelLocals(FILE *f)
 	}
 
 	/* write the block */
-	fwrite(&temp, sizeof(temp), 1, f);
+	WriteBlock(f, &temp, sizeof(temp));
 
 	/* now write any allocated data following the edict */
 	for (field = levelfields; field->name; field++)
@@ -1006,30 +1274,144 @@ WriteLevelLocals(FILE *f)
 	}
 }
 
+/*
+ * Checks if the strings of an edict
+ * still match the ones stored in its
+ * cached record. Some entities, like
+ * func_clock, change their strings
+ * in place.
+ */
+static qboolean
+CachedStringsMatch(edict_t *ent, savecache_t *cache)
+{
+	field_t *field;
+	char *str;
+	int ofs;
+	int len;
+
+	ofs = sizeof(edict_t);
+
+	for (field = fields; field->name; field++)
+	{
+		if (field->flags & FFL_SPAWNTEMP)
+		{
+			continue;
+		}
+
+		switch (field->type)
+		{
+			case F_LSTRING:
+				str = *(char **)((byte *)ent + field->ofs);
+				len = *(int *)(cache->record + field->ofs);
+
+				if (str && strcmp(str, (char *)cache->record + ofs))
+				{
+					return false;
+				}
+
+				ofs += len;
+				break;
+			case F_FUNCTION:
+			case F_MMOVE:
+				ofs += *(int *)(cache->record + field->ofs);
+				break;
+			default:
+				break;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Writes an edict into a memory
+ * stream. If the edict wasn't
+ * changed since the last save
+ * the cached record is copied,
+ * otherwise it's written again
+ * and the cache is updated.
+ */
+static void
+WriteCachedEdict(savefile_t *f, int entnum, edict_t *ent)
+{
+	savecache_t *cache;
+	edict_t temp;
+	size_t start;
+	int len;
+
+	if (!save_cache)
+	{
+		save_cache = gi.TagMalloc(game.maxentities * sizeof(savecache_t),
+				TAG_GAME);
+	}
+
+	cache = &save_cache[entnum];
+
+	/* the world links are rebuild on load */
+	memcpy(&temp, ent, sizeof(temp));
+	memset(&temp.area, 0, sizeof(temp.area));
+
+	if (cache->record && !memcmp(&temp, &cache->snapshot, sizeof(temp)) &&
+		CachedStringsMatch(ent, cache))
+	{
+		WriteBlock(f, cache->record, cache->recordlen);
+		return;
+	}
+
+	start = f->cursize;
+	WriteEdict(f, ent);
+	len = f->cursize - start;
+
+	if (len > cache->recordsize)
+	{
+		if (cache->record)
+		{
+			gi.TagFree(cache->record);
+		}
+
+		cache->record = gi.TagMalloc(len, TAG_GAME);
+		cache->recordsize = len;
+	}
+
+	memcpy(cache->record, f->data + start, len);
+	cache->recordlen = len;
+	memcpy(&cache->snapshot, &temp, sizeof(temp));
+}
+
+/*
+ * Releases the buffer WriteLevel()
+ * keeps between saves. Called when
+ * the game library is shut down.
+ */
+void
+FreeLevelBuffer(void)
+{
+	free(save_levelbuf.data);
+	memset(&save_levelbuf, 0, sizeof(save_levelbuf));
+}
+
 /*
  * Writes the current level
- * into a file.
+ * into a file. The level is
+ * build in memory and written
+ * as one compressed block.
  */
 void
 WriteLevel(const char *filename)
 {
-	int i;
+	levelHeader_t header;
+	savefile_t *sf;
+	void *packed;
+	size_t packedlen;
 	edict_t *ent;
 	FILE *f;
+	int i;
 
-	f = Q_fopen(filename, "wb");
-
-	if (!f)
-	{
-		gi.error("Couldn't open %s", filename);
-	}
-
-	/* write out edict size for checking */
-	i = sizeof(edict_t);
-	fwrite(&i, sizeof(i), 1, f);
+	sf = &save_levelbuf;
+	sf->cursize = 0;
 
 	/* write out level_locals_t */
-	WriteLevelLocals(f);
+	WriteLevelLocals(sf);
 
 	/* write out all the entities */
 	for (i = 0; i < globals.num_edicts; i++)
@@ -1041,14 +1423,42 @@ WriteLevel(const char *filename)
 			continue;
 		}
 
-		fwrite(&i, sizeof(i), 1, f);
-		WriteEdict(f, ent);
+		WriteBlock(sf, &i, sizeof(i));
+		WriteCachedEdict(sf, i, ent);
 	}
 
 	i = -1;
-	fwrite(&i, sizeof(i), 1, f);
+	WriteBlock(sf, &i, sizeof(i));
+
+	/* a fast setting is enough, most of the
+	   level are zeros and repeated records */
+	packed = tdefl_compress_mem_to_heap(sf->data, sf->cursize, &packedlen,
+			TDEFL_WRITE_ZLIB_HEADER | TDEFL_GREEDY_PARSING_FLAG | 16);
+
+	if (!packed)
+	{
+		gi.error("WriteLevel: couldn't compress %s", filename);
+	}
+
+	f = Q_fopen(filename, "wb");
+
+	if (!f)
+	{
+		mz_free(packed);
+		gi.error("Couldn't open %s", filename);
+	}
+
+	header.ident = LEVELHEADER;
+	header.version = LEVELVERSION;
+	header.edictsize = sizeof(edict_t);
+	header.rawsize = sf->cursize;
+	header.packedsize = packedlen;
+
+	fwrite(&header, sizeof(header), 1, f);
+	fwrite(packed, packedlen, 1, f);
 
 	fclose(f);
+	mz_free(packed);
 }
 
 /* ========================================================== */
@@ -1060,11 +1470,11 @@ WriteLevel(const char *filename)
  * by ReadLevel.
  */
 void
-ReadEdict(FILE *f, edict_t *ent)
+ReadEdict(savefile_t *f, edict_t *ent)
 {
 	field_t *field;
 
-	fread(ent, sizeof(*ent), 1, f);
+	ReadBlock(f, ent, sizeof(*ent));
 
 	for (field = fields; field->name; field++)
 	{
@@ -1079,11 +1489,11 @@ ReadEdict(FILE *f, edict_t *ent)
  * Called by ReadLevel.
  */
 void
-ReadLevelLocals(FILE *f)
+ReadLevelLocals(savefile_t *f)
 {
 	field_t *field;
 
-	fread(&level, sizeof(level), 1, f);
+	ReadBlock(f, &level, sizeof(level));
 
 	for (field = levelfields; field->name; field++)
 	{
@@ -1103,6 +1513,10 @@ ReadLevelLocals(FILE *f)
 void
 ReadLevel(const char *filename)
 {
+	levelHeader_t header;
+	savefile_t sf;
+	void *packed;
+	size_t rawlen;
 	int entnum;
 	FILE *f;
 	int i;
@@ -1121,26 +1535,84 @@ ReadLevel(const char *filename)
 
 	/* wipe all the entities */
 	memset(g_edicts, 0, game.maxentities * sizeof(g_edicts[0]));
+	G_ClearEdictIndex();
+	G_ClearFreeEdicts();
+	G_ClearThinkQueue();
+	AI_ClearSightCache();
+	Nav_Init();
 	globals.num_edicts = maxclients->value + 1;
 
-	/* check edict size */
-	fread(&i, sizeof(i), 1, f);
+	memset(&sf, 0, sizeof(sf));
+	memset(&header, 0, sizeof(header));
+
+	/* old level files start with the
+	   edict size, new ones with the
+	   ident of the compressed format */
+	fread(&header.ident, sizeof(header.ident), 1, f);
 
-	if (i != sizeof(edict_t))
+	if (header.ident == LEVELHEADER)
+	{
+		fread(&header.version, sizeof(header) - sizeof(header.ident), 1, f);
+
+		if (header.version != LEVELVERSION)
+		{
+			fclose(f);
+			gi.error("ReadLevel: unsupported level version %i", header.version);
+		}
+
+		if (header.edictsize != sizeof(edict_t))
+		{
+			fclose(f);
+			gi.error("ReadLevel: mismatched edict size");
+		}
+
+		packed = (header.packedsize > 0) ? malloc(header.packedsize) : NULL;
+
+		if (!packed || (fread(packed, header.packedsize, 1, f) != 1))
+		{
+			free(packed);
+			fclose(f);
+			gi.error("ReadLevel: failed to read %s", filename);
+		}
+
+		fclose(f);
+
+		sf.data = tinfl_decompress_mem_to_heap(packed, header.packedsize,
+				&rawlen, TINFL_FLAG_PARSE_ZLIB_HEADER);
+		free(packed);
+
+		if (!sf.data || (rawlen != (size_t)header.rawsize))
+		{
+			mz_free(sf.data);
+			gi.error("ReadLevel: %s is corrupt", filename);
+		}
+
+		sf.cursize = rawlen;
+	}
+	else if (header.ident == sizeof(edict_t))
+	{
+		sf.f = f;
+	}
+	else
 	{
 		fclose(f);
 		gi.error("ReadLevel: mismatched edict size");
 	}
 
 	/* load the level locals */
-	ReadLevelLocals(f);
+	ReadLevelLocals(&sf);
 
 	/* load all the entities */
 	while (1)
 	{
-		if (fread(&entnum, sizeof(entnum), 1, f) != 1)
+		if (!ReadBlock(&sf, &entnum, sizeof(entnum)))
 		{
-			fclose(f);
+			if (sf.f)
+			{
+				fclose(sf.f);
+			}
+
+			mz_free(sf.data);
 			gi.error("ReadLevel: failed to read entnum");
 		}
 
@@ -1155,14 +1627,22 @@ ReadLevel(const char *filename)
 		}
 
 		ent = &g_edicts[entnum];
-		ReadEdict(f, ent);
+		ReadEdict(&sf, ent);
 
 		/* let the server rebuild world links for this ent */
 		memset(&ent->area, 0, sizeof(ent->area));
 		gi.linkentity(ent);
 	}
 
-	fclose(f);
+	if (sf.f)
+	{
+		fclose(sf.f);
+	}
+
+	mz_free(sf.data);
+
+	G_RebuildEdictIndex();
+	G_RebuildFreeEdicts();
 
 	/* mark all clients as unconnected */
 	for (i = 0; i < maxclients->value; i++)
@@ -26,18 +26,18 @@
  */
 
 extern void ReadLevel ( const char * filename ) ;
-extern void ReadLevelLocals ( FILE * f ) ;
-extern void ReadEdict ( FILE * f , edict_t * ent ) ;
+extern void ReadLevelLocals ( savefile_t * f ) ;
+extern void ReadEdict ( savefile_t * f , edict_t * ent ) ;
 extern void WriteLevel ( const char * filename ) ;
-extern void WriteLevelLocals ( FILE * f ) ;
-extern void WriteEdict ( FILE * f , edict_t * ent ) ;
+extern void WriteLevelLocals ( savefile_t * f ) ;
+extern void WriteEdict ( savefile_t * f , edict_t * ent ) ;
 extern void ReadGame ( const char * filename ) ;
 extern void WriteGame ( const char * filename , qboolean autosave ) ;
-extern void ReadClient ( FILE * f , gclient_t * client , short save_ver ) ;
-extern void WriteClient ( FILE * f , gclient_t * client ) ;
-extern void ReadField ( FILE * f , field_t * field , byte * base ) ;
-extern void WriteField2 ( FILE * f , field_t * field , byte * base ) ;
-extern void WriteField1 ( FILE * f , field_t * field , byte * base ) ;
+extern void ReadClient ( savefile_t * f , gclient_t * client , short save_ver ) ;
+extern void WriteClient ( savefile_t * f , gclient_t * client ) ;
+extern void ReadField ( savefile_t * f , field_t * field , byte * base ) ;
+extern void WriteField2 ( savefile_t * f , field_t * field , byte * base ) ;
+extern void WriteField1 ( savefile_t * f , field_t * field , byte * base ) ;
 extern mmove_t * FindMmoveByName ( char * name ) ;
 extern mmoveList_t * GetMmoveByAddress ( mmove_t * adr ) ;
 extern byte * FindFunctionByName ( char * name ) ;
@@ -727,8 +727,6 @@ extern void Svcmd_Test_f ( void ) ;
 extern void SP_worldspawn ( edict_t * ent ) ;
 extern void SpawnEntities ( const char * mapname , char * entities , const char * spawnpoint ) ;
 extern void G_FindTeams ( void ) ;
-extern char * ED_ParseEdict ( char * data , edict_t * ent ) ;
-extern void ED_ParseField ( const char * key , const char * value , edict_t * ent ) ;
 extern char * ED_NewString ( const char * string ) ;
 extern void ED_CallSpawn ( edict_t * ent ) ;
 extern void G_RunEntity ( edict_t * ent ) ;
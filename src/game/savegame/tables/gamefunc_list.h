@@ -727,8 +727,6 @@
 {"SP_worldspawn", (byte *)SP_worldspawn},
 {"SpawnEntities", (byte *)SpawnEntities},
 {"G_FindTeams", (byte *)G_FindTeams},
-{"ED_ParseEdict", (byte *)ED_ParseEdict},
-{"ED_ParseField", (byte *)ED_ParseField},
 {"ED_NewString", (byte *)ED_NewString},
 {"ED_CallSpawn", (byte *)ED_CallSpawn},
 {"G_RunEntity", (byte *)G_RunEntity},
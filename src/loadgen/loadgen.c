@@ -0,0 +1,1232 @@
+/*
+ * Copyright (C) 1997-2001 Id Software, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * =======================================================================
+ *
+ * Headless load generator for the dedicated server. Opens a number of
+ * synthetic clients, each with its own UDP socket, runs them through
+ * the regular connect handshake and lets them send movement commands.
+ * The server can't tell them from real players. Frame arrival times,
+ * snapshot sizes and packet loss are measured and printed.
+ *
+ * The bots use the real netchan and message code, but parse only the
+ * reliable part of the server messages. Everything from svc_frame on
+ * is just counted.
+ *
+ * =======================================================================
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "../common/header/common.h"
+
+#define MAX_BOTS 1024
+#define MAX_SCRIPT 256
+#define CMD_BACKUP 64
+#define MAX_CVARS 16
+
+typedef enum
+{
+	bs_idle,        /* not started yet */
+	bs_challenge,   /* waiting for a challenge */
+	bs_connecting,  /* waiting for client_connect */
+	bs_connected,   /* signon in progress */
+	bs_active       /* in game, sending moves */
+} botstate_t;
+
+typedef enum
+{
+	mode_idle,
+	mode_random,
+	mode_circle,
+	mode_script
+} botmode_t;
+
+/* one step of a movement script */
+typedef struct
+{
+	int msec;
+	short forward;
+	short side;
+	short up;
+	float yawspeed;
+	int buttons;
+} scriptstep_t;
+
+typedef struct
+{
+	int packets;
+	int bytes;
+	int maxsize;
+	int frames;
+	int dropped;            /* packets lost by the netchan */
+	int gaps;               /* sum of frame interarrival times */
+	int maxgap;
+	int late;               /* frames arriving 50% late */
+} stats_t;
+
+typedef struct
+{
+	int num;
+	int socket;
+	botstate_t state;
+	netchan_t netchan;
+	int qport;
+	int challenge;
+	int lastoob;            /* last connectionless packet */
+	int lastmove;
+	int serverframe;
+	int lastframe;          /* arrival of the last frame */
+	int connecttime;
+
+	/* movement */
+	usercmd_t cmds[CMD_BACKUP];
+	usercmd_t move;
+	float yaw;
+	float yawspeed;
+	int movetime;           /* time of the next movement change */
+	int step;
+} bot_t;
+
+static bot_t bots[MAX_BOTS];
+static struct pollfd pollfds[MAX_BOTS];
+static bot_t *net_bot;  /* bot the netchan sends for */
+
+static netadr_t server_adr;
+static int numbots = 16;
+static int ramp = 4;
+static int duration;
+static int fps = 30;
+static int rate = 25000;
+static int report = 5;
+static botmode_t mode = mode_random;
+static scriptstep_t script[MAX_SCRIPT];
+static int scriptsteps;
+
+static stats_t interval;
+static stats_t total;
+
+static volatile sig_atomic_t quit;
+
+int curtime;
+
+/* ====================================================================== */
+
+/* The parts of the engine the netchan and message code need */
+
+static cvar_t cvars[MAX_CVARS];
+static int numcvars;
+
+cvar_t *
+Cvar_Get(char *var_name, char *value, int flags)
+{
+	int i;
+
+	for (i = 0; i < numcvars; i++)
+	{
+		if (!strcmp(cvars[i].name, var_name))
+		{
+			return &cvars[i];
+		}
+	}
+
+	if (numcvars == MAX_CVARS)
+	{
+		Com_Error(ERR_FATAL, "Cvar_Get: too many cvars");
+	}
+
+	cvars[numcvars].name = var_name;
+	cvars[numcvars].string = value;
+	cvars[numcvars].flags = flags;
+	cvars[numcvars].value = (float)atof(value);
+
+	return &cvars[numcvars++];
+}
+
+void
+Com_Printf(char *fmt, ...)
+{
+	va_list argptr;
+
+	va_start(argptr, fmt);
+	vprintf(fmt, argptr);
+	va_end(argptr);
+}
+
+void
+Com_DPrintf(char *fmt, ...)
+{
+}
+
+void
+Com_Error(int code, char *fmt, ...)
+{
+	va_list argptr;
+
+	va_start(argptr, fmt);
+	vfprintf(stderr, fmt, argptr);
+	va_end(argptr);
+
+	fprintf(stderr, "\n");
+	exit(1);
+}
+
+void
+Sys_Error(char *error, ...)
+{
+	va_list argptr;
+
+	va_start(argptr, error);
+	vfprintf(stderr, error, argptr);
+	va_end(argptr);
+
+	fprintf(stderr, "\n");
+	exit(1);
+}
+
+int
+Sys_Milliseconds(void)
+{
+	struct timespec now;
+	static time_t secbase;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	if (!secbase)
+	{
+		secbase = now.tv_sec;
+	}
+
+	return (int)((now.tv_sec - secbase) * 1000 + now.tv_nsec / 1000000);
+}
+
+char *
+NET_AdrToString(netadr_t a)
+{
+	static char s[64];
+
+	Com_sprintf(s, sizeof(s), "%i.%i.%i.%i:%i", a.ip[0], a.ip[1],
+			a.ip[2], a.ip[3], ntohs(a.port));
+
+	return s;
+}
+
+/*
+ * The netchan only knows the client and the server socket,
+ * but each bot has it's own. It's selected by net_bot.
+ */
+void
+NET_SendPacket(netsrc_t sock, int length, void *data, netadr_t to)
+{
+	struct sockaddr_in addr;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = to.port;
+	memcpy(&addr.sin_addr, to.ip, 4);
+
+	if (sendto(net_bot->socket, data, length, 0, (struct sockaddr *)&addr,
+				sizeof(addr)) == -1)
+	{
+		if ((errno != EWOULDBLOCK) && (errno != ECONNREFUSED))
+		{
+			Com_Printf("bot %i: sendto: %s\n", net_bot->num, strerror(errno));
+		}
+	}
+}
+
+/* ====================================================================== */
+
+static void
+LG_AddStats(int packets, int bytes, int frames, int dropped, int gap)
+{
+	stats_t *s;
+	int i;
+
+	for (i = 0, s = &interval; i < 2; i++, s = &total)
+	{
+		s->packets += packets;
+		s->bytes += bytes;
+		s->frames += frames;
+		s->dropped += dropped;
+
+		if (bytes > s->maxsize)
+		{
+			s->maxsize = bytes;
+		}
+
+		if (gap > 0)
+		{
+			s->gaps += gap;
+
+			if (gap > s->maxgap)
+			{
+				s->maxgap = gap;
+			}
+
+			/* the server sends 10 frames per second */
+			if (gap > 150)
+			{
+				s->late++;
+			}
+		}
+	}
+}
+
+static void
+LG_PrintStats(const char *label, stats_t *s, int msec)
+{
+	int active, i;
+
+	for (i = 0, active = 0; i < numbots; i++)
+	{
+		if (bots[i].state == bs_active)
+		{
+			active++;
+		}
+	}
+
+	if (msec <= 0)
+	{
+		msec = 1;
+	}
+
+	Com_Printf("%s: %i/%i bots, %.1f KB/s, %.1f frames/s per bot, "
+			"snapshot avg %i max %i bytes, frame gap avg %i max %i ms, "
+			"%i late, %.2f%% loss\n", label, active, numbots,
+			s->bytes * 1000.0f / msec / 1024, active ?
+			s->frames * 1000.0f / msec / active : 0,
+			s->packets ? s->bytes / s->packets : 0, s->maxsize,
+			s->frames ? s->gaps / s->frames : 0, s->maxgap, s->late,
+			s->packets ? s->dropped * 100.0f / (s->packets + s->dropped) : 0);
+}
+
+/* ====================================================================== */
+
+static void
+LG_SendString(bot_t *bot, const char *s)
+{
+	MSG_WriteByte(&bot->netchan.message, clc_stringcmd);
+	MSG_WriteString(&bot->netchan.message, (char *)s);
+}
+
+static void
+LG_SendOOB(bot_t *bot, const char *fmt, ...)
+{
+	char string[MAX_MSGLEN - 4];
+	va_list argptr;
+
+	va_start(argptr, fmt);
+	vsnprintf(string, sizeof(string), fmt, argptr);
+	va_end(argptr);
+
+	net_bot = bot;
+	bot->lastoob = curtime;
+	Netchan_OutOfBand(NS_CLIENT, server_adr, strlen(string), (byte *)string);
+}
+
+static void
+LG_SendConnect(bot_t *bot)
+{
+	char userinfo[MAX_INFO_STRING];
+
+	Com_sprintf(userinfo, sizeof(userinfo),
+			"\\name\\loadbot%03i\\skin\\male/grunt\\rate\\%i\\msg\\1\\hand\\2",
+			bot->num, rate);
+
+	LG_SendOOB(bot, "connect %i %i %i \"%s\" ext=%i\n", PROTOCOL_VERSION,
+			bot->qport, bot->challenge, userinfo, PROTOCOL_EXT_SUPPORTED);
+}
+
+static void
+LG_StartBot(bot_t *bot)
+{
+	struct sockaddr_in addr;
+
+	if (bot->socket == -1)
+	{
+		bot->socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+		if (bot->socket == -1)
+		{
+			Com_Error(ERR_FATAL, "socket: %s", strerror(errno));
+		}
+
+		fcntl(bot->socket, F_SETFL, fcntl(bot->socket, F_GETFL) | O_NONBLOCK);
+
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+
+		if (bind(bot->socket, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+		{
+			Com_Error(ERR_FATAL, "bind: %s", strerror(errno));
+		}
+
+		pollfds[bot->num].fd = bot->socket;
+		pollfds[bot->num].events = POLLIN;
+	}
+
+	bot->state = bs_challenge;
+	bot->connecttime = curtime;
+	bot->serverframe = -1;
+	LG_SendOOB(bot, "getchallenge\n");
+}
+
+/*
+ * Executes the commands the server stuffs
+ * into the console, as far as bots care.
+ */
+static void
+LG_Stufftext(bot_t *bot, char *text)
+{
+	char line[MAX_STRING_CHARS];
+	char *s, *end, *token;
+	int len;
+
+	for (s = text; *s; s = end)
+	{
+		end = s + strcspn(s, "\n;");
+		len = end - s;
+
+		if (*end)
+		{
+			end++;
+		}
+
+		if (len >= sizeof(line))
+		{
+			continue;
+		}
+
+		memcpy(line, s, len);
+		line[len] = '\0';
+
+		s = line;
+		token = COM_Parse(&s);
+
+		if (!strcmp(token, "cmd"))
+		{
+			while (*s == ' ')
+			{
+				s++;
+			}
+
+			LG_SendString(bot, s);
+		}
+		else if (!strcmp(token, "precache"))
+		{
+			token = COM_Parse(&s);
+			LG_SendString(bot, va("begin %s\n", token));
+
+			bot->state = bs_active;
+			bot->lastframe = 0;
+			Com_DPrintf("bot %i: in game after %i ms\n", bot->num,
+					curtime - bot->connecttime);
+		}
+		else if (!strcmp(token, "changing"))
+		{
+			bot->state = bs_connected;
+		}
+		else if (!strcmp(token, "reconnect"))
+		{
+			bot->state = bs_connected;
+			LG_SendString(bot, "new");
+		}
+		else if (!strcmp(token, "disconnect"))
+		{
+			LG_StartBot(bot);
+		}
+	}
+}
+
+/*
+ * Skips an entity delta, as
+ * in CL_ParseDelta().
+ */
+static void
+LG_SkipEntity(void)
+{
+	unsigned bits, b;
+
+	bits = MSG_ReadByte(&net_message);
+
+	if (bits & U_MOREBITS1)
+	{
+		b = MSG_ReadByte(&net_message);
+		bits |= b << 8;
+	}
+
+	if (bits & U_MOREBITS2)
+	{
+		b = MSG_ReadByte(&net_message);
+		bits |= b << 16;
+	}
+
+	if (bits & U_MOREBITS3)
+	{
+		b = MSG_ReadByte(&net_message);
+		bits |= b << 24;
+	}
+
+	net_message.readcount += (bits & U_NUMBER16) ? 2 : 1;
+
+	net_message.readcount += !!(bits & U_MODEL) + !!(bits & U_MODEL2) +
+		!!(bits & U_MODEL3) + !!(bits & U_MODEL4);
+
+	net_message.readcount += (bits & U_FRAME8) ? 1 : 0;
+	net_message.readcount += (bits & U_FRAME16) ? 2 : 0;
+
+	if ((bits & U_SKIN8) && (bits & U_SKIN16))
+	{
+		net_message.readcount += 4;
+	}
+	else
+	{
+		net_message.readcount += (bits & U_SKIN8) ? 1 : ((bits & U_SKIN16) ? 2 : 0);
+	}
+
+	if ((bits & (U_EFFECTS8 | U_EFFECTS16)) == (U_EFFECTS8 | U_EFFECTS16))
+	{
+		net_message.readcount += 4;
+	}
+	else
+	{
+		net_message.readcount += (bits & U_EFFECTS8) ? 1 : ((bits & U_EFFECTS16) ? 2 : 0);
+	}
+
+	if ((bits & (U_RENDERFX8 | U_RENDERFX16)) == (U_RENDERFX8 | U_RENDERFX16))
+	{
+		net_message.readcount += 4;
+	}
+	else
+	{
+		net_message.readcount += (bits & U_RENDERFX8) ? 1 : ((bits & U_RENDERFX16) ? 2 : 0);
+	}
+
+	net_message.readcount += 2 * (!!(bits & U_ORIGIN1) + !!(bits & U_ORIGIN2) +
+		!!(bits & U_ORIGIN3));
+	net_message.readcount += !!(bits & U_ANGLE1) + !!(bits & U_ANGLE2) +
+		!!(bits & U_ANGLE3);
+	net_message.readcount += (bits & U_OLDORIGIN) ? 6 : 0;
+	net_message.readcount += !!(bits & U_SOUND) + !!(bits & U_EVENT);
+	net_message.readcount += (bits & U_SOLID) ? 2 : 0;
+}
+
+/*
+ * Skips a sound, as in
+ * CL_ParseStartSoundPacket().
+ */
+static void
+LG_SkipSound(void)
+{
+	int flags;
+
+	flags = MSG_ReadByte(&net_message);
+	MSG_ReadByte(&net_message);
+
+	net_message.readcount += !!(flags & SND_VOLUME) +
+		!!(flags & SND_ATTENUATION) + !!(flags & SND_OFFSET);
+	net_message.readcount += (flags & SND_ENT) ? 2 : 0;
+	net_message.readcount += (flags & SND_POS) ? 6 : 0;
+}
+
+static void
+LG_ParseFrame(bot_t *bot)
+{
+	int frame, gap;
+
+	frame = MSG_ReadLong(&net_message);
+
+	if (bot->state != bs_active)
+	{
+		bot->serverframe = frame;
+		return;
+	}
+
+	gap = bot->lastframe ? curtime - bot->lastframe : 0;
+	bot->lastframe = curtime;
+	bot->serverframe = frame;
+
+	LG_AddStats(0, 0, 1, 0, gap);
+}
+
+static void
+LG_ParseServerMessage(bot_t *bot)
+{
+	int cmd, i, size;
+
+	while (net_message.readcount < net_message.cursize)
+	{
+		cmd = MSG_ReadByte(&net_message);
+
+		switch (cmd)
+		{
+			case svc_nop:
+				break;
+
+			case svc_disconnect:
+				Com_Printf("bot %i: disconnected by the server\n", bot->num);
+				LG_StartBot(bot);
+				return;
+
+			case svc_reconnect:
+				LG_StartBot(bot);
+				return;
+
+			case svc_print:
+				MSG_ReadByte(&net_message);
+				MSG_ReadString(&net_message);
+				break;
+
+			case svc_centerprint:
+			case svc_layout:
+				MSG_ReadString(&net_message);
+				break;
+
+			case svc_stufftext:
+				LG_Stufftext(bot, MSG_ReadString(&net_message));
+
+				if (bot->state < bs_connected)
+				{
+					return;
+				}
+
+				break;
+
+			case svc_serverdata:
+				if (MSG_ReadLong(&net_message) != PROTOCOL_VERSION)
+				{
+					Com_Error(ERR_FATAL, "server uses a different protocol");
+				}
+
+				MSG_ReadLong(&net_message);
+				MSG_ReadByte(&net_message);
+				MSG_ReadString(&net_message);
+				MSG_ReadShort(&net_message);
+				MSG_ReadString(&net_message);
+				bot->state = bs_connected;
+				break;
+
+			case svc_configstring:
+				MSG_ReadShort(&net_message);
+				MSG_ReadString(&net_message);
+				break;
+
+			case svc_spawnbaseline:
+				LG_SkipEntity();
+				break;
+
+			case svc_sound:
+				LG_SkipSound();
+				break;
+
+			case svc_muzzleflash:
+			case svc_muzzleflash2:
+				MSG_ReadShort(&net_message);
+				MSG_ReadByte(&net_message);
+				break;
+
+			case svc_inventory:
+				for (i = 0; i < MAX_ITEMS; i++)
+				{
+					MSG_ReadShort(&net_message);
+				}
+
+				break;
+
+			case svc_download:
+				size = MSG_ReadShort(&net_message);
+				MSG_ReadByte(&net_message);
+
+				if (size > 0)
+				{
+					net_message.readcount += size;
+				}
+
+				break;
+
+			case svc_frame:
+				LG_ParseFrame(bot);
+				return;
+
+			default:
+				/* temp entities can't be skipped without
+				   parsing them, and they're unreliable */
+				return;
+		}
+	}
+}
+
+static void
+LG_ConnectionlessPacket(bot_t *bot)
+{
+	char *s, *c;
+
+	MSG_BeginReading(&net_message);
+	MSG_ReadLong(&net_message);
+
+	s = MSG_ReadStringLine(&net_message);
+	c = COM_Parse(&s);
+
+	if (!strcmp(c, "challenge"))
+	{
+		if (bot->state != bs_challenge)
+		{
+			return;
+		}
+
+		bot->challenge = atoi(COM_Parse(&s));
+		bot->state = bs_connecting;
+		LG_SendConnect(bot);
+	}
+	else if (!strcmp(c, "client_connect"))
+	{
+		if (bot->state != bs_connecting)
+		{
+			return;
+		}
+
+		Netchan_Setup(NS_CLIENT, &bot->netchan, server_adr, bot->qport);
+
+		while (s && *s)
+		{
+			c = COM_Parse(&s);
+
+			if (!strncmp(c, "ext=", 4))
+			{
+				if (atoi(c + 4) & PROTOCOL_EXT_FRAGMENT)
+				{
+					Netchan_EnableFragments(&bot->netchan);
+				}
+
+				if (atoi(c + 4) & PROTOCOL_EXT_COMPRESS)
+				{
+					Netchan_EnableCompression(&bot->netchan);
+				}
+			}
+		}
+
+		bot->state = bs_connected;
+		LG_SendString(bot, "new");
+	}
+	else if (!strcmp(c, "print"))
+	{
+		Com_Printf("bot %i: %s", bot->num, MSG_ReadString(&net_message));
+	}
+}
+
+static void
+LG_ReadPackets(bot_t *bot)
+{
+	struct sockaddr_in from;
+	socklen_t fromlen;
+	int ret;
+
+	for ( ; ; )
+	{
+		fromlen = sizeof(from);
+		ret = recvfrom(bot->socket, net_message_buffer,
+				sizeof(net_message_buffer), 0,
+				(struct sockaddr *)&from, &fromlen);
+
+		if (ret <= 0)
+		{
+			return;
+		}
+
+		if ((from.sin_port != server_adr.port) ||
+			memcmp(&from.sin_addr, server_adr.ip, 4))
+		{
+			continue;
+		}
+
+		net_from = server_adr;
+		net_message.cursize = ret;
+		net_message.readcount = 0;
+
+		if (*(int *)net_message.data == -1)
+		{
+			LG_ConnectionlessPacket(bot);
+			continue;
+		}
+
+		if (bot->state < bs_connected)
+		{
+			continue;
+		}
+
+		if (!Netchan_Process(&bot->netchan, &net_message))
+		{
+			continue;
+		}
+
+		if (bot->state == bs_active)
+		{
+			LG_AddStats(1, net_message.cursize, 0, bot->netchan.dropped, 0);
+		}
+
+		net_bot = bot;
+		LG_ParseServerMessage(bot);
+	}
+}
+
+/* ====================================================================== */
+
+/*
+ * Picks the next movement.
+ */
+static void
+LG_ChangeMove(bot_t *bot)
+{
+	scriptstep_t *step;
+	static const short speeds[] = {-400, 0, 400, 400};
+
+	memset(&bot->move, 0, sizeof(bot->move));
+	bot->yawspeed = 0;
+
+	switch (mode)
+	{
+		case mode_idle:
+			bot->movetime = curtime + 1000;
+			break;
+
+		case mode_random:
+			bot->move.forwardmove = speeds[rand() & 3];
+			bot->move.sidemove = speeds[rand() & 3];
+			bot->move.upmove = (rand() % 10) ? 0 : 200;
+			bot->move.buttons = (rand() % 5) ? 0 : BUTTON_ATTACK;
+			bot->yawspeed = (float)(rand() % 361 - 180);
+			bot->movetime = curtime + 500 + rand() % 1500;
+			break;
+
+		case mode_circle:
+			bot->move.forwardmove = 400;
+			bot->yawspeed = 90;
+			bot->movetime = curtime + 1000;
+			break;
+
+		case mode_script:
+			step = &script[bot->step++ % scriptsteps];
+			bot->move.forwardmove = step->forward;
+			bot->move.sidemove = step->side;
+			bot->move.upmove = step->up;
+			bot->move.buttons = step->buttons;
+			bot->yawspeed = step->yawspeed;
+			bot->movetime = curtime + step->msec;
+			break;
+	}
+}
+
+/*
+ * Sends a clc_move the way CL_SendCmd() does: the
+ * last three commands, protected by a checksum.
+ */
+static void
+LG_SendMove(bot_t *bot)
+{
+	byte data[128];
+	sizebuf_t buf;
+	usercmd_t *cmd, *oldcmd;
+	usercmd_t nullcmd;
+	int checksumindex;
+	int msec;
+
+	msec = curtime - bot->lastmove;
+	bot->lastmove = curtime;
+
+	if (msec > 250)
+	{
+		msec = 100;
+	}
+
+	if (curtime >= bot->movetime)
+	{
+		LG_ChangeMove(bot);
+	}
+
+	bot->yaw += bot->yawspeed * msec * 0.001f;
+
+	cmd = &bot->cmds[bot->netchan.outgoing_sequence & (CMD_BACKUP - 1)];
+	*cmd = bot->move;
+	cmd->msec = msec;
+	cmd->angles[YAW] = ANGLE2SHORT(bot->yaw);
+	cmd->lightlevel = 128;
+
+	SZ_Init(&buf, data, sizeof(data));
+
+	MSG_WriteByte(&buf, clc_move);
+	checksumindex = buf.cursize;
+	MSG_WriteByte(&buf, 0);
+
+	/* acknowledge the last frame so the
+	   server sends deltas, like real clients */
+	MSG_WriteLong(&buf, bot->serverframe);
+
+	memset(&nullcmd, 0, sizeof(nullcmd));
+	oldcmd = &bot->cmds[(bot->netchan.outgoing_sequence - 2) & (CMD_BACKUP - 1)];
+	MSG_WriteDeltaUsercmd(&buf, &nullcmd, oldcmd);
+	cmd = &bot->cmds[(bot->netchan.outgoing_sequence - 1) & (CMD_BACKUP - 1)];
+	MSG_WriteDeltaUsercmd(&buf, oldcmd, cmd);
+	oldcmd = cmd;
+	cmd = &bot->cmds[bot->netchan.outgoing_sequence & (CMD_BACKUP - 1)];
+	MSG_WriteDeltaUsercmd(&buf, oldcmd, cmd);
+
+	buf.data[checksumindex] = COM_BlockSequenceCRCByte(
+			buf.data + checksumindex + 1, buf.cursize - checksumindex - 1,
+			bot->netchan.outgoing_sequence);
+
+	net_bot = bot;
+	Netchan_Transmit(&bot->netchan, buf.cursize, buf.data);
+}
+
+static void
+LG_RunBot(bot_t *bot)
+{
+	byte dummy;
+
+	switch (bot->state)
+	{
+		case bs_idle:
+			break;
+
+		case bs_challenge:
+			if (curtime - bot->lastoob > 1000)
+			{
+				LG_SendOOB(bot, "getchallenge\n");
+			}
+
+			break;
+
+		case bs_connecting:
+			if (curtime - bot->lastoob > 1000)
+			{
+				LG_SendConnect(bot);
+			}
+
+			break;
+
+		case bs_connected:
+			if (bot->netchan.message.cursize ||
+				(curtime - bot->netchan.last_sent > 100))
+			{
+				net_bot = bot;
+				Netchan_Transmit(&bot->netchan, 0, &dummy);
+			}
+
+			break;
+
+		case bs_active:
+			if (curtime - bot->lastmove >= 1000 / fps)
+			{
+				LG_SendMove(bot);
+			}
+
+			break;
+	}
+}
+
+/* ====================================================================== */
+
+static void
+LG_LoadScript(const char *name)
+{
+	FILE *f;
+	char line[256];
+	scriptstep_t *step;
+
+	f = fopen(name, "r");
+
+	if (!f)
+	{
+		Com_Error(ERR_FATAL, "couldn't open %s", name);
+	}
+
+	/* msec forward side up yawspeed buttons */
+	while (fgets(line, sizeof(line), f) && (scriptsteps < MAX_SCRIPT))
+	{
+		int forward, side, up;
+
+		step = &script[scriptsteps];
+
+		if ((line[0] == '#') ||
+			(sscanf(line, "%i %i %i %i %f %i", &step->msec, &forward, &side,
+					&up, &step->yawspeed, &step->buttons) != 6))
+		{
+			continue;
+		}
+
+		step->forward = forward;
+		step->side = side;
+		step->up = up;
+
+		if (step->msec > 0)
+		{
+			scriptsteps++;
+		}
+	}
+
+	fclose(f);
+
+	if (!scriptsteps)
+	{
+		Com_Error(ERR_FATAL, "%s contains no steps", name);
+	}
+
+	mode = mode_script;
+}
+
+static void
+LG_ResolveServer(const char *name)
+{
+	char host[256];
+	char *port;
+	struct addrinfo hints, *res;
+
+	Q_strlcpy(host, name, sizeof(host));
+	port = strchr(host, ':');
+
+	if (port)
+	{
+		*port++ = '\0';
+	}
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+
+	if (getaddrinfo(host, port ? port : va("%i", PORT_SERVER), &hints, &res))
+	{
+		Com_Error(ERR_FATAL, "couldn't resolve %s", name);
+	}
+
+	memset(&server_adr, 0, sizeof(server_adr));
+	server_adr.type = NA_IP;
+	memcpy(server_adr.ip, &((struct sockaddr_in *)res->ai_addr)->sin_addr, 4);
+	server_adr.port = ((struct sockaddr_in *)res->ai_addr)->sin_port;
+
+	freeaddrinfo(res);
+}
+
+static void
+LG_Usage(void)
+{
+	printf("Usage: q2loadgen [options]\n"
+			"  -server <host[:port]>  server to connect to, default 127.0.0.1\n"
+			"  -clients <n>           number of bots, default 16\n"
+			"  -ramp <n>              bots connecting per second, default 4\n"
+			"  -duration <sec>        run time, 0 (default) until interrupted\n"
+			"  -fps <n>               move commands per second, default 30\n"
+			"  -rate <n>              rate the bots ask for, default 25000\n"
+			"  -mode <idle|random|circle>  movement, default random\n"
+			"  -script <file>         movement script, one step per line:\n"
+			"                         msec forward side up yawspeed buttons\n"
+			"  -report <sec>          statistics interval, default 5\n"
+			"  -seed <n>              random seed\n");
+	exit(1);
+}
+
+static void
+LG_Signal(int sig)
+{
+	quit = 1;
+}
+
+int
+main(int argc, char **argv)
+{
+	int i, start, lastreport, started, len;
+	char *server = "127.0.0.1";
+	byte final[32];
+	unsigned seed = 0;
+
+	for (i = 1; i < argc; i++)
+	{
+		if (i + 1 >= argc)
+		{
+			LG_Usage();
+		}
+
+		if (!strcmp(argv[i], "-server"))
+		{
+			server = argv[++i];
+		}
+		else if (!strcmp(argv[i], "-clients"))
+		{
+			numbots = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-ramp"))
+		{
+			ramp = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-duration"))
+		{
+			duration = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-fps"))
+		{
+			fps = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-rate"))
+		{
+			rate = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-mode"))
+		{
+			i++;
+
+			if (!strcmp(argv[i], "idle"))
+			{
+				mode = mode_idle;
+			}
+			else if (!strcmp(argv[i], "random"))
+			{
+				mode = mode_random;
+			}
+			else if (!strcmp(argv[i], "circle"))
+			{
+				mode = mode_circle;
+			}
+			else
+			{
+				LG_Usage();
+			}
+		}
+		else if (!strcmp(argv[i], "-script"))
+		{
+			LG_LoadScript(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-report"))
+		{
+			report = atoi(argv[++i]);
+		}
+		else if (!strcmp(argv[i], "-seed"))
+		{
+			seed = (unsigned)atoi(argv[++i]);
+		}
+		else
+		{
+			LG_Usage();
+		}
+	}
+
+	numbots = (numbots < 1) ? 1 : ((numbots > MAX_BOTS) ? MAX_BOTS : numbots);
+	ramp = (ramp < 1) ? 1 : ramp;
+	fps = (fps < 1) ? 1 : ((fps > 250) ? 250 : fps);
+	report = (report < 1) ? 1 : report;
+
+	LG_ResolveServer(server);
+	Swap_Init();
+	Netchan_Init();
+	SZ_Init(&net_message, net_message_buffer, sizeof(net_message_buffer));
+
+	srand(seed ? seed : (unsigned)time(NULL));
+
+	signal(SIGINT, LG_Signal);
+	signal(SIGTERM, LG_Signal);
+
+	for (i = 0; i < numbots; i++)
+	{
+		bots[i].num = i;
+		bots[i].socket = -1;
+		bots[i].qport = rand() & 0xffff;
+		pollfds[i].fd = -1;
+	}
+
+	Com_Printf("%i bots connecting to %s\n", numbots,
+			NET_AdrToString(server_adr));
+
+	start = lastreport = Sys_Milliseconds();
+	started = 0;
+
+	while (!quit)
+	{
+		curtime = Sys_Milliseconds();
+
+		if (duration && (curtime - start >= duration * 1000))
+		{
+			break;
+		}
+
+		/* connect a few bots at a time, the server
+		   rate limits connectionless packets */
+		while ((started < numbots) &&
+				(started <= (curtime - start) * ramp / 1000))
+		{
+			LG_StartBot(&bots[started++]);
+		}
+
+		for (i = 0; i < started; i++)
+		{
+			LG_RunBot(&bots[i]);
+		}
+
+		if (poll(pollfds, started, 1) > 0)
+		{
+			curtime = Sys_Milliseconds();
+
+			for (i = 0; i < started; i++)
+			{
+				if (pollfds[i].revents & POLLIN)
+				{
+					LG_ReadPackets(&bots[i]);
+				}
+			}
+		}
+
+		if (curtime - lastreport >= report * 1000)
+		{
+			LG_PrintStats(va("%4is", (curtime - start) / 1000), &interval,
+					curtime - lastreport);
+			memset(&interval, 0, sizeof(interval));
+			lastreport = curtime;
+		}
+	}
+
+	/* disconnect the bots, like CL_Disconnect() */
+	final[0] = clc_stringcmd;
+	strcpy((char *)final + 1, "disconnect");
+	len = strlen((char *)final) + 1;
+
+	for (i = 0; i < started; i++)
+	{
+		if (bots[i].state >= bs_connected)
+		{
+			net_bot = &bots[i];
+			Netchan_Transmit(&bots[i].netchan, len, final);
+			Netchan_Transmit(&bots[i].netchan, len, final);
+			Netchan_Transmit(&bots[i].netchan, len, final);
+		}
+
+		close(bots[i].socket);
+	}
+
+	LG_PrintStats("total", &total, Sys_Milliseconds() - start);
+
+	return 0;
+}
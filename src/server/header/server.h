@@ -39,6 +39,14 @@
    out before legitimate users connected */
 #define MAX_CHALLENGES 1024
 
+/* Number of buckets in the table mapping base
+   addresses to challenges. Must be a power of two. */
+#define CHALLENGE_HASH_SIZE 1024
+
+/* Number of buckets in the table mapping (base address,
+   qport) to connected clients. Must be a power of two. */
+#define CLIENT_HASH_SIZE 256
+
 /* MAX_TOKEN_CHARS was 128. YQ2 bumped it to 1024, since we
  * need to support some very long cvars like gl_nolerp_list.
  * Keep structs used in savegames at 128, otherwise older
@@ -60,6 +68,39 @@ typedef enum
 	ss_pic
 } server_state_t;
 
+/* entry of the keyframe index at the end of a demo */
+typedef struct
+{
+	int message;                    /* first message after the keyframe */
+	int offset;                     /* file offset of that message */
+	int keyoffset;                  /* file offset of the keyframe */
+} demokey_t;
+
+/* view cluster and area of a client, refreshed
+   by SV_Multicast whenever its origin changes */
+typedef struct
+{
+	vec3_t origin;
+	int cluster;
+	int area;
+	qboolean valid;
+} mcastclient_t;
+
+/* clients inside the PVS or PHS of one origin
+   cluster and area, one bit per client slot */
+#define MULTICAST_SETS 64 /* must be a power of two */
+#define MULTICAST_WORDS (MAX_CLIENTS / 32)
+
+typedef struct
+{
+	int cluster;
+	int area;
+	qboolean phs;
+	int generation;                 /* sv.multicast_generation when built */
+	int floodversion;               /* CM_AreaFloodVersion() when built */
+	unsigned clients[MULTICAST_WORDS];
+} mcastset_t;
+
 typedef struct
 {
 	server_state_t state;           /* precache commands are only valid during load */
@@ -81,9 +122,21 @@ typedef struct
 	sizebuf_t multicast;
 	byte multicast_buf[MAX_MSGLEN];
 
+	/* recipient lookup for SV_Multicast, the sets are
+	   stale when a client changes its cluster or area */
+	mcastclient_t multicast_clients[MAX_CLIENTS];
+	mcastset_t multicast_sets[MULTICAST_SETS];
+	int multicast_generation;
+
 	/* demo server information */
 	fileHandle_t demofile;
 	qboolean timedemo; /* don't time sync */
+	demokey_t *demokeys;
+	int numdemokeys;
+	int demomessage;                /* messages played since the start */
+	int demoskip;                   /* messages to fast-forward */
+	qboolean demokeyframe;          /* playing a keyframe */
+	int demoresume;                 /* stream offset after the keyframe */
 } server_t;
 
 typedef enum
@@ -134,6 +187,7 @@ typedef struct client_s
 	byte datagram_buf[MAX_MSGLEN];
 
 	client_frame_t frames[UPDATE_BACKUP];     /* updates can be delta'd from here */
+	int entity_deferred[MAX_EDICTS];    /* sv.framenum an entity update was first held back */
 
 	byte *download;                     /* file being downloaded */
 	int downloadsize;                   /* total bytes (can't use EOF because of paks) */
@@ -145,13 +199,21 @@ typedef struct client_s
 	int challenge;                      /* challenge of this user, randomly generated */
 
 	netchan_t netchan;
+	int extensions;                     /* negotiated PROTOCOL_EXT_* */
+
+	struct client_s *hashnext;          /* next client in the same svs.clienthash bucket */
+
+	qboolean statusactive;              /* state, score and ping in the cached status string */
+	int statusfrags;
+	int statusping;
 } client_t;
 
-typedef struct
+typedef struct challenge_s
 {
 	netadr_t adr;
 	int challenge;
 	int time;
+	struct challenge_s *hashnext;       /* next challenge in the same svs.challengehash bucket */
 } challenge_t;
 
 typedef struct
@@ -172,9 +234,15 @@ typedef struct
 	int last_heartbeat;
 
 	challenge_t challenges[MAX_CHALLENGES];    /* to prevent invalid IPs from connecting */
+	challenge_t *challengehash[CHALLENGE_HASH_SIZE];    /* challenges by base address */
+	int nextchallenge;                         /* oldest challenge, replaced next */
+
+	qboolean statusvalid;               /* SV_StatusString() can be reused */
+
+	client_t *clienthash[CLIENT_HASH_SIZE];    /* non free clients by base address and qport */
 
 	/* serverrecord values */
-	FILE *demofile;
+	demowriter_t *demofile;
 	sizebuf_t demo_multicast;
 	byte demo_multicast_buf[MAX_MSGLEN];
 } server_static_t;
@@ -194,12 +262,22 @@ extern cvar_t *sv_airaccelerate;            /* don't reload level state when ree
 											/* development tool */
 extern cvar_t *sv_enforcetime;
 extern cvar_t *sv_downloadserver;			/* Download server. */
+extern cvar_t *sv_fragment;			/* Allow fragmented netchan messages. */
+extern cvar_t *sv_bitdelta;			/* Allow bit packed entity updates. */
+extern cvar_t *sv_compress;			/* Allow compressed messages. */
+extern cvar_t *sv_ratecull;			/* Defer entity updates instead of dropping frames. */
+extern cvar_t *sv_conless_rate;		/* Connectionless packets per second and address. */
+extern cvar_t *sv_status_rate;		/* Status and info replies per second. */
+extern cvar_t *demo_speed;			/* Demo messages played per frame. */
 
 extern client_t *sv_client;
 extern edict_t *sv_player;
 
 void SV_FinalMessage(char *message, qboolean reconnect);
 void SV_DropClient(client_t *drop);
+unsigned SV_HashAdr(netadr_t *adr, int seed);
+void SV_HashClient(client_t *cl);
+void SV_UnhashClient(client_t *cl);
 
 int SV_ModelIndex(char *name);
 int SV_SoundIndex(char *name);
@@ -209,6 +287,7 @@ void SV_WriteClientdataToMessage(client_t *client, sizebuf_t *msg);
 
 void SV_ExecuteUserCommand(char *s);
 void SV_InitOperatorCommands(void);
+void SV_Bench_f(void);
 
 void SV_SendServerinfo(client_t *client);
 void SV_UserinfoChanged(client_t *cl);
@@ -227,6 +306,9 @@ extern char sv_outputbuf[SV_OUTPUTBUF_LENGTH];
 
 void SV_FlushRedirect(int sv_redirected, char *outputbuf);
 
+void SV_BeginDemoserver(void);
+void SV_EndDemoserver(void);
+qboolean SV_DemoSeek(int message);
 void SV_DemoCompleted(void);
 void SV_SendClientMessages(void);
 
@@ -247,6 +329,7 @@ void SV_Status_f(void);
 void SV_WriteFrameToClient(client_t *client, sizebuf_t *msg);
 void SV_RecordDemoMessage(void);
 void SV_BuildClientFrame(client_t *client);
+qboolean SV_CullClientFrame(client_t *client, int budget);
 
 extern game_export_t *ge;
 
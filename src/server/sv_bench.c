@@ -0,0 +1,482 @@
+/*
+ * Copyright (C) 1997-2001 Id Software, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * =======================================================================
+ *
+ * Game logic benchmark. Starts a map like the map command does, puts
+ * a fake player into the first client slot and runs the game frames
+ * back to back, without waiting and without sending anything. The
+ * player is driven by a movement script in the loadgen format.
+ *
+ * Each frame the state of all edicts is hashed. The game is loaded
+ * again and the PRNG is reseeded for every run, so two runs of the
+ * same map, frame count and script must give the same hashes. The
+ * hashes are written to bench_<map>.txt in the game dir and compared
+ * with the previous run of the same benchmark.
+ *
+ * =======================================================================
+ */
+
+#include <stdint.h>
+
+#include "header/server.h"
+
+#define BENCH_MAXSTEPS 1024
+
+/* one step of a movement script */
+typedef struct
+{
+	int msec;
+	short forward;
+	short side;
+	short up;
+	float yawspeed;
+	int buttons;
+} benchstep_t;
+
+static benchstep_t bench_steps[BENCH_MAXSTEPS];
+static int bench_numsteps;
+
+/*
+ * Reads a movement script, one step per line:
+ * msec forward side up yawspeed buttons
+ */
+static qboolean
+SV_BenchLoadScript(char *name)
+{
+	char *buf, *text, *line, *next;
+	benchstep_t *step;
+	int len;
+
+	bench_numsteps = 0;
+
+	len = FS_LoadFile(name, (void **)&buf);
+
+	if (len < 0)
+	{
+		Com_Printf("Can't find %s\n", name);
+		return false;
+	}
+
+	text = Z_Malloc(len + 1);
+	memcpy(text, buf, len);
+	text[len] = 0;
+	FS_FreeFile(buf);
+
+	for (line = text; line && (bench_numsteps < BENCH_MAXSTEPS); line = next)
+	{
+		int forward, side, up;
+
+		next = strchr(line, '\n');
+
+		if (next)
+		{
+			*next++ = 0;
+		}
+
+		step = &bench_steps[bench_numsteps];
+
+		if ((line[0] == '#') ||
+			(sscanf(line, "%i %i %i %i %f %i", &step->msec, &forward, &side,
+					&up, &step->yawspeed, &step->buttons) != 6))
+		{
+			continue;
+		}
+
+		step->forward = forward;
+		step->side = side;
+		step->up = up;
+
+		if (step->msec > 0)
+		{
+			bench_numsteps++;
+		}
+	}
+
+	Z_Free(text);
+
+	if (!bench_numsteps)
+	{
+		Com_Printf("%s contains no steps\n", name);
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Builds the move for the given frame. Every step
+ * lasts its msec rounded to whole frames, the
+ * script starts over when it's done.
+ */
+static void
+SV_BenchMove(usercmd_t *cmd, int *step, int *stepframes, float *yaw)
+{
+	benchstep_t *s;
+
+	memset(cmd, 0, sizeof(*cmd));
+	cmd->msec = 100;
+
+	if (!bench_numsteps)
+	{
+		return;
+	}
+
+	s = &bench_steps[*step];
+
+	*yaw += s->yawspeed * 0.1f;
+
+	cmd->forwardmove = s->forward;
+	cmd->sidemove = s->side;
+	cmd->upmove = s->up;
+	cmd->buttons = s->buttons;
+	cmd->angles[YAW] = ANGLE2SHORT(*yaw);
+
+	if (++(*stepframes) * 100 >= s->msec)
+	{
+		*stepframes = 0;
+		*step = (*step + 1) % bench_numsteps;
+	}
+}
+
+/*
+ * FNV-1a
+ */
+static uint64_t
+SV_BenchHashData(uint64_t hash, const void *data, size_t len)
+{
+	const byte *p;
+
+	for (p = data; len; len--, p++)
+	{
+		hash = (hash ^ *p) * 0x100000001b3ULL;
+	}
+
+	return hash;
+}
+
+/*
+ * Hashes what the game exposes to the server: the entity
+ * state of all edicts in use and the player states. The
+ * hash of the previous frame is chained in, so a single
+ * difference shows up in all following frames.
+ */
+static uint64_t
+SV_BenchHashFrame(uint64_t hash)
+{
+	edict_t *ent;
+	int i;
+
+	for (i = 0; i < ge->num_edicts; i++)
+	{
+		ent = EDICT_NUM(i);
+
+		if (!ent->inuse)
+		{
+			continue;
+		}
+
+		hash = SV_BenchHashData(hash, &i, sizeof(i));
+		hash = SV_BenchHashData(hash, &ent->s, sizeof(ent->s));
+		hash = SV_BenchHashData(hash, &ent->solid, sizeof(ent->solid));
+
+		if (ent->client)
+		{
+			hash = SV_BenchHashData(hash, &ent->client->ps,
+					sizeof(ent->client->ps));
+		}
+	}
+
+	return hash;
+}
+
+/*
+ * Reads the hashes of the last run. Returns the
+ * number of frames read, 0 if there was no run
+ * with the same arguments.
+ */
+static int
+SV_BenchReadReference(const char *name, const char *header, uint64_t *hashes,
+		int frames)
+{
+	char line[256];
+	unsigned long long hash;
+	int frame, usec, n;
+	FILE *f;
+
+	f = Q_fopen(name, "r");
+
+	if (!f)
+	{
+		return 0;
+	}
+
+	n = 0;
+
+	if (fgets(line, sizeof(line), f) && !strcmp(line, header))
+	{
+		while (fgets(line, sizeof(line), f))
+		{
+			if ((sscanf(line, "%i %i %llx", &frame, &usec, &hash) == 3) &&
+				(frame == n) && (n < frames))
+			{
+				hashes[n++] = hash;
+			}
+		}
+	}
+
+	fclose(f);
+
+	return n;
+}
+
+static int
+SV_BenchCompare(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+/*
+ * bench <map> <frames> [script]
+ */
+void
+SV_Bench_f(void)
+{
+	char name[MAX_OSPATH], header[256], expanded[MAX_QPATH];
+	char map[MAX_QPATH], script[MAX_QPATH];
+	uint64_t *hashes, *reference, hash;
+	int *times, *sorted;
+	int frames, numreference, mismatch;
+	int step, stepframes, i, t, zone;
+	long long start, total, thinktime;
+	float yaw;
+	char *oldprof;
+	client_t *cl;
+	edict_t *ent;
+	usercmd_t cmd;
+	netadr_t adr;
+	FILE *f;
+
+	if ((Cmd_Argc() != 3) && (Cmd_Argc() != 4))
+	{
+		Com_Printf("USAGE: bench <map> <frames> [script]\n");
+		return;
+	}
+
+	Q_strlcpy(map, Cmd_Argv(1), sizeof(map));
+	Q_strlcpy(script, (Cmd_Argc() == 4) ? Cmd_Argv(3) : "", sizeof(script));
+	frames = (int)strtol(Cmd_Argv(2), (char **)NULL, 10);
+
+	if (frames <= 0)
+	{
+		Com_Printf("bench: frames must be positive\n");
+		return;
+	}
+
+	Com_sprintf(expanded, sizeof(expanded), "maps/%s.bsp", map);
+
+	if (FS_LoadFile(expanded, NULL) == -1)
+	{
+		Com_Printf("Can't find %s\n", expanded);
+		return;
+	}
+
+	if (script[0])
+	{
+		if (!SV_BenchLoadScript(script))
+		{
+			return;
+		}
+	}
+	else
+	{
+		bench_numsteps = 0;
+	}
+
+	/* start the map like the map command does. The
+	   game is loaded again, which reseeds its PRNG */
+	sv.state = ss_dead;
+	SV_WipeSavegame("current");
+	SV_Map(false, map, false, false);
+	Q_strlcpy(svs.mapcmd, map, sizeof(svs.mapcmd));
+
+	if (sv.state != ss_game)
+	{
+		Com_Printf("bench: %s didn't start\n", map);
+		return;
+	}
+
+	/* the fake player, set up like a
+	   connection in SV_DirectConnect() */
+	cl = &svs.clients[0];
+	ent = EDICT_NUM(1);
+
+	memset(cl, 0, sizeof(*cl));
+	memset(&adr, 0, sizeof(adr));
+	adr.type = NA_LOOPBACK;
+
+	cl->edict = ent;
+	cl->lastframe = -1;
+	Netchan_Setup(NS_SERVER, &cl->netchan, adr, 0);
+	SZ_Init(&cl->datagram, cl->datagram_buf, sizeof(cl->datagram_buf));
+	cl->datagram.allowoverflow = true;
+
+	Q_strlcpy(cl->userinfo, "\\name\\bench\\skin\\male/grunt\\hand\\2",
+			sizeof(cl->userinfo));
+
+	if (!ge->ClientConnect(ent, cl->userinfo))
+	{
+		Com_Printf("bench: the game rejected the player\n");
+		memset(cl, 0, sizeof(*cl));
+		return;
+	}
+
+	SV_UserinfoChanged(cl);
+	cl->state = cs_spawned;
+	ge->ClientBegin(ent);
+
+	times = Z_Malloc(frames * sizeof(int));
+	sorted = Z_Malloc(frames * sizeof(int));
+	hashes = Z_Malloc(frames * sizeof(uint64_t));
+	reference = Z_Malloc(frames * sizeof(uint64_t));
+
+	/* the profiler sums up the zones and
+	   the traces and links of the game */
+	oldprof = CopyString((char *)Cvar_VariableString("prof"));
+	Cvar_Set("prof", "1");
+	Prof_ClearTotals();
+
+	step = stepframes = 0;
+	yaw = 0;
+	hash = 0xcbf29ce484222325ULL;
+	total = thinktime = 0;
+
+	Com_Printf("Running %i frames of %s...\n", frames, map);
+
+	for (i = 0; i < frames; i++)
+	{
+		Prof_BeginFrame();
+
+		SV_BenchMove(&cmd, &step, &stepframes, &yaw);
+
+		start = Sys_Microseconds();
+		zone = Prof_Begin("ClientThink");
+		ge->ClientThink(ent, &cmd);
+		Prof_End(zone);
+		thinktime += Sys_Microseconds() - start;
+
+		/* what SV_RunGameFrame() does */
+		sv.framenum++;
+		sv.time = sv.framenum * 100;
+
+		start = Sys_Microseconds();
+		zone = Prof_Begin("G_RunFrame");
+		ge->RunFrame();
+		Prof_End(zone);
+		times[i] = (int)(Sys_Microseconds() - start);
+		total += times[i];
+
+		hash = SV_BenchHashFrame(hash);
+		hashes[i] = hash;
+
+		/* nobody reads the messages */
+		SZ_Clear(&cl->netchan.message);
+		SZ_Clear(&cl->datagram);
+		SV_PrepWorldFrame();
+
+		Prof_EndFrame();
+	}
+
+	svs.realtime = sv.time;
+
+	ge->ClientDisconnect(ent);
+	cl->state = cs_free;
+
+	/* statistics */
+	memcpy(sorted, times, frames * sizeof(int));
+	qsort(sorted, frames, sizeof(int), SV_BenchCompare);
+
+	Com_Printf("%i frames in %.1f ms, ClientThink %.1f ms\n", frames,
+			total / 1000.0f, thinktime / 1000.0f);
+	Com_Printf("G_RunFrame usec: avg %i, min %i, median %i, 99%% %i, max %i\n",
+			(int)(total / frames), sorted[0], sorted[frames / 2],
+			sorted[(frames * 99) / 100], sorted[frames - 1]);
+	Prof_PrintTotals();
+
+	/* determinism check against the last run */
+	Com_sprintf(name, sizeof(name), "%s/bench_%s.txt", FS_Gamedir(), map);
+	Com_sprintf(header, sizeof(header), "# bench %s %i %s\n", map, frames,
+			script);
+
+	numreference = SV_BenchReadReference(name, header, reference, frames);
+
+	for (mismatch = -1, t = 0; t < numreference; t++)
+	{
+		if (reference[t] != hashes[t])
+		{
+			mismatch = t;
+			break;
+		}
+	}
+
+	Com_Printf("state hash %016llx\n", (unsigned long long)hash);
+
+	if (numreference < frames)
+	{
+		Com_Printf("No complete earlier run to compare with.\n");
+	}
+	else if (mismatch >= 0)
+	{
+		Com_Printf("NOT DETERMINISTIC: frame %i differs from the last run.\n",
+				mismatch);
+	}
+	else
+	{
+		Com_Printf("All %i frames match the last run.\n", frames);
+	}
+
+	/* frame, G_RunFrame usec and state hash per line */
+	f = Q_fopen(name, "w");
+
+	if (f)
+	{
+		fputs(header, f);
+
+		for (i = 0; i < frames; i++)
+		{
+			fprintf(f, "%i %i %016llx\n", i, times[i],
+					(unsigned long long)hashes[i]);
+		}
+
+		fclose(f);
+		Com_Printf("Wrote %s.\n", name);
+	}
+	else
+	{
+		Com_Printf("Couldn't write %s.\n", name);
+	}
+
+	Cvar_Set("prof", oldprof);
+	Z_Free(oldprof);
+
+	Z_Free(times);
+	Z_Free(sorted);
+	Z_Free(hashes);
+	Z_Free(reference);
+}
@@ -394,8 +394,8 @@ SV_Status_f(void)
 
 	Com_Printf("map              : %s\n", sv.name);
 
-	Com_Printf("num score ping name            lastmsg address               qport \n");
-	Com_Printf("--- ----- ---- --------------- ------- --------------------- ------\n");
+	Com_Printf("num score ping name            lastmsg address               qport  comp\n");
+	Com_Printf("--- ----- ---- --------------- ------- --------------------- ------ -----\n");
 
 	for (i = 0, cl = svs.clients; i < maxclients->value; i++, cl++)
 	{
@@ -440,7 +440,18 @@ SV_Status_f(void)
 			Com_Printf(" ");
 		}
 
-		Com_Printf("%5i", cl->netchan.qport);
+		Com_Printf("%5i ", cl->netchan.qport);
+
+		/* compressed size in percent of the raw size */
+		if (cl->netchan.compression && cl->netchan.rawbytes)
+		{
+			Com_Printf("%5i%%", (int)(cl->netchan.sentbytes * 100 /
+						cl->netchan.rawbytes));
+		}
+		else
+		{
+			Com_Printf("    -");
+		}
 
 		Com_Printf("\n");
 	}
@@ -543,7 +554,6 @@ SV_ServerRecord_f(void)
 	char name[MAX_OSPATH];
 	byte buf_data[32768];
 	sizebuf_t buf;
-	int len;
 	int i;
 
 	if (Cmd_Argc() != 2)
@@ -575,16 +585,17 @@ SV_ServerRecord_f(void)
 	/* open the demo file */
 	Com_sprintf(name, sizeof(name), "%s/demos/%s.dm2", FS_Gamedir(), Cmd_Argv(1));
 
-	Com_Printf("recording to %s.\n", name);
 	FS_CreatePath(name);
-	svs.demofile = Q_fopen(name, "wb");
+	svs.demofile = DemoWriter_Open(name);
 
 	if (!svs.demofile)
 	{
-		Com_Printf("ERROR: couldn't open.\n");
+		Com_Printf("ERROR: couldn't open %s.\n", name);
 		return;
 	}
 
+	Com_Printf("recording to %s.\n", DemoWriter_Name(svs.demofile));
+
 	/* setup a buffer to catch all multicasts */
 	SZ_Init(&svs.demo_multicast, svs.demo_multicast_buf,
 			sizeof(svs.demo_multicast_buf));
@@ -617,7 +628,7 @@ SV_ServerRecord_f(void)
 			if (buf.cursize + 67 >= buf.maxsize)
 			{
 				Com_Printf("not enough buffer space available.\n");
-				fclose(svs.demofile);
+				DemoWriter_Close(svs.demofile);
 				svs.demofile = NULL;
 				return;
 			}
@@ -626,9 +637,7 @@ SV_ServerRecord_f(void)
 
 	/* write it to the demo file */
 	Com_DPrintf("signon message length: %i\n", buf.cursize);
-	len = LittleLong(buf.cursize);
-	fwrite(&len, 4, 1, svs.demofile);
-	fwrite(buf.data, buf.cursize, 1, svs.demofile);
+	DemoWriter_WriteMessage(svs.demofile, buf.data, buf.cursize);
 }
 
 /*
@@ -643,11 +652,50 @@ SV_ServerStop_f(void)
 		return;
 	}
 
-	fclose(svs.demofile);
+	DemoWriter_Close(svs.demofile);
 	svs.demofile = NULL;
 	Com_Printf("Recording completed.\n");
 }
 
+/*
+ * demo_seek <seconds|+seconds|-seconds>
+ * Jumps to an absolute or relative position in the running demo
+ */
+void
+SV_DemoSeek_f(void)
+{
+	char *arg;
+	int message;
+
+	if ((sv.state != ss_demo) || !sv.demofile)
+	{
+		Com_Printf("No demo is playing.\n");
+		return;
+	}
+
+	if (Cmd_Argc() != 2)
+	{
+		Com_Printf("demo_seek <seconds|+seconds|-seconds>\n");
+		Com_Printf("at %i seconds, %i keyframes\n", sv.demomessage / 10,
+				sv.numdemokeys);
+		return;
+	}
+
+	/* the demo advances 10 messages per second */
+	arg = Cmd_Argv(1);
+	message = (int)(atof(arg) * 10);
+
+	if ((arg[0] == '+') || (arg[0] == '-'))
+	{
+		message += sv.demomessage;
+	}
+
+	if (!SV_DemoSeek(message))
+	{
+		Com_Printf("Couldn't seek in the demo.\n");
+	}
+}
+
 /*
  * Kick everyone off, possibly in preparation for a new game
  */
@@ -774,11 +822,13 @@ SV_InitOperatorCommands(void)
 
 	Cmd_AddCommand("serverrecord", SV_ServerRecord_f);
 	Cmd_AddCommand("serverstop", SV_ServerStop_f);
+	Cmd_AddCommand("demo_seek", SV_DemoSeek_f);
 
 	Cmd_AddCommand("save", SV_Savegame_f);
 	Cmd_AddCommand("load", SV_Loadgame_f);
 
 	Cmd_AddCommand("killserver", SV_KillServer_f);
+	Cmd_AddCommand("bench", SV_Bench_f);
 
 	Cmd_AddCommand("sv", SV_ServerCommand_f);
 }
@@ -30,12 +30,150 @@ extern cvar_t *hostname;
 extern cvar_t *rcon_password;
 char *SV_StatusString(void);
 
+/* Number of per address token buckets limiting
+   connectionless packets. An address hashes to a
+   set of RATE_WAYS buckets and replaces the least
+   recently used one in it, so memory stays bounded
+   even when the sources are spoofed. Both must be
+   powers of two. */
+#define RATE_BUCKETS 1024
+#define RATE_WAYS 4
+
+typedef struct
+{
+	netadr_t adr;
+	int tokens;     /* in 1/1000 packets */
+	int lasttime;   /* curtime of the last refill */
+} ratebucket_t;
+
+static ratebucket_t ratebuckets[RATE_BUCKETS];
+static ratebucket_t statusbucket;
+
+/*
+ * Refills the bucket for the time passed since the last call
+ * and takes a token out of it. rate is in packets per second,
+ * the bucket holds up to one second worth of tokens.
+ */
+static qboolean
+SVC_TakeToken(ratebucket_t *bucket, int rate)
+{
+	int elapsed;
+
+	if (rate <= 0)
+	{
+		return true; /* unlimited */
+	}
+
+	if (rate > 100000)
+	{
+		rate = 100000;
+	}
+
+	elapsed = curtime - bucket->lasttime;
+	bucket->lasttime = curtime;
+
+	if ((elapsed < 0) || (elapsed > 1000))
+	{
+		elapsed = 1000;
+	}
+
+	bucket->tokens += elapsed * rate;
+
+	if (bucket->tokens > rate * 1000)
+	{
+		bucket->tokens = rate * 1000;
+	}
+
+	if (bucket->tokens < 1000)
+	{
+		return false;
+	}
+
+	bucket->tokens -= 1000;
+
+	return true;
+}
+
+/*
+ * Returns false if the sender of the current
+ * connectionless packet exceeded its rate.
+ */
+static qboolean
+SVC_RateLimit(void)
+{
+	ratebucket_t *set, *bucket;
+	int i;
+
+	if (NET_IsLocalAddress(net_from))
+	{
+		return true;
+	}
+
+	set = &ratebuckets[(SV_HashAdr(&net_from, 0) &
+			(RATE_BUCKETS / RATE_WAYS - 1)) * RATE_WAYS];
+	bucket = set;
+
+	for (i = 0; i < RATE_WAYS; i++)
+	{
+		if (NET_CompareBaseAdr(net_from, set[i].adr))
+		{
+			bucket = &set[i];
+			break;
+		}
+
+		if (set[i].lasttime < bucket->lasttime)
+		{
+			bucket = &set[i];
+		}
+	}
+
+	if (i == RATE_WAYS)
+	{
+		/* a new source starts with a full bucket, taken
+		   from the source that was quiet the longest */
+		bucket->adr = net_from;
+		bucket->tokens = 0;
+		bucket->lasttime = curtime - 1000;
+	}
+
+	return SVC_TakeToken(bucket, (int)sv_conless_rate->value);
+}
+
+/*
+ * Returns the challenge slot of the current
+ * packets sender, NULL if there's none.
+ */
+static challenge_t *
+SVC_FindChallenge(void)
+{
+	challenge_t *ch;
+
+	ch = svs.challengehash[SV_HashAdr(&net_from, 0) & (CHALLENGE_HASH_SIZE - 1)];
+
+	for ( ; ch; ch = ch->hashnext)
+	{
+		if (NET_CompareBaseAdr(net_from, ch->adr))
+		{
+			return ch;
+		}
+	}
+
+	return NULL;
+}
+
 /*
  * Responds with all the info that qplug or qspy can see
  */
 void
 SVC_Status(void)
 {
+	/* status replies are large, limit them
+	   even when the sources are spoofed */
+	if (!SVC_TakeToken(&statusbucket, (int)sv_status_rate->value))
+	{
+		return;
+	}
+
 	Netchan_OutOfBandPrint(NS_SERVER, net_from, "print\n%s", SV_StatusString());
 }
 
@@ -61,6 +199,11 @@ SVC_Info(void)
 		return; /* ignore in single player */
 	}
 
+	if (!SVC_TakeToken(&statusbucket, (int)sv_status_rate->value))
+	{
+		return;
+	}
+
 	version = (int)strtol(Cmd_Argv(1), (char **)NULL, 10);
 
 	if (version != PROTOCOL_VERSION)
@@ -107,40 +250,47 @@ SVC_Ping(void)
 void
 SVC_GetChallenge(void)
 {
-	int i;
-	int oldest;
-	int oldestTime;
-
-	oldest = 0;
-	oldestTime = 0x7fffffff;
+	challenge_t *ch;
+	challenge_t **link;
 
 	/* see if we already have a challenge for this ip */
-	for (i = 0; i < MAX_CHALLENGES; i++)
+	ch = SVC_FindChallenge();
+
+	if (!ch)
 	{
-		if (NET_CompareBaseAdr(net_from, svs.challenges[i].adr))
-		{
-			break;
-		}
+		/* overwrite the oldest. challenges are never
+		   refreshed, so that's the one written first */
+		ch = &svs.challenges[svs.nextchallenge];
+		svs.nextchallenge = (svs.nextchallenge + 1) % MAX_CHALLENGES;
 
-		if (svs.challenges[i].time < oldestTime)
+		if (ch->time)
 		{
-			oldestTime = svs.challenges[i].time;
-			oldest = i;
+			link = &svs.challengehash[SV_HashAdr(&ch->adr, 0) &
+				(CHALLENGE_HASH_SIZE - 1)];
+
+			for ( ; *link; link = &(*link)->hashnext)
+			{
+				if (*link == ch)
+				{
+					*link = ch->hashnext;
+					break;
+				}
+			}
 		}
-	}
 
-	if (i == MAX_CHALLENGES)
-	{
-		/* overwrite the oldest */
-		svs.challenges[oldest].challenge = randk() & 0x7fff;
-		svs.challenges[oldest].adr = net_from;
-		svs.challenges[oldest].time = curtime;
-		i = oldest;
+		ch->challenge = randk() & 0x7fff;
+		ch->adr = net_from;
+		ch->time = curtime ? curtime : 1;
+
+		link = &svs.challengehash[SV_HashAdr(&ch->adr, 0) &
+			(CHALLENGE_HASH_SIZE - 1)];
+		ch->hashnext = *link;
+		*link = ch;
 	}
 
 	/* send it back */
 	Netchan_OutOfBandPrint(NS_SERVER, net_from, "challenge %i p=34",
-			svs.challenges[i].challenge);
+			ch->challenge);
 }
 
 /*
@@ -159,6 +309,8 @@ SVC_DirectConnect(void)
 	int version;
 	int qport;
 	int challenge;
+	int extensions;
+	challenge_t *ch;
 
 	adr = net_from;
 
@@ -179,6 +331,36 @@ SVC_DirectConnect(void)
 
 	Q_strlcpy(userinfo, Cmd_Argv(4), sizeof(userinfo));
 
+	/* protocol extensions offered by the client,
+	   old clients don't send them */
+	extensions = 0;
+
+	for (i = 5; i < Cmd_Argc(); i++)
+	{
+		if (!strncmp(Cmd_Argv(i), "ext=", 4))
+		{
+			extensions = (int)strtol(Cmd_Argv(i) + 4, (char **)NULL, 10);
+		}
+	}
+
+	extensions &= PROTOCOL_EXT_SUPPORTED;
+
+	if (!sv_fragment->value)
+	{
+		extensions &= ~PROTOCOL_EXT_FRAGMENT;
+	}
+
+	if (!sv_bitdelta->value)
+	{
+		extensions &= ~PROTOCOL_EXT_BITDELTA;
+	}
+
+	/* not worth the CPU time for the local client */
+	if (!sv_compress->value || (adr.type == NA_LOOPBACK))
+	{
+		extensions &= ~PROTOCOL_EXT_COMPRESS;
+	}
+
 	/* force the IP key/value pair so the game can filter based on ip */
 	Info_SetValueForKey(userinfo, "ip", NET_AdrToString(net_from));
 
@@ -197,25 +379,19 @@ SVC_DirectConnect(void)
 	/* see if the challenge is valid */
 	if (!NET_IsLocalAddress(adr))
 	{
-		for (i = 0; i < MAX_CHALLENGES; i++)
-		{
-			if (NET_CompareBaseAdr(net_from, svs.challenges[i].adr))
-			{
-				if (challenge == svs.challenges[i].challenge)
-				{
-					break; /* good */
-				}
+		ch = SVC_FindChallenge();
 
-				Netchan_OutOfBandPrint(NS_SERVER, adr,
-						"print\nBad challenge.\n");
-				return;
-			}
+		if (!ch)
+		{
+			Netchan_OutOfBandPrint(NS_SERVER, adr,
+					"print\nNo challenge for address.\n");
+			return;
 		}
 
-		if (i == MAX_CHALLENGES)
+		if (challenge != ch->challenge)
 		{
 			Netchan_OutOfBandPrint(NS_SERVER, adr,
-					"print\nNo challenge for address.\n");
+					"print\nBad challenge.\n");
 			return;
 		}
 	}
@@ -271,6 +447,7 @@ gotnewcl:
 
 	/* build a new connection  accept the new client this
 	   is the only place a client_t is ever initialized */
+	SV_UnhashClient(newcl);
 	*newcl = temp;
 	sv_client = newcl;
 	edictnum = (newcl - svs.clients) + 1;
@@ -304,14 +481,28 @@ gotnewcl:
 	/* send the connect packet to the client */
 	if (sv_downloadserver->string[0])
 	{
-		Netchan_OutOfBandPrint(NS_SERVER, adr, "client_connect dlserver=%s", sv_downloadserver->string);
+		Netchan_OutOfBandPrint(NS_SERVER, adr, "client_connect dlserver=%s ext=%i",
+				sv_downloadserver->string, extensions);
 	}
 	else
 	{
-		Netchan_OutOfBandPrint(NS_SERVER, adr, "client_connect");
+		Netchan_OutOfBandPrint(NS_SERVER, adr, "client_connect ext=%i", extensions);
 	}
 
 	Netchan_Setup(NS_SERVER, &newcl->netchan, adr, qport);
+	newcl->extensions = extensions;
+
+	if (extensions & PROTOCOL_EXT_FRAGMENT)
+	{
+		Netchan_EnableFragments(&newcl->netchan);
+	}
+
+	if (extensions & PROTOCOL_EXT_COMPRESS)
+	{
+		Netchan_EnableCompression(&newcl->netchan);
+	}
+
+	SV_HashClient(newcl);
 
 	newcl->state = cs_connected;
 
@@ -399,6 +590,13 @@ SV_ConnectionlessPacket(void)
 	MSG_BeginReading(&net_message);
 	MSG_ReadLong(&net_message); /* skip the -1 marker */
 
+	/* floods and scanners shouldn't eat the frame */
+	if (!SVC_RateLimit())
+	{
+		Com_DPrintf("Rate limited %s\n", NET_AdrToString(net_from));
+		return;
+	}
+
 	s = MSG_ReadStringLine(&net_message);
 
 	Cmd_TokenizeString(s, false);
@@ -33,19 +33,42 @@
 // DG: is casted to int32_t* in SV_FatPVS() so align accordingly
 static YQ2_ALIGNAS_TYPE(int32_t) byte fatpvs[65536 / 8];
 
+/* entity updates competing for the
+   bandwidth in SV_CullClientFrame() */
+typedef struct
+{
+	int index;                  /* into the frame's entity list */
+	int size;                   /* bits of the delta */
+	float priority;             /* lower values are sent first */
+	entity_state_t *oldstate;   /* what the client has, NULL for new entities */
+} cullent_t;
+
+static cullent_t cullents[MAX_EDICTS];
+
+/* upper bound of a single entity delta in
+   bits, in both the byte and the bit packed
+   encoding */
+#define CULL_MAXDELTA (48 * 8)
+
+/* longest bit packed entity number */
+#define CULL_NUMBERSLACK 12
+
 /*
  * Writes a delta update of an entity_state_t list to the message.
+ * With bitdelta the bit packed svc_bitentities is used.
  */
 void
-SV_EmitPacketEntities(client_frame_t *from, client_frame_t *to, sizebuf_t *msg)
+SV_EmitPacketEntities(client_frame_t *from, client_frame_t *to, sizebuf_t *msg,
+		qboolean bitdelta)
 {
 	entity_state_t *oldent, *newent;
 	int oldindex, newindex;
 	int oldnum, newnum;
 	int from_num_entities;
+	int lastnum;
 	int bits;
 
-	MSG_WriteByte(msg, svc_packetentities);
+	MSG_WriteByte(msg, bitdelta ? svc_bitentities : svc_packetentities);
 
 	if (!from)
 	{
@@ -60,10 +83,11 @@ SV_EmitPacketEntities(client_frame_t *from, client_frame_t *to, sizebuf_t *msg)
 	oldindex = 0;
 	newent = NULL;
 	oldent = NULL;
+	lastnum = 0;
 
 	while (newindex < to->num_entities || oldindex < from_num_entities)
 	{
-		if (msg->cursize > MAX_MSGLEN - 150)
+		if (msg->cursize > msg->maxsize - 150)
 		{
 			break;
 		}
@@ -97,8 +121,17 @@ SV_EmitPacketEntities(client_frame_t *from, client_frame_t *to, sizebuf_t *msg)
 			   being emited if the entity has not changed at all
 			   note that players are always 'newentities', this
 			   updates their oldorigin always and prevents warping */
-			MSG_WriteDeltaEntity(oldent, newent, msg,
-					false, newent->number <= maxclients->value);
+			if (!bitdelta)
+			{
+				MSG_WriteDeltaEntity(oldent, newent, msg,
+						false, newent->number <= maxclients->value);
+			}
+			else if (MSG_WriteDeltaEntityBits(oldent, newent, msg,
+						false, newent->number <= maxclients->value, lastnum))
+			{
+				lastnum = newnum;
+			}
+
 			oldindex++;
 			newindex++;
 			continue;
@@ -107,7 +140,17 @@ SV_EmitPacketEntities(client_frame_t *from, client_frame_t *to, sizebuf_t *msg)
 		if (newnum < oldnum)
 		{
 			/* this is a new entity, send it from the baseline */
-			MSG_WriteDeltaEntity(&sv.baselines[newnum], newent, msg, true, true);
+			if (bitdelta)
+			{
+				MSG_WriteDeltaEntityBits(&sv.baselines[newnum], newent, msg,
+						true, true, lastnum);
+				lastnum = newnum;
+			}
+			else
+			{
+				MSG_WriteDeltaEntity(&sv.baselines[newnum], newent, msg, true, true);
+			}
+
 			newindex++;
 			continue;
 		}
@@ -115,6 +158,15 @@ SV_EmitPacketEntities(client_frame_t *from, client_frame_t *to, sizebuf_t *msg)
 		if (newnum > oldnum)
 		{
 			/* the old entity isn't present in the new message */
+			if (bitdelta)
+			{
+				MSG_WriteEntityNumberBits(msg, oldnum, lastnum);
+				MSG_WriteBits(msg, 1, 1);
+				lastnum = oldnum;
+				oldindex++;
+				continue;
+			}
+
 			bits = U_REMOVE;
 
 			if (oldnum >= 256)
@@ -143,251 +195,43 @@ SV_EmitPacketEntities(client_frame_t *from, client_frame_t *to, sizebuf_t *msg)
 		}
 	}
 
-	MSG_WriteShort(msg, 0);
-}
-
-void
-SV_WritePlayerstateToClient(client_frame_t *from, client_frame_t *to,
-		sizebuf_t *msg)
-{
-	int i;
-	int pflags;
-	player_state_t *ps, *ops;
-	player_state_t dummy;
-	int statbits;
-
-	ps = &to->ps;
-
-	if (!from)
+	if (bitdelta)
 	{
-		memset(&dummy, 0, sizeof(dummy));
-		ops = &dummy;
+		MSG_WriteEntityNumberBits(msg, 0, lastnum);
 	}
 	else
 	{
-		ops = &from->ps;
-	}
-
-	/* determine what needs to be sent */
-	pflags = 0;
-
-	if (ps->pmove.pm_type != ops->pmove.pm_type)
-	{
-		pflags |= PS_M_TYPE;
-	}
-
-	if ((ps->pmove.origin[0] != ops->pmove.origin[0]) ||
-		(ps->pmove.origin[1] != ops->pmove.origin[1]) ||
-		(ps->pmove.origin[2] != ops->pmove.origin[2]))
-	{
-		pflags |= PS_M_ORIGIN;
-	}
-
-	if ((ps->pmove.velocity[0] != ops->pmove.velocity[0]) ||
-		(ps->pmove.velocity[1] != ops->pmove.velocity[1]) ||
-		(ps->pmove.velocity[2] != ops->pmove.velocity[2]))
-	{
-		pflags |= PS_M_VELOCITY;
-	}
-
-	if (ps->pmove.pm_time != ops->pmove.pm_time)
-	{
-		pflags |= PS_M_TIME;
-	}
-
-	if (ps->pmove.pm_flags != ops->pmove.pm_flags)
-	{
-		pflags |= PS_M_FLAGS;
-	}
-
-	if (ps->pmove.gravity != ops->pmove.gravity)
-	{
-		pflags |= PS_M_GRAVITY;
-	}
-
-	if ((ps->pmove.delta_angles[0] != ops->pmove.delta_angles[0]) ||
-		(ps->pmove.delta_angles[1] != ops->pmove.delta_angles[1]) ||
-		(ps->pmove.delta_angles[2] != ops->pmove.delta_angles[2]))
-	{
-		pflags |= PS_M_DELTA_ANGLES;
-	}
-
-	if ((ps->viewoffset[0] != ops->viewoffset[0]) ||
-		(ps->viewoffset[1] != ops->viewoffset[1]) ||
-		(ps->viewoffset[2] != ops->viewoffset[2]))
-	{
-		pflags |= PS_VIEWOFFSET;
-	}
-
-	if ((ps->viewangles[0] != ops->viewangles[0]) ||
-		(ps->viewangles[1] != ops->viewangles[1]) ||
-		(ps->viewangles[2] != ops->viewangles[2]))
-	{
-		pflags |= PS_VIEWANGLES;
-	}
-
-	if ((ps->kick_angles[0] != ops->kick_angles[0]) ||
-		(ps->kick_angles[1] != ops->kick_angles[1]) ||
-		(ps->kick_angles[2] != ops->kick_angles[2]))
-	{
-		pflags |= PS_KICKANGLES;
-	}
-
-	if ((ps->blend[0] != ops->blend[0]) ||
-		(ps->blend[1] != ops->blend[1]) ||
-		(ps->blend[2] != ops->blend[2]) ||
-		(ps->blend[3] != ops->blend[3]))
-	{
-		pflags |= PS_BLEND;
-	}
-
-	if (ps->fov != ops->fov)
-	{
-		pflags |= PS_FOV;
-	}
-
-	if (ps->rdflags != ops->rdflags)
-	{
-		pflags |= PS_RDFLAGS;
-	}
-
-	if ((ps->gunframe != ops->gunframe) ||
-		/* added so weapon angle/offset update during pauseframes */
-		(ps->gunoffset[0] != ops->gunoffset[0]) ||
-		(ps->gunoffset[1] != ops->gunoffset[1]) ||
-		(ps->gunoffset[2] != ops->gunoffset[2]) ||
-
-		(ps->gunangles[0] != ops->gunangles[0]) ||
-		(ps->gunangles[1] != ops->gunangles[1]) ||
-		(ps->gunangles[2] != ops->gunangles[2]))
-	{
-		pflags |= PS_WEAPONFRAME;
-	}
-
-	pflags |= PS_WEAPONINDEX;
-
-	/* write it */
-	MSG_WriteByte(msg, svc_playerinfo);
-	MSG_WriteShort(msg, pflags);
-
-	/* write the pmove_state_t */
-	if (pflags & PS_M_TYPE)
-	{
-		MSG_WriteByte(msg, ps->pmove.pm_type);
-	}
-
-	if (pflags & PS_M_ORIGIN)
-	{
-		MSG_WriteShort(msg, ps->pmove.origin[0]);
-		MSG_WriteShort(msg, ps->pmove.origin[1]);
-		MSG_WriteShort(msg, ps->pmove.origin[2]);
-	}
-
-	if (pflags & PS_M_VELOCITY)
-	{
-		MSG_WriteShort(msg, ps->pmove.velocity[0]);
-		MSG_WriteShort(msg, ps->pmove.velocity[1]);
-		MSG_WriteShort(msg, ps->pmove.velocity[2]);
-	}
-
-	if (pflags & PS_M_TIME)
-	{
-		MSG_WriteByte(msg, ps->pmove.pm_time);
-	}
-
-	if (pflags & PS_M_FLAGS)
-	{
-		MSG_WriteByte(msg, ps->pmove.pm_flags);
-	}
-
-	if (pflags & PS_M_GRAVITY)
-	{
-		MSG_WriteShort(msg, ps->pmove.gravity);
-	}
-
-	if (pflags & PS_M_DELTA_ANGLES)
-	{
-		MSG_WriteShort(msg, ps->pmove.delta_angles[0]);
-		MSG_WriteShort(msg, ps->pmove.delta_angles[1]);
-		MSG_WriteShort(msg, ps->pmove.delta_angles[2]);
-	}
-
-	/* write the rest of the player_state_t */
-	if (pflags & PS_VIEWOFFSET)
-	{
-		MSG_WriteChar(msg, ps->viewoffset[0] * 4);
-		MSG_WriteChar(msg, ps->viewoffset[1] * 4);
-		MSG_WriteChar(msg, ps->viewoffset[2] * 4);
-	}
-
-	if (pflags & PS_VIEWANGLES)
-	{
-		MSG_WriteAngle16(msg, ps->viewangles[0]);
-		MSG_WriteAngle16(msg, ps->viewangles[1]);
-		MSG_WriteAngle16(msg, ps->viewangles[2]);
-	}
-
-	if (pflags & PS_KICKANGLES)
-	{
-		MSG_WriteChar(msg, ps->kick_angles[0] * 4);
-		MSG_WriteChar(msg, ps->kick_angles[1] * 4);
-		MSG_WriteChar(msg, ps->kick_angles[2] * 4);
-	}
-
-	if (pflags & PS_WEAPONINDEX)
-	{
-		MSG_WriteByte(msg, ps->gunindex);
-	}
-
-	if (pflags & PS_WEAPONFRAME)
-	{
-		MSG_WriteByte(msg, ps->gunframe);
-		MSG_WriteChar(msg, ps->gunoffset[0] * 4);
-		MSG_WriteChar(msg, ps->gunoffset[1] * 4);
-		MSG_WriteChar(msg, ps->gunoffset[2] * 4);
-		MSG_WriteChar(msg, ps->gunangles[0] * 4);
-		MSG_WriteChar(msg, ps->gunangles[1] * 4);
-		MSG_WriteChar(msg, ps->gunangles[2] * 4);
-	}
-
-	if (pflags & PS_BLEND)
-	{
-		MSG_WriteByte(msg, ps->blend[0] * 255);
-		MSG_WriteByte(msg, ps->blend[1] * 255);
-		MSG_WriteByte(msg, ps->blend[2] * 255);
-		MSG_WriteByte(msg, ps->blend[3] * 255);
+		MSG_WriteShort(msg, 0);
 	}
+}
 
-	if (pflags & PS_FOV)
-	{
-		MSG_WriteByte(msg, ps->fov);
-	}
+void
+SV_WritePlayerstateToClient(client_frame_t *from, client_frame_t *to,
+		sizebuf_t *msg)
+{
+	MSG_WriteDeltaPlayerstate(from ? &from->ps : NULL, &to->ps, msg);
+}
 
-	if (pflags & PS_RDFLAGS)
+/*
+ * Returns the frame the next update to the client is
+ * delta compressed against, NULL for a full update.
+ */
+static client_frame_t *
+SV_DeltaFrame(client_t *client)
+{
+	if (client->lastframe <= 0)
 	{
-		MSG_WriteByte(msg, ps->rdflags);
+		/* client is asking for a retransmit */
+		return NULL;
 	}
-
-	/* send stats */
-	statbits = 0;
-
-	for (i = 0; i < MAX_STATS; i++)
+	else if (sv.framenum - client->lastframe >= (UPDATE_BACKUP - 3))
 	{
-		if (ps->stats[i] != ops->stats[i])
-		{
-			statbits |= 1 << i;
-		}
+		/* client hasn't gotten a good message through in a long time */
+		return NULL;
 	}
 
-	MSG_WriteLong(msg, statbits);
-
-	for (i = 0; i < MAX_STATS; i++)
-	{
-		if (statbits & (1 << i))
-		{
-			MSG_WriteShort(msg, ps->stats[i]);
-		}
-	}
+	/* we have a valid message to delta from */
+	return &client->frames[client->lastframe & UPDATE_MASK];
 }
 
 void
@@ -399,24 +243,8 @@ SV_WriteFrameToClient(client_t *client, sizebuf_t *msg)
 	/* this is the frame we are creating */
 	frame = &client->frames[sv.framenum & UPDATE_MASK];
 
-	if (client->lastframe <= 0)
-	{
-		/* client is asking for a retransmit */
-		oldframe = NULL;
-		lastframe = -1;
-	}
-	else if (sv.framenum - client->lastframe >= (UPDATE_BACKUP - 3))
-	{
-		/* client hasn't gotten a good message through in a long time */
-		oldframe = NULL;
-		lastframe = -1;
-	}
-	else
-	{
-		/* we have a valid message to delta from */
-		oldframe = &client->frames[client->lastframe & UPDATE_MASK];
-		lastframe = client->lastframe;
-	}
+	oldframe = SV_DeltaFrame(client);
+	lastframe = oldframe ? client->lastframe : -1;
 
 	MSG_WriteByte(msg, svc_frame);
 	MSG_WriteLong(msg, sv.framenum);
@@ -432,7 +260,8 @@ SV_WriteFrameToClient(client_t *client, sizebuf_t *msg)
 	SV_WritePlayerstateToClient(oldframe, frame, msg);
 
 	/* delta encode the entities */
-	SV_EmitPacketEntities(oldframe, frame, msg);
+	SV_EmitPacketEntities(oldframe, frame, msg,
+			(client->extensions & PROTOCOL_EXT_BITDELTA) != 0);
 }
 
 /*
@@ -671,6 +500,440 @@ SV_BuildClientFrame(client_t *client)
 	}
 }
 
+static int
+SV_CullCompare(const void *a, const void *b)
+{
+	const cullent_t *x = a;
+	const cullent_t *y = b;
+
+	if (x->priority < y->priority)
+	{
+		return -1;
+	}
+	else if (x->priority > y->priority)
+	{
+		return 1;
+	}
+
+	return x->index - y->index;
+}
+
+/*
+ * Cheap upper bound of the bits the entity
+ * list of the frame takes, without encoding
+ * anything. Entities that didn't change and
+ * don't carry an event aren't sent at all.
+ */
+static int
+SV_CullUpperBound(client_frame_t *frame, client_frame_t *oldframe)
+{
+	entity_state_t *oldent, *newent;
+	int oldindex, newindex;
+	int oldnum, newnum;
+	int from_num_entities;
+	int bound;
+
+	from_num_entities = oldframe ? oldframe->num_entities : 0;
+
+	bound = 0;
+	newindex = 0;
+	oldindex = 0;
+	newent = NULL;
+	oldent = NULL;
+
+	while (newindex < frame->num_entities || oldindex < from_num_entities)
+	{
+		if (newindex >= frame->num_entities)
+		{
+			newnum = 9999;
+		}
+		else
+		{
+			newent = &svs.client_entities[(frame->first_entity +
+					 newindex) % svs.num_client_entities];
+			newnum = newent->number;
+		}
+
+		if (oldindex >= from_num_entities)
+		{
+			oldnum = 9999;
+		}
+		else
+		{
+			oldent = &svs.client_entities[(oldframe->first_entity +
+					 oldindex) % svs.num_client_entities];
+			oldnum = oldent->number;
+		}
+
+		if (newnum == oldnum)
+		{
+			/* players are always sent as new entities */
+			if (newent->event || (newnum <= maxclients->value) ||
+				memcmp(oldent, newent, sizeof(*newent)))
+			{
+				bound += CULL_MAXDELTA;
+			}
+
+			oldindex++;
+			newindex++;
+		}
+		else
+		{
+			bound += CULL_MAXDELTA;
+
+			if (newnum < oldnum)
+			{
+				newindex++;
+			}
+			else
+			{
+				oldindex++;
+			}
+		}
+	}
+
+	return bound;
+}
+
+/*
+ * Trims the frame built by SV_BuildClientFrame() so that it
+ * fits into budget bytes. Changed entities are ranked by their
+ * distance to the viewer, whether they're in front of him and
+ * for how long their update was already held back. Updates that
+ * don't fit are deferred: known entities keep the state the
+ * client already has, new ones are left out. The next frames
+ * are delta compressed against this one and pick them up.
+ * Returns false if not even the player state fits.
+ */
+qboolean
+SV_CullClientFrame(client_t *client, int budget)
+{
+	client_frame_t *frame, *oldframe;
+	entity_state_t *oldent, *newent;
+	cullent_t *ce;
+	edict_t *ent;
+	sizebuf_t scratch;
+	byte scratch_buf[MAX_MSGLEN];
+	vec3_t org, forward, center, delta;
+	qboolean bitdelta;
+	int oldindex, newindex;
+	int oldnum, newnum;
+	int from_num_entities;
+	int numcull, removed;
+	int total, wanted, limit;
+	int age, bits, lastnum, i, j;
+
+	if (!client->edict->client)
+	{
+		return true; /* not in game yet */
+	}
+
+	frame = &client->frames[sv.framenum & UPDATE_MASK];
+	oldframe = SV_DeltaFrame(client);
+	from_num_entities = oldframe ? oldframe->num_entities : 0;
+	bitdelta = (client->extensions & PROTOCOL_EXT_BITDELTA) != 0;
+
+	/* sizes are counted in bits, the bit
+	   packed encoding doesn't end on bytes.
+	   frame header, areabits, the entity
+	   list's header and end come first */
+	limit = budget * 8;
+	total = (14 + frame->areabytes) * 8;
+
+	SZ_Init(&scratch, scratch_buf, sizeof(scratch_buf));
+	scratch.allowoverflow = true;
+
+	SV_WritePlayerstateToClient(oldframe, frame, &scratch);
+	total += scratch.cursize * 8;
+
+	if (total > limit)
+	{
+		return false;
+	}
+
+	/* most frames fit even if every changed
+	   entity took the longest delta possible
+	   and don't need to be measured */
+	if (total + SV_CullUpperBound(frame, oldframe) <= limit)
+	{
+		for (i = 0; i < frame->num_entities; i++)
+		{
+			newent = &svs.client_entities[(frame->first_entity +
+					 i) % svs.num_client_entities];
+			client->entity_deferred[newent->number] = 0;
+		}
+
+		return true;
+	}
+
+	for (i = 0; i < 3; i++)
+	{
+		org[i] = frame->ps.pmove.origin[i] * 0.125 + frame->ps.viewoffset[i];
+	}
+
+	AngleVectors(frame->ps.viewangles, forward, NULL, NULL);
+
+	/* measure the entity deltas with the
+	   encoding SV_EmitPacketEntities() is
+	   going to use for this client */
+	numcull = 0;
+	wanted = 0;
+	newindex = 0;
+	oldindex = 0;
+	lastnum = 0;
+	newent = NULL;
+	oldent = NULL;
+
+	while (newindex < frame->num_entities || oldindex < from_num_entities)
+	{
+		if (newindex >= frame->num_entities)
+		{
+			newnum = 9999;
+		}
+		else
+		{
+			newent = &svs.client_entities[(frame->first_entity +
+					 newindex) % svs.num_client_entities];
+			newnum = newent->number;
+		}
+
+		if (oldindex >= from_num_entities)
+		{
+			oldnum = 9999;
+		}
+		else
+		{
+			oldent = &svs.client_entities[(oldframe->first_entity +
+					 oldindex) % svs.num_client_entities];
+			oldnum = oldent->number;
+		}
+
+		if (newnum > oldnum)
+		{
+			/* removals are cheap and always sent */
+			if (bitdelta)
+			{
+				total += CULL_NUMBERSLACK + 1;
+				lastnum = oldnum;
+			}
+			else
+			{
+				total += ((oldnum >= 256) ? 4 : 2) * 8;
+			}
+
+			oldindex++;
+			continue;
+		}
+
+		SZ_Clear(&scratch);
+
+		if (newnum == oldnum)
+		{
+			if (!bitdelta)
+			{
+				MSG_WriteDeltaEntity(oldent, newent, &scratch,
+						false, newent->number <= maxclients->value);
+			}
+			else if (MSG_WriteDeltaEntityBits(oldent, newent, &scratch,
+						false, newent->number <= maxclients->value, lastnum))
+			{
+				lastnum = newnum;
+			}
+
+			oldindex++;
+		}
+		else
+		{
+			if (bitdelta)
+			{
+				MSG_WriteDeltaEntityBits(&sv.baselines[newnum], newent,
+						&scratch, true, true, lastnum);
+				lastnum = newnum;
+			}
+			else
+			{
+				MSG_WriteDeltaEntity(&sv.baselines[newnum], newent,
+						&scratch, true, true);
+			}
+
+			oldent = NULL;
+		}
+
+		newindex++;
+
+		bits = scratch.cursize * 8;
+
+		if (scratch.bitpos)
+		{
+			bits -= 8 - scratch.bitpos;
+		}
+
+		/* the player's own entity and
+		   one shot events can't wait */
+		if (!bits || newent->event ||
+			(newnum == NUM_FOR_EDICT(client->edict)))
+		{
+			client->entity_deferred[newnum] = 0;
+			total += bits;
+			continue;
+		}
+
+		ent = EDICT_NUM(newnum);
+		VectorAdd(ent->absmin, ent->absmax, center);
+		VectorScale(center, 0.5, center);
+		VectorSubtract(center, org, delta);
+
+		ce = &cullents[numcull++];
+		ce->index = newindex - 1;
+		ce->size = bits;
+		ce->oldstate = (newnum == oldnum) ? oldent : NULL;
+		ce->priority = VectorLength(delta);
+
+		/* things behind the viewer are less important */
+		if (DotProduct(delta, forward) < 0)
+		{
+			ce->priority *= 2;
+		}
+
+		/* the longer an update waits, the more urgent it gets */
+		age = sv.framenum - client->entity_deferred[newnum];
+
+		if (client->entity_deferred[newnum] && (age > 0))
+		{
+			ce->priority /= 1 + age;
+		}
+
+		wanted += ce->size;
+	}
+
+	if (total > limit)
+	{
+		return false;
+	}
+
+	/* everything fits */
+	if (total + wanted <= limit)
+	{
+		for (i = 0; i < numcull; i++)
+		{
+			newent = &svs.client_entities[(frame->first_entity +
+					 cullents[i].index) % svs.num_client_entities];
+			client->entity_deferred[newent->number] = 0;
+		}
+
+		return true;
+	}
+
+	qsort(cullents, numcull, sizeof(cullents[0]), SV_CullCompare);
+
+	removed = 0;
+
+	for (i = 0; i < numcull; i++)
+	{
+		ce = &cullents[i];
+		newent = &svs.client_entities[(frame->first_entity +
+				 ce->index) % svs.num_client_entities];
+
+		if (total + ce->size <= limit)
+		{
+			client->entity_deferred[newent->number] = 0;
+			total += ce->size;
+			continue;
+		}
+
+		if (!client->entity_deferred[newent->number])
+		{
+			client->entity_deferred[newent->number] = sv.framenum;
+		}
+
+		/* the bit packed number of the entity
+		   sent after this one gets longer */
+		if (bitdelta)
+		{
+			total += CULL_NUMBERSLACK;
+		}
+
+		if (ce->oldstate)
+		{
+			*newent = *ce->oldstate;
+
+			/* the event was sent with the old state */
+			newent->event = 0;
+		}
+		else
+		{
+			newent->number = 0; /* removed below */
+			removed++;
+		}
+	}
+
+	/* close the gaps left by deferred new entities */
+	if (removed)
+	{
+		for (i = 0, j = 0; i < frame->num_entities; i++)
+		{
+			newent = &svs.client_entities[(frame->first_entity +
+					 i) % svs.num_client_entities];
+
+			if (!newent->number)
+			{
+				continue;
+			}
+
+			if (i != j)
+			{
+				svs.client_entities[(frame->first_entity + j) %
+					svs.num_client_entities] = *newent;
+			}
+
+			j++;
+		}
+
+		frame->num_entities = j;
+	}
+
+	return true;
+}
+
+/*
+ * Stores the configstrings as keyframe. Server demo frames
+ * are never delta compressed, so that's all the state the
+ * following messages need.
+ */
+static void
+SV_RecordDemoKeyframe(void)
+{
+	sizebuf_t buf;
+	byte buf_data[MAX_MSGLEN];
+	int i;
+
+	DemoWriter_BeginKeyframe(svs.demofile);
+	SZ_Init(&buf, buf_data, sizeof(buf_data));
+
+	for (i = 0; i < MAX_CONFIGSTRINGS; i++)
+	{
+		if (sv.configstrings[i][0])
+		{
+			if (buf.cursize + strlen(sv.configstrings[i]) + 32 > buf.maxsize)
+			{
+				DemoWriter_WriteMessage(svs.demofile, buf.data, buf.cursize);
+				SZ_Clear(&buf);
+			}
+
+			MSG_WriteByte(&buf, svc_configstring);
+			MSG_WriteShort(&buf, i);
+			MSG_WriteString(&buf, sv.configstrings[i]);
+		}
+	}
+
+	if (buf.cursize)
+	{
+		DemoWriter_WriteMessage(svs.demofile, buf.data, buf.cursize);
+	}
+
+	DemoWriter_EndKeyframe(svs.demofile);
+}
+
 /*
  * Save everything in the world out without deltas.
  * Used for recording footage for merged or assembled demos
@@ -683,7 +946,6 @@ SV_RecordDemoMessage(void)
 	entity_state_t nostate;
 	sizebuf_t buf;
 	byte buf_data[32768];
-	int len;
 
 	if (!svs.demofile)
 	{
@@ -724,8 +986,11 @@ SV_RecordDemoMessage(void)
 	SZ_Clear(&svs.demo_multicast);
 
 	/* now write the entire message to the file, prefixed by the length */
-	len = LittleLong(buf.cursize);
-	fwrite(&len, 4, 1, svs.demofile);
-	fwrite(buf.data, buf.cursize, 1, svs.demofile);
+	DemoWriter_WriteMessage(svs.demofile, buf.data, buf.cursize);
+
+	if (DemoWriter_KeyframeDue(svs.demofile))
+	{
+		SV_RecordDemoKeyframe();
+	}
 }
 
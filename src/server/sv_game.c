@@ -352,6 +352,32 @@ PF_StartSound(edict_t *entity, int channel, int sound_num,
 			volume, attenuation, timeofs);
 }
 
+/*
+ * Wrappers summing up the time spent
+ * in the game's traces and links
+ */
+static trace_t
+PF_trace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end,
+		edict_t *passedict, int contentmask)
+{
+	long long start_time = PROF_START();
+	trace_t trace;
+
+	trace = SV_Trace(start, mins, maxs, end, passedict, contentmask);
+	Prof_Accumulate(PROF_TRACE, start_time);
+
+	return trace;
+}
+
+static void
+PF_linkentity(edict_t *ent)
+{
+	long long start_time = PROF_START();
+
+	SV_LinkEdict(ent);
+	Prof_Accumulate(PROF_LINKEDICT, start_time);
+}
+
 /*
  * Called when either the entire server is being killed, or
  * it is changing to a different game directory.
@@ -394,10 +420,10 @@ SV_InitGameProgs(void)
 	import.centerprintf = PF_centerprintf;
 	import.error = PF_error;
 
-	import.linkentity = SV_LinkEdict;
+	import.linkentity = PF_linkentity;
 	import.unlinkentity = SV_UnlinkEdict;
 	import.BoxEdicts = SV_AreaEdicts;
-	import.trace = SV_Trace;
+	import.trace = PF_trace;
 	import.pointcontents = SV_PointContents;
 	import.setmodel = PF_setmodel;
 	import.inPVS = PF_inPVS;
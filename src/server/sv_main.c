@@ -51,6 +51,13 @@ cvar_t *hostname;
 cvar_t *public_server; /* should heartbeats be sent */
 cvar_t *sv_entfile; /* External entity files. */
 cvar_t *sv_downloadserver; /* Download server. */
+cvar_t *sv_fragment; /* Allow fragmented netchan messages. */
+cvar_t *sv_bitdelta; /* Allow bit packed entity updates. */
+cvar_t *sv_compress; /* Allow compressed messages. */
+cvar_t *sv_ratecull; /* Defer entity updates instead of dropping frames. */
+cvar_t *sv_conless_rate; /* Connectionless packets per second and address. */
+cvar_t *sv_status_rate; /* Status and info replies per second. */
+cvar_t *demo_speed; /* Demo messages played per frame. */
 
 void Master_Shutdown(void);
 void SV_ConnectionlessPacket(void);
@@ -84,7 +91,45 @@ SV_DropClient(client_t *drop)
 }
 
 /*
- * Builds the string that is sent as heartbeats and status replies
+ * Checks if anything shown by SV_StatusString() has
+ * changed since the status string was last built.
+ */
+static qboolean
+SV_StatusChanged(void)
+{
+	int i;
+	client_t *cl;
+	qboolean active;
+
+	if (!svs.statusvalid || serverinfo_modified)
+	{
+		return true;
+	}
+
+	for (i = 0; i < maxclients->value; i++)
+	{
+		cl = &svs.clients[i];
+		active = (cl->state == cs_connected) || (cl->state == cs_spawned);
+
+		if (active != cl->statusactive)
+		{
+			return true;
+		}
+
+		if (active && ((cl->statusfrags != cl->edict->client->ps.stats[STAT_FRAGS]) ||
+					(cl->statusping != cl->ping)))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Builds the string that is sent as heartbeats and status replies.
+ * The string is cached until the serverinfo, a players userinfo,
+ * score or ping changes.
  */
 char *
 SV_StatusString(void)
@@ -96,6 +141,27 @@ SV_StatusString(void)
 	int statusLength;
 	int playerLength;
 
+	if (!SV_StatusChanged())
+	{
+		return status;
+	}
+
+	/* remember what the string is built from */
+	for (i = 0; i < maxclients->value; i++)
+	{
+		cl = &svs.clients[i];
+		cl->statusactive = (cl->state == cs_connected) || (cl->state == cs_spawned);
+
+		if (cl->statusactive)
+		{
+			cl->statusfrags = cl->edict->client->ps.stats[STAT_FRAGS];
+			cl->statusping = cl->ping;
+		}
+	}
+
+	svs.statusvalid = true;
+	serverinfo_modified = false;
+
 	strcpy(status, Cvar_Serverinfo());
 	strcat(status, "\n");
 	statusLength = (int)strlen(status);
@@ -196,10 +262,142 @@ SV_GiveMsec(void)
 	}
 }
 
+/*
+ * Hashes the parts of an address that NET_CompareBaseAdr()
+ * looks at together with seed. The port is left out, since
+ * address translating routers may change it.
+ */
+unsigned
+SV_HashAdr(netadr_t *adr, int seed)
+{
+	unsigned hash;
+	int i;
+
+	hash = adr->type * 31 + seed;
+
+	switch (adr->type)
+	{
+		case NA_IP:
+			for (i = 0; i < 4; i++)
+			{
+				hash = hash * 31 + adr->ip[i];
+			}
+
+			break;
+
+		case NA_IP6:
+			for (i = 0; i < 16; i++)
+			{
+				hash = hash * 31 + adr->ip[i];
+			}
+
+			break;
+
+		case NA_IPX:
+			for (i = 0; i < 10; i++)
+			{
+				hash = hash * 31 + adr->ipx[i];
+			}
+
+			break;
+
+		default:
+			break;
+	}
+
+	hash ^= hash >> 16;
+
+	return hash;
+}
+
+static unsigned
+SV_ClientHashKey(netadr_t *adr, int qport)
+{
+	return SV_HashAdr(adr, qport) & (CLIENT_HASH_SIZE - 1);
+}
+
+/*
+ * Makes a client visible to SV_ReadPackets(). Must
+ * be called after the clients netchan was set up.
+ */
+void
+SV_HashClient(client_t *cl)
+{
+	unsigned key;
+
+	SV_UnhashClient(cl);
+
+	key = SV_ClientHashKey(&cl->netchan.remote_address, cl->netchan.qport);
+	cl->hashnext = svs.clienthash[key];
+	svs.clienthash[key] = cl;
+}
+
+/*
+ * Removes a client from the lookup table. It's
+ * safe to call this for clients not hashed.
+ */
+void
+SV_UnhashClient(client_t *cl)
+{
+	client_t **link;
+
+	link = &svs.clienthash[SV_ClientHashKey(&cl->netchan.remote_address,
+			cl->netchan.qport)];
+
+	for ( ; *link; link = &(*link)->hashnext)
+	{
+		if (*link == cl)
+		{
+			*link = cl->hashnext;
+			break;
+		}
+	}
+
+	cl->hashnext = NULL;
+}
+
+/*
+ * Returns the client a sequenced packet belongs
+ * to or NULL. If more than one client matches,
+ * the one with the lowest slot number wins.
+ */
+static client_t *
+SV_FindClient(netadr_t *adr, int qport)
+{
+	client_t *cl;
+	client_t *best;
+
+	best = NULL;
+
+	for (cl = svs.clienthash[SV_ClientHashKey(adr, qport)]; cl; cl = cl->hashnext)
+	{
+		if (cl->state == cs_free)
+		{
+			continue;
+		}
+
+		if (!NET_CompareBaseAdr(*adr, cl->netchan.remote_address))
+		{
+			continue;
+		}
+
+		if (cl->netchan.qport != qport)
+		{
+			continue;
+		}
+
+		if (!best || (cl < best))
+		{
+			best = cl;
+		}
+	}
+
+	return best;
+}
+
 void
 SV_ReadPackets(void)
 {
-	int i;
 	client_t *cl;
 	int qport;
 
@@ -220,49 +418,31 @@ SV_ReadPackets(void)
 		qport = MSG_ReadShort(&net_message) & 0xffff;
 
 		/* check for packets from connected clients */
-		for (i = 0, cl = svs.clients; i < maxclients->value; i++, cl++)
-		{
-			if (cl->state == cs_free)
-			{
-				continue;
-			}
+		cl = SV_FindClient(&net_from, qport);
 
-			if (!NET_CompareBaseAdr(net_from, cl->netchan.remote_address))
-			{
-				continue;
-			}
+		if (!cl)
+		{
+			continue;
+		}
 
-			if (cl->netchan.qport != qport)
-			{
-				continue;
-			}
+		if (cl->netchan.remote_address.port != net_from.port)
+		{
+			Com_Printf("SV_ReadPackets: fixing up a translated port\n");
+			cl->netchan.remote_address.port = net_from.port;
+		}
 
-			if (cl->netchan.remote_address.port != net_from.port)
+		if (Netchan_Process(&cl->netchan, &net_message))
+		{
+			/* this is a valid, sequenced packet, so process it */
+			if (cl->state != cs_zombie)
 			{
-				Com_Printf("SV_ReadPackets: fixing up a translated port\n");
-				cl->netchan.remote_address.port = net_from.port;
-			}
+				cl->lastmessage = svs.realtime; /* don't timeout */
 
-			if (Netchan_Process(&cl->netchan, &net_message))
-			{
-				/* this is a valid, sequenced packet, so process it */
-				if (cl->state != cs_zombie)
+				if (!(sv.demofile && (sv.state == ss_demo)))
 				{
-					cl->lastmessage = svs.realtime; /* don't timeout */
-
-					if (!(sv.demofile && (sv.state == ss_demo)))
-					{
-						SV_ExecuteClientMessage(cl);
-					}
+					SV_ExecuteClientMessage(cl);
 				}
 			}
-
-			break;
-		}
-
-		if (i != maxclients->value)
-		{
-			continue;
 		}
 	}
 }
@@ -298,6 +478,7 @@ SV_CheckTimeouts(void)
 		if ((cl->state == cs_zombie) &&
 			(cl->lastmessage < zombiepoint))
 		{
+			SV_UnhashClient(cl);
 			cl->state = cs_free; /* can now be reused */
 			continue;
 		}
@@ -307,6 +488,7 @@ SV_CheckTimeouts(void)
 		{
 			SV_BroadcastPrintf(PRINT_HIGH, "%s timed out\n", cl->name);
 			SV_DropClient(cl);
+			SV_UnhashClient(cl);
 			cl->state = cs_free; /* don't bother with zombie state */
 		}
 	}
@@ -334,6 +516,8 @@ SV_PrepWorldFrame(void)
 void
 SV_RunGameFrame(void)
 {
+	int zone;
+
 #ifndef DEDICATED_ONLY
 	if (host_speeds->value)
 	{
@@ -351,7 +535,9 @@ SV_RunGameFrame(void)
 	/* don't run if paused */
 	if (!sv_paused->value || (maxclients->value > 1))
 	{
+		zone = Prof_Begin("G_RunFrame");
 		ge->RunFrame();
+		Prof_End(zone);
 
 		/* never get more than one tic behind */
 		if (sv.time < svs.realtime)
@@ -376,6 +562,8 @@ SV_RunGameFrame(void)
 void
 SV_Frame(int usec)
 {
+	int zone;
+
 #ifndef DEDICATED_ONLY
 	time_before_game = time_after_game = 0;
 #endif
@@ -388,6 +576,8 @@ SV_Frame(int usec)
 
 	svs.realtime += usec / 1000;
 
+	Prof_BeginFrame();
+
 	/* keep the random time dependent */
 	randk();
 
@@ -395,7 +585,9 @@ SV_Frame(int usec)
 	SV_CheckTimeouts();
 
 	/* get packets from clients */
+	zone = Prof_Begin("SV_ReadPackets");
 	SV_ReadPackets();
+	Prof_End(zone);
 
 	/* move autonomous things around if enough time has passed */
 	if (!sv_timedemo->value && (svs.realtime < sv.time))
@@ -411,7 +603,14 @@ SV_Frame(int usec)
 			svs.realtime = sv.time - 100;
 		}
 
-		NET_Sleep(sv.time - svs.realtime);
+#ifdef DEDICATED_ONLY
+		/* the main loop waits for packets itself */
+		if (!eventwait->value)
+#endif
+		{
+			NET_Sleep(sv.time - svs.realtime);
+		}
+
 		return;
 	}
 
@@ -422,19 +621,53 @@ SV_Frame(int usec)
 	SV_GiveMsec();
 
 	/* let everything in the world think and move */
+	zone = Prof_Begin("SV_RunGameFrame");
 	SV_RunGameFrame();
+	Prof_End(zone);
 
 	/* send messages back to the clients that had packets read this frame */
+	zone = Prof_Begin("SV_SendClientMessages");
 	SV_SendClientMessages();
+	Prof_End(zone);
 
 	/* save the entire world state if recording a serverdemo */
+	zone = Prof_Begin("SV_RecordDemoMessage");
 	SV_RecordDemoMessage();
+	Prof_End(zone);
 
 	/* send a heartbeat to the master if needed */
 	Master_Heartbeat();
 
 	/* clear teleport flags, etc for next frame */
 	SV_PrepWorldFrame();
+
+	Prof_EndFrame();
+}
+
+/*
+ * Returns the milliseconds until SV_Frame() runs
+ * the next game frame, 0 if it's already due and
+ * -1 if no server is running.
+ */
+int
+SV_FrameDelay(void)
+{
+	if (!svs.initialized)
+	{
+		return -1;
+	}
+
+	if (sv_timedemo->value || (svs.realtime >= sv.time))
+	{
+		return 0;
+	}
+
+	if (sv.time - svs.realtime > 100)
+	{
+		return 100;
+	}
+
+	return sv.time - svs.realtime;
 }
 
 /*
@@ -533,6 +766,9 @@ SV_UserinfoChanged(client_t *cl)
 	/* call prog code to allow overrides */
 	ge->ClientUserinfoChanged(cl->edict, cl->userinfo);
 
+	/* the name may have changed */
+	svs.statusvalid = false;
+
 	/* name for C code */
 	Q_strlcpy(cl->name, Info_ValueForKey(cl->userinfo, "name"), sizeof(cl->name));
 
@@ -592,6 +828,9 @@ SV_Init(void)
 	Cvar_Get("timelimit", "0", CVAR_SERVERINFO);
 	Cvar_Get("cheats", "0", CVAR_SERVERINFO | CVAR_LATCH);
 	Cvar_Get("protocol", va("%i", PROTOCOL_VERSION), CVAR_SERVERINFO | CVAR_NOSET);
+	/* tells the game how many of its own threads
+	   may run traces at the same time */
+	Cvar_Get("sv_tracethreads", va("%i", CM_MAX_THREADS - 1), CVAR_NOSET);
 	maxclients = Cvar_Get("maxclients", "1", CVAR_SERVERINFO | CVAR_LATCH);
 	hostname = Cvar_Get("hostname", "noname", CVAR_SERVERINFO | CVAR_ARCHIVE);
 	timeout = Cvar_Get("timeout", "125", 0);
@@ -606,6 +845,13 @@ SV_Init(void)
 	allow_download_sounds = Cvar_Get("allow_download_sounds", "1", CVAR_ARCHIVE);
 	allow_download_maps = Cvar_Get("allow_download_maps", "1", CVAR_ARCHIVE);
 	sv_downloadserver = Cvar_Get ("sv_downloadserver", "", 0);
+	sv_fragment = Cvar_Get("sv_fragment", "1", 0);
+	sv_bitdelta = Cvar_Get("sv_bitdelta", "1", 0);
+	sv_compress = Cvar_Get("sv_compress", "1", 0);
+	sv_ratecull = Cvar_Get("sv_ratecull", "1", 0);
+	sv_conless_rate = Cvar_Get("sv_conless_rate", "10", 0);
+	sv_status_rate = Cvar_Get("sv_status_rate", "50", 0);
+	demo_speed = Cvar_Get("demo_speed", "1", 0);
 
 	sv_noreload = Cvar_Get("sv_noreload", "0", 0);
 
@@ -690,10 +936,7 @@ SV_Shutdown(char *finalmsg, qboolean reconnect)
 	SV_ShutdownGameProgs();
 
 	/* free current level */
-	if (sv.demofile)
-	{
-		FS_FCloseFile(sv.demofile);
-	}
+	SV_EndDemoserver();
 
 	memset(&sv, 0, sizeof(sv));
 	Com_SetServerState(sv.state);
@@ -711,7 +954,7 @@ SV_Shutdown(char *finalmsg, qboolean reconnect)
 
 	if (svs.demofile)
 	{
-		fclose(svs.demofile);
+		DemoWriter_Close(svs.demofile);
 	}
 
 	memset(&svs, 0, sizeof(svs));
@@ -26,6 +26,11 @@
 
 #include "header/server.h"
 
+/* limits for sending several demo messages in one
+   frame, the loopback queue holds only a few packets */
+#define DEMO_MAX_MESSAGES 8
+#define DEMO_MAX_BYTES 8192
+
 char sv_outputbuf[SV_OUTPUTBUF_LENGTH];
 
 void
@@ -138,6 +143,108 @@ SV_BroadcastCommand(char *fmt, ...)
 	SV_Multicast(NULL, MULTICAST_ALL_R);
 }
 
+/*
+ * Refreshes the cluster and area of all clients
+ * that moved since the last multicast. Any change
+ * invalidates the cached recipient sets.
+ */
+static void
+SV_UpdateMulticastClients(void)
+{
+	mcastclient_t *mc;
+	client_t *client;
+	int leafnum;
+	int cluster, area;
+	int j;
+
+	for (j = 0, client = svs.clients; j < maxclients->value; j++, client++)
+	{
+		if ((client->state == cs_free) || (client->state == cs_zombie))
+		{
+			continue;
+		}
+
+		mc = &sv.multicast_clients[j];
+
+		if (mc->valid && VectorCompare(mc->origin, client->edict->s.origin))
+		{
+			continue;
+		}
+
+		leafnum = CM_PointLeafnum(client->edict->s.origin);
+		cluster = CM_LeafCluster(leafnum);
+		area = CM_LeafArea(leafnum);
+
+		if (!mc->valid || (mc->cluster != cluster) || (mc->area != area))
+		{
+			sv.multicast_generation++;
+		}
+
+		VectorCopy(client->edict->s.origin, mc->origin);
+		mc->cluster = cluster;
+		mc->area = area;
+		mc->valid = true;
+	}
+}
+
+/*
+ * Returns the clients inside the PVS or PHS of the
+ * given cluster that are connected to its area. The
+ * decompressed row and the area checks are only
+ * redone when a client or an areaportal changed.
+ */
+static mcastset_t *
+SV_MulticastSet(int cluster, int area, qboolean phs)
+{
+	mcastclient_t *mc;
+	mcastset_t *set;
+	byte *mask;
+	int floodversion;
+	int j;
+
+	floodversion = CM_AreaFloodVersion();
+	set = &sv.multicast_sets[((unsigned)cluster * 2 + phs) & (MULTICAST_SETS - 1)];
+
+	if ((set->generation == sv.multicast_generation) &&
+		(set->floodversion == floodversion) &&
+		(set->cluster == cluster) && (set->area == area) &&
+		(set->phs == phs))
+	{
+		return set;
+	}
+
+	set->cluster = cluster;
+	set->area = area;
+	set->phs = phs;
+	set->generation = sv.multicast_generation;
+	set->floodversion = floodversion;
+	memset(set->clients, 0, sizeof(set->clients));
+
+	mask = phs ? CM_ClusterPHS(cluster) : CM_ClusterPVS(cluster);
+
+	for (j = 0, mc = sv.multicast_clients; j < maxclients->value; j++, mc++)
+	{
+		if (!mc->valid || (mc->cluster < 0))
+		{
+			continue;
+		}
+
+		if (!(mask[mc->cluster >> 3] & (1 << (mc->cluster & 7))))
+		{
+			continue;
+		}
+
+		if (!CM_AreasConnected(area, mc->area))
+		{
+			continue;
+		}
+
+		set->clients[j >> 5] |= 1u << (j & 31);
+	}
+
+	return set;
+}
+
 /*
  * Sends the contents of sv.multicast to a subset of the clients,
  * then clears sv.multicast.
@@ -150,23 +257,15 @@ void
 SV_Multicast(vec3_t origin, multicast_t to)
 {
 	client_t *client;
-	byte *mask;
-	int leafnum = 0, cluster;
+	mcastset_t *set;
+	int leafnum, cluster;
 	int j;
-	qboolean reliable;
-	int area1, area2;
+	qboolean reliable, phs;
+	int area1;
 
 	reliable = false;
-
-	if ((to != MULTICAST_ALL_R) && (to != MULTICAST_ALL))
-	{
-		leafnum = CM_PointLeafnum(origin);
-		area1 = CM_LeafArea(leafnum);
-	}
-	else
-	{
-		area1 = 0;
-	}
+	phs = false;
+	set = NULL;
 
 	/* if doing a serverrecord, store everything */
 	if (svs.demofile)
@@ -179,60 +278,59 @@ SV_Multicast(vec3_t origin, multicast_t to)
 		case MULTICAST_ALL_R:
 			reliable = true; /* intentional fallthrough */
 		case MULTICAST_ALL:
-			mask = NULL;
 			break;
 
 		case MULTICAST_PHS_R:
 			reliable = true; /* intentional fallthrough */
 		case MULTICAST_PHS:
-			leafnum = CM_PointLeafnum(origin);
-			cluster = CM_LeafCluster(leafnum);
-			mask = CM_ClusterPHS(cluster);
-			break;
-
+			phs = true; /* intentional fallthrough */
 		case MULTICAST_PVS_R:
-			reliable = true; /* intentional fallthrough */
 		case MULTICAST_PVS:
+			if (to == MULTICAST_PVS_R)
+			{
+				reliable = true;
+			}
+
 			leafnum = CM_PointLeafnum(origin);
 			cluster = CM_LeafCluster(leafnum);
-			mask = CM_ClusterPVS(cluster);
+			area1 = CM_LeafArea(leafnum);
+
+			SV_UpdateMulticastClients();
+			set = SV_MulticastSet(cluster, area1, phs);
 			break;
 
 		default:
-			mask = NULL;
 			Com_Error(ERR_FATAL, "SV_Multicast: bad to:%i", to);
 	}
 
 	/* send the data to all relevent clients */
 	for (j = 0, client = svs.clients; j < maxclients->value; j++, client++)
 	{
-		if ((client->state == cs_free) || (client->state == cs_zombie))
+		if (set)
 		{
-			continue;
-		}
-
-		if ((client->state != cs_spawned) && !reliable)
-		{
-			continue;
-		}
-
-		if (mask)
-		{
-			leafnum = CM_PointLeafnum(client->edict->s.origin);
-			cluster = CM_LeafCluster(leafnum);
-			area2 = CM_LeafArea(leafnum);
-
-			if (!CM_AreasConnected(area1, area2))
+			if (!set->clients[j >> 5])
 			{
+				j |= 31; /* skip the whole word */
+				client = svs.clients + j;
 				continue;
 			}
 
-			if (!(mask[cluster >> 3] & (1 << (cluster & 7))))
+			if (!(set->clients[j >> 5] & (1u << (j & 31))))
 			{
 				continue;
 			}
 		}
 
+		if ((client->state == cs_free) || (client->state == cs_zombie))
+		{
+			continue;
+		}
+
+		if ((client->state != cs_spawned) && !reliable)
+		{
+			continue;
+		}
+
 		if (reliable)
 		{
 			SZ_Write(&client->netchan.message, sv.multicast.data,
@@ -415,20 +513,40 @@ SV_StartSound(vec3_t origin, edict_t *entity, int channel, int soundindex,
 	}
 }
 
+/*
+ * Sends the current frame to the client. If budget isn't
+ * negative, entity updates are deferred to keep the datagram
+ * within that many bytes. Returns false if the frame was
+ * suppressed because not even the player state fits.
+ */
 qboolean
-SV_SendClientDatagram(client_t *client)
+SV_SendClientDatagram(client_t *client, int budget)
 {
-	byte msg_buf[MAX_MSGLEN];
+	byte msg_buf[MAX_BIGMSGLEN];
 	sizebuf_t msg;
+	int zone;
 
+	zone = Prof_Begin("SV_BuildClientFrame");
 	SV_BuildClientFrame(client);
+	Prof_End(zone);
 
-	SZ_Init(&msg, msg_buf, sizeof(msg_buf));
+	if ((budget >= 0) &&
+		!SV_CullClientFrame(client, budget - client->datagram.cursize))
+	{
+		return false;
+	}
+
+	/* clients supporting fragments can take more
+	   entities than fit into a single datagram */
+	SZ_Init(&msg, msg_buf, client->netchan.fragments ?
+			sizeof(msg_buf) - 16 : MAX_MSGLEN);
 	msg.allowoverflow = true;
 
 	/* send over all the relevant entity_state_t
 	   and the player_state_t */
+	zone = Prof_Begin("SV_WriteFrameToClient");
 	SV_WriteFrameToClient(client, &msg);
+	Prof_End(zone);
 
 	/* copy the accumulated multicast datagram
 	   for this client out to the message
@@ -464,13 +582,99 @@ SV_SendClientDatagram(client_t *client)
 void
 SV_DemoCompleted(void)
 {
-	if (sv.demofile)
+	SV_EndDemoserver();
+	SV_Nextserver();
+}
+
+/*
+ * Reads the next message of the demo. At the end of a
+ * keyframe playback continues in the message stream.
+ */
+static qboolean
+SV_ReadDemoMessage(byte *msgbuf, int *msglen)
+{
+	size_t r;
+
+	for ( ; ; )
 	{
-		FS_FCloseFile(sv.demofile);
-		sv.demofile = 0;
+		r = FS_FRead(msglen, 4, 1, sv.demofile);
+
+		if (r != 4)
+		{
+			return false;
+		}
+
+		*msglen = LittleLong(*msglen);
+
+		if ((*msglen == -1) && sv.demokeyframe)
+		{
+			sv.demokeyframe = false;
+
+			if (!FS_Seek(sv.demofile, sv.demoresume))
+			{
+				return false;
+			}
+
+			continue;
+		}
+
+		break;
 	}
 
-	SV_Nextserver();
+	if (*msglen == -1)
+	{
+		return false;
+	}
+
+	if ((*msglen < 0) || (*msglen > MAX_BIGMSGLEN))
+	{
+		Com_Error(ERR_DROP,
+				"SV_ReadDemoMessage: bad msglen %i", *msglen);
+	}
+
+	r = FS_FRead(msgbuf, *msglen, 1, sv.demofile);
+
+	if (r != *msglen)
+	{
+		return false;
+	}
+
+	if (!sv.demokeyframe)
+	{
+		sv.demomessage++;
+
+		if (sv.demoskip > 0)
+		{
+			sv.demoskip--;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Number of demo messages to send this frame. Keyframes and
+ * seeks are played as fast as the clients can take them.
+ */
+static int
+SV_DemoMessagesPerFrame(void)
+{
+	if (sv.demokeyframe || (sv.demoskip > 0))
+	{
+		return DEMO_MAX_MESSAGES;
+	}
+
+	if (demo_speed->value < 1)
+	{
+		return 1;
+	}
+
+	if (demo_speed->value > DEMO_MAX_MESSAGES)
+	{
+		return DEMO_MAX_MESSAGES;
+	}
+
+	return (int)demo_speed->value;
 }
 
 /*
@@ -506,14 +710,44 @@ SV_RateDrop(client_t *c)
 	return false;
 }
 
+/*
+ * Returns how many bytes can be sent to the client this
+ * frame without exceeding its rate, -1 for no limit.
+ */
+static int
+SV_RateBudget(client_t *c)
+{
+	int total;
+	int i;
+
+	/* never limit the loopback */
+	if (c->netchan.remote_address.type == NA_LOOPBACK)
+	{
+		return -1;
+	}
+
+	total = 0;
+
+	/* the current slot is about to be replaced */
+	for (i = 0; i < RATE_MESSAGES; i++)
+	{
+		if (i != sv.framenum % RATE_MESSAGES)
+		{
+			total += c->message_size[i];
+		}
+	}
+
+	return (total < c->rate) ? c->rate - total : 0;
+}
+
 void
 SV_SendClientMessages(void)
 {
-	int i;
+	int i, n, count, total;
+	int budget;
 	client_t *c;
 	int msglen;
-	byte msgbuf[MAX_MSGLEN];
-	size_t r;
+	byte msgbuf[MAX_BIGMSGLEN];
 
 	msglen = 0;
 
@@ -526,39 +760,41 @@ SV_SendClientMessages(void)
 		}
 		else
 		{
-			/* get the next message */
-			r = FS_FRead(&msglen, 4, 1, sv.demofile);
-
-			if (r != 4)
-			{
-				SV_DemoCompleted();
-				return;
-			}
-
-			msglen = LittleLong(msglen);
-
-			if (msglen == -1)
-			{
-				SV_DemoCompleted();
-				return;
-			}
+			/* when seeking or fast-forwarding all but the
+			   last message are sent out right here */
+			count = SV_DemoMessagesPerFrame();
+			total = 0;
 
-			if (msglen > MAX_MSGLEN)
+			for (n = 0; n < count; n++)
 			{
-				Com_Error(ERR_DROP,
-						"SV_SendClientMessages: msglen > MAX_MSGLEN");
-			}
-
-			r = FS_FRead(msgbuf, msglen, 1, sv.demofile);
-
-			if (r != msglen)
-			{
-				SV_DemoCompleted();
-				return;
+				if (!SV_ReadDemoMessage(msgbuf, &msglen))
+				{
+					SV_DemoCompleted();
+					return;
+				}
+
+				total += msglen;
+
+				if ((n == count - 1) || (total >= DEMO_MAX_BYTES))
+				{
+					break;
+				}
+
+				for (i = 0, c = svs.clients; i < maxclients->value; i++, c++)
+				{
+					if (c->state)
+					{
+						Netchan_Transmit(&c->netchan, msglen, msgbuf);
+					}
+				}
 			}
 		}
 	}
 
+	/* the datagrams are written in as few
+	   syscalls as possible after the loop */
+	NET_BeginSendBatch(NS_SERVER);
+
 	/* send a message to each connected client */
 	for (i = 0, c = svs.clients; i < maxclients->value; i++, c++)
 	{
@@ -586,13 +822,27 @@ SV_SendClientMessages(void)
 		}
 		else if (c->state == cs_spawned)
 		{
-			/* don't overrun bandwidth */
-			if (SV_RateDrop(c))
+			/* don't overrun bandwidth, either by
+			   deferring entity updates or by
+			   dropping the whole frame */
+			if (sv_ratecull->value)
+			{
+				budget = SV_RateBudget(c);
+			}
+			else if (SV_RateDrop(c))
 			{
 				continue;
 			}
+			else
+			{
+				budget = -1;
+			}
 
-			SV_SendClientDatagram(c);
+			if (!SV_SendClientDatagram(c, budget))
+			{
+				c->surpressCount++;
+				c->message_size[sv.framenum % RATE_MESSAGES] = 0;
+			}
 		}
 		else
 		{
@@ -604,5 +854,7 @@ SV_SendClientMessages(void)
 			}
 		}
 	}
+
+	NET_FlushSendBatch(NS_SERVER);
 }
 
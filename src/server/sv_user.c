@@ -30,18 +30,172 @@
 
 edict_t *sv_player;
 
+/*
+ * Reads the keyframe index from the end of the demo.
+ * Demos without one can only be fast-forwarded.
+ */
+static void
+SV_LoadDemoIndex(int length)
+{
+	int trailer[3];
+	int ofs, count, i;
+
+	if ((length < sizeof(trailer)) ||
+		!FS_Seek(sv.demofile, length - sizeof(trailer)) ||
+		(FS_FRead(trailer, sizeof(trailer), 1, sv.demofile) != sizeof(trailer)) ||
+		memcmp(&trailer[2], DEMO_INDEX_MAGIC, 4))
+	{
+		FS_Seek(sv.demofile, 0);
+		return;
+	}
+
+	ofs = LittleLong(trailer[0]);
+	count = LittleLong(trailer[1]);
+
+	if ((count <= 0) || (ofs < 0) ||
+		(ofs + count * sizeof(demokey_t) != length - sizeof(trailer)))
+	{
+		Com_Printf("Ignoring broken demo index.\n");
+		FS_Seek(sv.demofile, 0);
+		return;
+	}
+
+	sv.demokeys = Z_Malloc(count * sizeof(demokey_t));
+
+	if (!FS_Seek(sv.demofile, ofs) ||
+		(FS_FRead(sv.demokeys, count * sizeof(demokey_t), 1,
+			sv.demofile) != count * sizeof(demokey_t)))
+	{
+		Com_Printf("Couldn't read the demo index.\n");
+		Z_Free(sv.demokeys);
+		sv.demokeys = NULL;
+		FS_Seek(sv.demofile, 0);
+		return;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		sv.demokeys[i].message = LittleLong(sv.demokeys[i].message);
+		sv.demokeys[i].offset = LittleLong(sv.demokeys[i].offset);
+		sv.demokeys[i].keyoffset = LittleLong(sv.demokeys[i].keyoffset);
+	}
+
+	sv.numdemokeys = count;
+	FS_Seek(sv.demofile, 0);
+}
+
 void
 SV_BeginDemoserver(void)
 {
 	char name[MAX_OSPATH];
+	int length;
+
+	SV_EndDemoserver();
 
 	Com_sprintf(name, sizeof(name), "demos/%s", sv.name);
-	FS_FOpenFile(name, &sv.demofile, false);
+	length = FS_FOpenFile(name, &sv.demofile, false);
 
 	if (!sv.demofile)
 	{
 		Com_Error(ERR_DROP, "Couldn't open %s\n", name);
 	}
+
+	SV_LoadDemoIndex(length);
+}
+
+/*
+ * Closes the demo and frees its index.
+ */
+void
+SV_EndDemoserver(void)
+{
+	if (sv.demofile)
+	{
+		FS_FCloseFile(sv.demofile);
+		sv.demofile = 0;
+	}
+
+	if (sv.demokeys)
+	{
+		Z_Free(sv.demokeys);
+		sv.demokeys = NULL;
+	}
+
+	sv.numdemokeys = 0;
+	sv.demomessage = 0;
+	sv.demoskip = 0;
+	sv.demokeyframe = false;
+}
+
+/*
+ * Moves the playback to the given message. The nearest
+ * keyframe before it is played and the remaining messages
+ * are fast-forwarded. Without a suitable keyframe the demo
+ * is fast-forwarded from the current position or, when
+ * going back, from the start.
+ */
+qboolean
+SV_DemoSeek(int message)
+{
+	demokey_t *key;
+	int i;
+
+	if (!sv.demofile || (sv.state != ss_demo))
+	{
+		return false;
+	}
+
+	if (message < 0)
+	{
+		message = 0;
+	}
+
+	key = NULL;
+
+	for (i = 0; i < sv.numdemokeys; i++)
+	{
+		if (sv.demokeys[i].message > message)
+		{
+			break;
+		}
+
+		key = &sv.demokeys[i];
+	}
+
+	/* going forward and no keyframe in between */
+	if ((message >= sv.demomessage) && !sv.demokeyframe &&
+		(!key || (key->message <= sv.demomessage)))
+	{
+		sv.demoskip = message - sv.demomessage;
+		return true;
+	}
+
+	if (key)
+	{
+		if (!FS_Seek(sv.demofile, key->keyoffset))
+		{
+			return false;
+		}
+
+		sv.demomessage = key->message;
+		sv.demoresume = key->offset;
+		sv.demokeyframe = true;
+	}
+	else
+	{
+		/* restart, the header resets the clients */
+		if (!FS_Seek(sv.demofile, 0))
+		{
+			return false;
+		}
+
+		sv.demomessage = 0;
+		sv.demokeyframe = false;
+	}
+
+	sv.demoskip = message - sv.demomessage;
+
+	return true;
 }
 
 /*
@@ -135,7 +289,7 @@ SV_Configstrings_f(void)
 	start = (int)strtol(Cmd_Argv(2), (char **)NULL, 10);
 
 	/* write a packet full of data */
-	while (sv_client->netchan.message.cursize < MAX_MSGLEN / 2 &&
+	while (sv_client->netchan.message.cursize < sv_client->netchan.message.maxsize / 2 &&
 		   start < MAX_CONFIGSTRINGS)
 	{
 		if (sv.configstrings[start][0])
@@ -191,7 +345,7 @@ SV_Baselines_f(void)
 	memset(&nullstate, 0, sizeof(nullstate));
 
 	/* write a packet full of data */
-	while (sv_client->netchan.message.cursize < MAX_MSGLEN / 2 &&
+	while (sv_client->netchan.message.cursize < sv_client->netchan.message.maxsize / 2 &&
 		   start < MAX_EDICTS)
 	{
 		base = &sv.baselines[start];
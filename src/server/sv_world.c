@@ -45,10 +45,12 @@ typedef struct areanode_s
 areanode_t sv_areanodes[AREA_NODES];
 int sv_numareanodes;
 
-float *area_mins, *area_maxs;
-edict_t **area_list;
-int area_count, area_maxcount;
-int area_type;
+/* state of the running SV_AreaEdicts() query, per
+   thread so traces can run in parallel */
+static YQ2_THREAD_LOCAL float *area_mins, *area_maxs;
+static YQ2_THREAD_LOCAL edict_t **area_list;
+static YQ2_THREAD_LOCAL int area_count, area_maxcount;
+static YQ2_THREAD_LOCAL int area_type;
 
 int SV_HullForEntity(edict_t *ent);
 
@@ -492,6 +494,9 @@ SV_PointContents(vec3_t p)
 	int i, num;
 	int contents, c2;
 	int headnode;
+	int slot;
+
+	slot = CM_AcquireSlot();
 
 	/* get base contents from world */
 	contents = CM_PointContents(p, sv.models[1]->headnode);
@@ -511,6 +516,8 @@ SV_PointContents(vec3_t p)
 		contents |= c2;
 	}
 
+	CM_ReleaseSlot(slot);
+
 	return contents;
 }
 
@@ -676,6 +683,7 @@ SV_Trace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end,
 		edict_t *passedict, int contentmask)
 {
 	moveclip_t clip;
+	int slot;
 
 	if (!mins)
 	{
@@ -689,12 +697,16 @@ SV_Trace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end,
 
 	memset(&clip, 0, sizeof(moveclip_t));
 
+	/* the game may trace from several threads */
+	slot = CM_AcquireSlot();
+
 	/* clip to world */
 	clip.trace = CM_BoxTrace(start, end, mins, maxs, 0, contentmask);
 	clip.trace.ent = ge->edicts;
 
 	if (clip.trace.fraction == 0)
 	{
+		CM_ReleaseSlot(slot);
 		return clip.trace; /* blocked by the world */
 	}
 
@@ -715,6 +727,8 @@ SV_Trace(vec3_t start, vec3_t mins, vec3_t maxs, vec3_t end,
 	/* clip to other solid entities */
 	SV_ClipMoveToEntities(&clip);
 
+	CM_ReleaseSlot(slot);
+
 	return clip.trace;
 }
 